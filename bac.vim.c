@@ -6,23 +6,19 @@
  * [movement]:x
  *
  * keys:
- * - V, v; visual block and visual select modes
- * - %, travel on parens or brackets
+ * - V, v; visual select modes
  * - I; insert at beginning of line
  * - CTRL_W + movement key to move between open frames
- * - r, R; replace current char with given char, or enter replace mode
  * - C; should clear any characters after cursor and enter insert mode
  * - cw; delete next word and enter insert mode
  *
  * commands:
  * - :vsp, sp; have frames open on the left and top first
- * - :e <path>; open file in current frame
  * - :x; should save only if changes were made
  * - !; for forcing commands, force write, force read, etc.
  *
  * tasks:
  * - o,O; when leaving insert mode and undoing, should take you to the location of the 'o' or 'O' command
- * - going to new line should take you to the correct space width
  * - handle automatic block comments?
  * - automatically move back to end of line if cursor is past the end of line when exiting insert
  *
@@ -38,8 +34,27 @@ void vim_exit_insert(int n_args, char **args);
 void vim_write(int n_args, char **args);
 void vim_quit(int n_args, char **args);
 void vim_write_quit(int n_args, char **args);
+void vim_edit(int n_args, char **args);
 void vim_vsp(int n_args, char **args);
 void vim_sp(int n_args, char **args);
+void vim_search(int n_args, char **args);
+void vim_grep_command(int n_args, char **args);
+void vim_qf_next(int n_args, char **args);
+void vim_qf_prev(int n_args, char **args);
+void vim_qf_goto(int n_args, char **args);
+void vim_qf_open(int n_args, char **args);
+void vim_shift_right(int n_args, char **args);
+void vim_shift_left(int n_args, char **args);
+void vim_join_command(int n_args, char **args);
+void vim_fold_indent(int n_args, char **args);
+void vim_command(int n_args, char **args);
+void vim_sort_command(int n_args, char **args);
+void vim_sort_reverse_command(int n_args, char **args);
+void vim_normal_command(int n_args, char **args);
+void vim_stats(int n_args, char **args);
+void vim_trace_dump(int n_args, char **args);
+void vim_flight_dump(int n_args, char **args);
+void vim_flight_replay(int n_args, char **args);
 /* END COMMANDS */
 
 typedef enum Mode {
@@ -48,6 +63,8 @@ typedef enum Mode {
     MODE_DELETE,
     MODE_YANK,
     MODE_VIRTUAL,
+    MODE_VISUAL_BLOCK,
+    MODE_REPLACE,
     /* N_NODES should always be last */
     N_MODES
 } Mode;
@@ -59,7 +76,9 @@ static char *mode_strs[] = {
     "INSERT",
     "DELETE",
     "YANK",
-    "VIRTUAL"
+    "VIRTUAL",
+    "VISUAL BLOCK",
+    "REPLACE"
 };
 
 static char *mode_strs_lowercase[] = {
@@ -67,13 +86,25 @@ static char *mode_strs_lowercase[] = {
     "insert",
     "delete",
     "yank",
-    "virtual"
+    "virtual",
+    "visual-block",
+    "replace"
+};
+
+/* The modes vim-bind and vim-unbind take. */
+static char *bind_mode_strs[] = {
+    "normal",
+    "insert",
+    "delete",
+    "yank",
+    "visual-block",
+    "replace"
 };
 
 static int vim_mode_completion(char *string, yed_completion_results *results) {
     int status;
 
-    FN_BODY_FOR_COMPLETE_FROM_ARRAY(string, 4, mode_strs_lowercase, results, status);
+    FN_BODY_FOR_COMPLETE_FROM_ARRAY(string, sizeof(bind_mode_strs) / sizeof(char*), bind_mode_strs, results, status);
 
     return status;
 }
@@ -89,19 +120,45 @@ typedef struct {
 
 static yed_plugin *Self;
 static Mode mode;
+static Mode reported_mode; /* the mode the last vim-mode-change message was for */
 static array_t mode_bindings[N_MODES];
 static array_t repeat_keys;
 static int repeating;
 static int till_pending; /* 0 = not pending, 1 = pending forward, 2 = pending backward, 3 = pending backward; stop before */
 static int last_till_key;
 static char last_till_op;
+static int count_pending; /* count typed before a command, 0 for none */
+static int nav_count = 1; /* count for the motion vim_nav_common() is doing */
 static int num_undo_records_before_insert;
 
+static array_t _cmd;
+static array_t _cmd_history;
+static yed_cmd_line_readline_ptr_t _cmd_readline;
+
 void vim_unload(yed_plugin *self);
 void vim_normal(int key, char* key_str);
 void vim_insert(int key, char* key_str);
 void vim_delete(int key, char* key_str);
 void vim_yank(int key, char* key_str);
+void vim_visual_block(int key, char* key_str);
+void vim_replace(int key, char* key_str);
+int vim_nav_common(int key, char *key_str);
+static void vim_push_repeat_key(int key);
+static void vim_pop_repeat_key(void);
+static void _vim_take_key(int key, char *maybe_key_str);
+static void vim_state_load_registers(void);
+static void vim_state_load_cmd_history(void);
+static void vim_state_load_search(void);
+static unsigned long long vim_stats_now_us(void);
+static void vim_hold_pumps(int hold);
+static void vim_jump_push(void);
+static void vim_jump_push_pos(yed_buffer *buff, int row, int col);
+static void vim_start_repeat(int key);
+static void vim_repeat(void);
+static void vim_repeat_till(void);
+static void vim_match_pair(void);
+void vim_insert_line(int direction);
+void vim_delete_char_under_cursor();
 void bind_keys(void);
 void vim_change_mode(Mode new_mode, int by_line, int cancel);
 void enter_insert(void);
@@ -110,131 +167,170 @@ void enter_delete(int by_line);
 void exit_delete(int cancel);
 void enter_yank(int by_line);
 void exit_yank(int cancel);
+void enter_visual_block(void);
+void exit_visual_block(int cancel);
+void enter_replace(void);
+void exit_replace(void);
 void vim_make_binding(int b_mode, int n_keys, int *keys, char *cmd, int n_args, char **args);
 void vim_remove_binding(int b_mode, int n_keys, int *keys);
 
-static char EOS = '\0';
-static array_t _number;
+#include "trace.c"
+#include "large.c"
+#include "edit.c"
+#include "command.c"
+#include "open.c"
+#include "search.c"
+#include "grep.c"
+#include "symbols.c"
+#include "registers.c"
+#include "block.c"
+#include "indent.c"
+#include "join.c"
+#include "case.c"
+#include "replace.c"
+#include "marks.c"
+#include "fold.c"
+#include "complete.c"
+#include "sort.c"
+#include "normal.c"
+#include "state.c"
+#include "undo.c"
+#include "stats.c"
+#include "flight.c"
+#include "motions.c"
+#include "keymap.c"
 
-static void _internal_take_key(int key) {
-    int number;
+int yed_plugin_boot(yed_plugin *self) {
+    int                i;
+    unsigned long long start_us;
 
-    if (is_digit(key)) {
-        array_push(_number, key);
-        return;
-    }
-    else if (array_len(_number) > 0) {
-        array_push(_number, EOS);
-        sscanf(array_data(_number), "%d", &number);
-        yed_cprint("Got number: `%d`", number);
-        array_clear(_number);
-    }
+    YED_PLUG_VERSION_CHECK();
 
-    switch (key) {
-        case ESC:
-            vim_quit(0, NULL);
-            break;
+    Self = self;
 
-        default:
-            yed_cerr("Unhandled key %d", key);
-    }
-}
+    start_us = vim_stats_now_us();
 
-void internal_take_key(int n_args, char **args) {
-    int key;
-    if (n_args != 1) {
-        yed_cerr("expected 1 argument, but got %d", n_args);
-        return;
+    vim_trace_make();
+
+    for (i = 0; i < N_MODES; i += 1) {
+        mode_bindings[i] = array_make(vim_key_binding);
     }
-    sscanf(args[0], "%d", &key);
-    _internal_take_key(key);
-}
 
-int yed_plugin_boot(yed_plugin *self) {
-    char  key_str[32];
-    int key;
+    repeat_keys = array_make(int);
+
+    _cmd          = array_make_with_cap(char, 16);
+    _cmd_history  = array_make(char*);
+    _cmd_readline = malloc(sizeof(*ys->search_readline));
+    yed_cmd_line_readline_make(_cmd_readline, &_cmd_history);
+
+    /* first: completion and the symbol index look at the profile on load */
+    vim_large_make();
+    vim_word_index_make();
+    vim_block_make();
+    vim_indent_make();
+    vim_case_make();
+    vim_replace_make();
+    vim_state_make();
+    vim_undo_make();
+    vim_marks_make();
+    vim_fold_make();
+    vim_complete_make();
+    vim_open_make();
+    vim_grep_make();
+    vim_symbols_make();
+
+    yed_plugin_set_unload_fn(Self, vim_unload);
+
+    /* the crash handlers go in once the plugin is registered and set up */
+    vim_flight_make();
+
+    yed_plugin_set_command(Self, "vim-take-key",    vim_take_key);
+    yed_plugin_set_command(Self, "vim-bind",        vim_bind);
+    yed_plugin_set_command(Self, "vim-unbind",      vim_unbind);
+    yed_plugin_set_command(Self, "vim-exit-insert", vim_exit_insert);
+    yed_plugin_set_command(Self, "w",               vim_write);
+    yed_plugin_set_command(Self, "W",               vim_write);
+    yed_plugin_set_command(Self, "q",               vim_quit);
+    yed_plugin_set_command(Self, "Q",               vim_quit);
+    yed_plugin_set_command(Self, "wq",              vim_write_quit);
+    yed_plugin_set_command(Self, "Wq",              vim_write_quit);
+    yed_plugin_set_command(Self, "x",               vim_write_quit);
+    yed_plugin_set_command(Self, "X",               vim_write_quit);
+    yed_plugin_set_command(Self, "e",               vim_edit);
+    yed_plugin_set_command(Self, "edit",            vim_edit);
+    yed_plugin_set_command(Self, "vsp",             vim_vsp);
+    yed_plugin_set_command(Self, "sp",              vim_sp);
+    yed_plugin_set_command(Self, "vimgrep",         vim_grep_command);
+    yed_plugin_set_command(Self, "grep",            vim_grep_command);
+    yed_plugin_set_command(Self, "cn",              vim_qf_next);
+    yed_plugin_set_command(Self, "cnext",           vim_qf_next);
+    yed_plugin_set_command(Self, "cp",              vim_qf_prev);
+    yed_plugin_set_command(Self, "cprev",           vim_qf_prev);
+    yed_plugin_set_command(Self, "cN",              vim_qf_prev);
+    yed_plugin_set_command(Self, "cc",              vim_qf_goto);
+    yed_plugin_set_command(Self, "copen",           vim_qf_open);
+    yed_plugin_set_command(Self, ">",               vim_shift_right);
+    yed_plugin_set_command(Self, "<",               vim_shift_left);
+    yed_plugin_set_command(Self, "join",            vim_join_command);
+    yed_plugin_set_command(Self, "vim-fold-indent", vim_fold_indent);
+    yed_plugin_set_command(Self, "vim-command",     vim_command);
+    yed_plugin_set_command(Self, "sort",            vim_sort_command);
+    yed_plugin_set_command(Self, "sort!",           vim_sort_reverse_command);
+    yed_plugin_set_command(Self, "normal",          vim_normal_command);
+    yed_plugin_set_command(Self, "norm",            vim_normal_command);
+    yed_plugin_set_command(Self, "vim-stats",       vim_stats);
+    yed_plugin_set_command(Self, "vim-trace-dump",  vim_trace_dump);
+    yed_plugin_set_command(Self, "vim-flight-dump", vim_flight_dump);
+    yed_plugin_set_command(Self, "vim-flight-replay", vim_flight_replay);
+
+    yed_plugin_set_completion(Self, "vim-mode", vim_mode_completion);
+    yed_plugin_set_completion(Self, "vim-bind-compl-arg-0", vim_mode_completion);
+    yed_plugin_set_completion(Self, "vim-bind-compl-arg-2", yed_get_completion("command"));
+    yed_plugin_set_completion(Self, "vim-unbind-compl-arg-0", vim_mode_completion);
+
+    bind_keys();
+
+    if (yed_get_var("vim-normal-attrs") == NULL) {
+        yed_set_var("vim-normal-attrs", "bg !4");
+    }
+    if (yed_get_var("vim-insert-attrs") == NULL) {
+        yed_set_var("vim-insert-attrs", "bg !2");
+    }
+    if (yed_get_var("vim-delete-attrs") == NULL) {
+        yed_set_var("vim-delete-attrs", "bg !1");
+    }
+    if (yed_get_var("vim-yank-attrs") == NULL) {
+        yed_set_var("vim-yank-attrs", "bg !5");
+    }
+    if (yed_get_var("vim-visual-block-attrs") == NULL) {
+        yed_set_var("vim-visual-block-attrs", "bg !6");
+    }
+    if (yed_get_var("vim-replace-attrs") == NULL) {
+        yed_set_var("vim-replace-attrs", "bg !3");
+    }
+    if (yed_get_var("vim-fold-attrs") == NULL) {
+        yed_set_var("vim-fold-attrs", "fg !8");
+    }
 
-    YED_PLUG_VERSION_CHECK();
+    vim_change_mode(MODE_NORMAL, 0, 0);
 
-    Self = self;
-    _number = array_make(char);
+    /* for compatibility with ctrl + e, ctrl + y, scroll frame with no offset */
+    yed_set_var("default-scroll-offset", "0");
 
-    yed_plugin_set_command(Self, "vim-take-key", internal_take_key);
+    YEXE("vim-bind", "normal", "ctrl-w j", "frame-next");
+    YEXE("vim-bind", "normal", "ctrl-w k", "frame-prev");
 
-    for (key = 1; key < REAL_KEY_MAX; key += 1) {
-        sprintf(key_str, "%d", key);
-        YPBIND(Self, key, "vim-take-key", key_str);
-    }
+    stats_boot_us = vim_stats_now_us() - start_us;
 
     return 0;
 }
 
-//int yed_plugin_boot(yed_plugin *self) {
-//    int i;
-//
-//    YED_PLUG_VERSION_CHECK();
-//
-//    Self = self;
-//
-//    for (i = 0; i < N_MODES; i += 1) {
-//        mode_bindings[i] = array_make(vim_key_binding);
-//    }
-//
-//    repeat_keys = array_make(int);
-//
-//    yed_plugin_set_unload_fn(Self, vim_unload);
-//
-//    yed_plugin_set_command(Self, "vim-take-key",    vim_take_key);
-//    yed_plugin_set_command(Self, "vim-bind",        vim_bind);
-//    yed_plugin_set_command(Self, "vim-unbind",      vim_unbind);
-//    yed_plugin_set_command(Self, "vim-exit-insert", vim_exit_insert);
-//    yed_plugin_set_command(Self, "w",               vim_write);
-//    yed_plugin_set_command(Self, "W",               vim_write);
-//    yed_plugin_set_command(Self, "q",               vim_quit);
-//    yed_plugin_set_command(Self, "Q",               vim_quit);
-//    yed_plugin_set_command(Self, "wq",              vim_write_quit);
-//    yed_plugin_set_command(Self, "Wq",              vim_write_quit);
-//    yed_plugin_set_command(Self, "x",               vim_write_quit);
-//    yed_plugin_set_command(Self, "X",               vim_write_quit);
-//    yed_plugin_set_command(Self, "vsp",             vim_vsp);
-//    yed_plugin_set_command(Self, "sp",              vim_sp);
-//
-//    yed_plugin_set_completion(Self, "vim-mode", vim_mode_completion);
-//    yed_plugin_set_completion(Self, "vim-bind-compl-arg-0", vim_mode_completion);
-//    yed_plugin_set_completion(Self, "vim-bind-compl-arg-2", yed_get_completion("command"));
-//    yed_plugin_set_completion(Self, "vim-unbind-compl-arg-0", vim_mode_completion);
-//
-//    bind_keys();
-//
-//    if (yed_get_var("vim-normal-attrs") == NULL) {
-//        yed_set_var("vim-normal-attrs", "bg !4");
-//    }
-//    if (yed_get_var("vim-insert-attrs") == NULL) {
-//        yed_set_var("vim-insert-attrs", "bg !2");
-//    }
-//    if (yed_get_var("vim-delete-attrs") == NULL) {
-//        yed_set_var("vim-delete-attrs", "bg !1");
-//    }
-//    if (yed_get_var("vim-yank-attrs") == NULL) {
-//        yed_set_var("vim-yank-attrs", "bg !5");
-//    }
-//
-//    vim_change_mode(MODE_NORMAL, 0, 0);
-//    yed_set_var("vim-mode", mode_strs[mode]);
-//
-//    /* for compatibility with ctrl + e, ctrl + y, scroll frame with no offset */
-//    yed_set_var("default-scroll-offset", "0");
-//
-//    YEXE("vim-bind", "normal", "ctrl-w j", "frame-next");
-//    YEXE("vim-bind", "normal", "ctrl-w k", "frame-prev");
-//
-//    return 0;
-//}
-
 void vim_unload(yed_plugin *self) {
     int                 i, j;
     vim_key_binding *b;
 
+    vim_state_save();
+
     for (i = 0; i < N_MODES; i += 1) {
         array_traverse(mode_bindings[i], b) {
             if (b->args) {
@@ -248,15 +344,51 @@ void vim_unload(yed_plugin *self) {
         array_free(mode_bindings[i]);
     }
     array_free(repeat_keys);
+    vim_word_index_free();
+    vim_registers_free();
+    vim_block_free();
+    vim_indent_free();
+    vim_case_free();
+    vim_replace_free();
+    vim_marks_free();
+    vim_fold_free();
+    vim_complete_free();
+    vim_open_free();
+    vim_grep_free();
+    vim_symbols_free();
+    vim_undo_free();
+    array_free(_cmd);
+    vim_state_free();
+    vim_flight_free();
+    vim_large_free();
+}
+
+/*
+ * Plain keys reach the mode handlers through this one hook rather than through
+ * a vim-take-key binding per key code.  Keys typed into a prompt, keys with a
+ * vim-bind binding in the current mode and the special keys past REAL_KEY_MAX
+ * are left to yed.
+ */
+static void vim_key_pressed(yed_event *event) {
+    vim_key_binding *b;
+
+    vim_flight_record(event->key);
+
+    if (event->key <= 0 || event->key >= REAL_KEY_MAX || ys->interactive_command) { return; }
+
+    array_traverse(mode_bindings[mode], b) {
+        if (b->len == 1 && b->keys[0] == event->key) { return; }
+    }
+
+    event->cancel  = 1;
+    stats_keys    += 1;
+    _vim_take_key(event->key, NULL);
 }
 
 void bind_keys(void) {
-    int   meta_keys[2];
-    int   meta_key;
-    char *ctrl_h_is_bs;
-    char *ctrl_h_is_bs_cpy;
-    int   key;
-    char  key_str[32];
+    yed_event_handler h;
+    int               meta_keys[2];
+    int               meta_key;
 
     meta_keys[0] = ESC;
 
@@ -277,44 +409,71 @@ void bind_keys(void) {
     yed_unbind_key(meta_key);
     yed_delete_key_sequence(meta_key);
 
-    if ((ctrl_h_is_bs = yed_get_var("ctrl-h-is-backspace"))) {
-        ctrl_h_is_bs_cpy = strdup(ctrl_h_is_bs);
-        yed_unset_var("ctrl-h-is-backspace");
-    }
+    h.kind = EVENT_KEY_PRESSED;
+    h.fn   = vim_key_pressed;
+    yed_plugin_add_event_handler(Self, h);
+}
 
-    for (key = 1; key < REAL_KEY_MAX; key += 1) {
-        sprintf(key_str, "%d", key);
-        YPBIND(Self, key, "vim-take-key", key_str);
+/* Set var only if that changes it, so var handlers and the status line don't see no-op writes. */
+static void vim_set_var_if_changed(const char *var, const char *val) {
+    char *cur;
+
+    cur = yed_get_var(var);
+
+    if (val == NULL) {
+        if (cur != NULL) { yed_unset_var(var); }
+        return;
     }
 
-    if (ctrl_h_is_bs) {
-        yed_set_var("ctrl-h-is-backspace", ctrl_h_is_bs_cpy);
-        free(ctrl_h_is_bs_cpy);
+    if (cur == NULL || strcmp(cur, val) != 0) {
+        yed_set_var(var, val);
     }
 }
 
+/*
+ * Other plugins hear about mode changes through an EVENT_PLUGIN_MESSAGE with
+ * message_id "vim-mode-change", plugin_id "vim" and string_data
+ * "<old mode> <new mode>", the modes named as vim-bind takes them.
+ */
+static void vim_send_mode_change(Mode old_mode, Mode new_mode) {
+    yed_event event;
+    char      data[64];
+
+    snprintf(data, sizeof(data), "%s %s", mode_strs_lowercase[old_mode], mode_strs_lowercase[new_mode]);
+
+    memset(&event, 0, sizeof(event));
+    event.kind                       = EVENT_PLUGIN_MESSAGE;
+    event.plugin_message.message_id  = "vim-mode-change";
+    event.plugin_message.plugin_id   = "vim";
+    event.plugin_message.string_data = data;
+    yed_trigger_event(&event);
+}
+
 void vim_change_mode(Mode new_mode, int by_line, int cancel) {
-    char                key_str[32];
-    vim_key_binding *b;
+    vim_key_binding    *b;
+    unsigned long long  start;
+    char               *attrs;
 
-    array_traverse(mode_bindings[mode], b) {
-        yed_unbind_key(b->key);
-        if (b->len > 1) {
-            yed_delete_key_sequence(b->key);
-        } else if (b->key < REAL_KEY_MAX) {
-            sprintf(key_str, "%d", b->key);
-            YPBIND(Self, b->key, "vim-take-key", key_str);
-        }
-    }
+    start = VIM_TRACE_BEGIN();
 
-    array_traverse(mode_bindings[new_mode], b) {
-        if (b->len > 1) {
-            b->key = yed_plugin_add_key_sequence(Self, b->len, b->keys);
-        } else {
-            b->key = b->keys[0];
+    /* :normal feeds keys past the bindings and always finishes in normal mode */
+    if (!batching) {
+        array_traverse(mode_bindings[mode], b) {
+            yed_unbind_key(b->key);
+            if (b->len > 1) {
+                yed_delete_key_sequence(b->key);
+            }
         }
 
-        yed_plugin_bind_key(Self, b->key, b->cmd, b->n_args, b->args);
+        array_traverse(mode_bindings[new_mode], b) {
+            if (b->len > 1) {
+                b->key = yed_plugin_add_key_sequence(Self, b->len, b->keys);
+            } else {
+                b->key = b->keys[0];
+            }
+
+            yed_plugin_bind_key(Self, b->key, b->cmd, b->n_args, b->args);
+        }
     }
 
     switch (mode) {
@@ -322,34 +481,54 @@ void vim_change_mode(Mode new_mode, int by_line, int cancel) {
         case MODE_INSERT: exit_insert();       break;
         case MODE_DELETE: exit_delete(cancel); break;
         case MODE_YANK:   exit_yank(cancel);   break;
+        case MODE_VISUAL_BLOCK: exit_visual_block(cancel); break;
+        case MODE_REPLACE: exit_replace();      break;
     }
 
     mode = new_mode;
 
     switch (new_mode) {
         case MODE_NORMAL: {
-            yed_set_var("enable-search-cursor-move", "no");
+            vim_set_var_if_changed("enable-search-cursor-move", "no");
             break;
         }
         case MODE_INSERT: enter_insert();        break;
         case MODE_DELETE: enter_delete(by_line); break;
         case MODE_YANK:   enter_yank(by_line);   break;
+        case MODE_VISUAL_BLOCK: enter_visual_block(); break;
+        case MODE_REPLACE: enter_replace();      break;
     }
 
-    yed_set_var("vim-mode", mode_strs[new_mode]);
-
-    yed_set_var("vim-mode-attrs", yed_get_var("vim-insert-attrs"));
+    if (batching) {
+        vim_trace_end("change-mode", start, "mode", new_mode);
+        return;
+    }
 
     switch (new_mode) {
-        case MODE_NORMAL: yed_set_var("vim-mode-attrs", yed_get_var("vim-normal-attrs")); break;
-        case MODE_INSERT: yed_set_var("vim-mode-attrs", yed_get_var("vim-insert-attrs")); break;
-        case MODE_DELETE: yed_set_var("vim-mode-attrs", yed_get_var("vim-delete-attrs")); break;
-        case MODE_YANK:   yed_set_var("vim-mode-attrs", yed_get_var("vim-yank-attrs"));   break;
+        case MODE_NORMAL:       attrs = "vim-normal-attrs";       break;
+        case MODE_DELETE:       attrs = "vim-delete-attrs";       break;
+        case MODE_YANK:         attrs = "vim-yank-attrs";         break;
+        case MODE_VISUAL_BLOCK: attrs = "vim-visual-block-attrs"; break;
+        case MODE_REPLACE:      attrs = "vim-replace-attrs";      break;
+        default:                attrs = "vim-insert-attrs";       break;
     }
+
+    vim_set_var_if_changed("vim-mode", mode_strs[new_mode]);
+    vim_set_var_if_changed("vim-mode-attrs", yed_get_var(attrs));
+
+    if (new_mode != reported_mode) {
+        vim_send_mode_change(reported_mode, new_mode);
+        reported_mode = new_mode;
+    }
+
+    vim_trace_end("change-mode", start, "mode", new_mode);
 }
 
 static void _vim_take_key(int key, char *maybe_key_str) {
-    char *key_str, buff[32];
+    char               *key_str, buff[32];
+    unsigned long long  start;
+
+    start = VIM_TRACE_BEGIN();
 
     if (maybe_key_str) {
         key_str = maybe_key_str;
@@ -363,11 +542,15 @@ static void _vim_take_key(int key, char *maybe_key_str) {
         case MODE_INSERT: vim_insert(key, key_str); break;
         case MODE_DELETE: vim_delete(key, key_str); break;
         case MODE_YANK:   vim_yank(key, key_str);   break;
+        case MODE_VISUAL_BLOCK: vim_visual_block(key, key_str); break;
+        case MODE_REPLACE: vim_replace(key, key_str); break;
         default:
             LOG_FN_ENTER();
             yed_log("[!] invalid mode (?)");
             LOG_EXIT();
     }
+
+    vim_trace_end("key", start, "key", key);
 }
 
 void vim_take_key(int n_args, char **args) {
@@ -398,6 +581,8 @@ void vim_bind(int n_args, char **args) {
     else if (strcmp(mode_str, "insert") == 0)    { b_mode = MODE_INSERT; }
     else if (strcmp(mode_str, "delete") == 0)    { b_mode = MODE_DELETE; }
     else if (strcmp(mode_str, "yank")   == 0)    { b_mode = MODE_YANK;   }
+    else if (strcmp(mode_str, "visual-block") == 0) { b_mode = MODE_VISUAL_BLOCK; }
+    else if (strcmp(mode_str, "replace") == 0) { b_mode = MODE_REPLACE; }
     else {
         yed_cerr("no mode named '%s'", mode_str);
         return;
@@ -444,6 +629,8 @@ void vim_unbind(int n_args, char **args) {
     else if (strcmp(mode_str, "insert") == 0)    { b_mode = MODE_INSERT; }
     else if (strcmp(mode_str, "delete") == 0)    { b_mode = MODE_DELETE; }
     else if (strcmp(mode_str, "yank")   == 0)    { b_mode = MODE_YANK;   }
+    else if (strcmp(mode_str, "visual-block") == 0) { b_mode = MODE_VISUAL_BLOCK; }
+    else if (strcmp(mode_str, "replace") == 0) { b_mode = MODE_REPLACE; }
     else {
         yed_cerr("no mode named '%s'", mode_str);
         return;
@@ -556,6 +743,28 @@ void vim_remove_binding(int b_mode, int n_keys, int *keys) {
     }
 }
 
+/*
+ * Background work that the pump hands over to the editor (open.c, grep.c,
+ * search.c) holds the update rate up while it runs, so pumps keep coming
+ * without keys.  The rate set before the first hold is put back after the
+ * last one.
+ */
+static void vim_hold_pumps(int hold) {
+    static int holds;
+    static int saved_hz;
+
+    if (hold) {
+        if (holds++ == 0) {
+            saved_hz = yed_get_update_hz();
+            if (saved_hz < 60) { yed_set_update_hz(60); }
+        }
+    } else if (holds > 0) {
+        if (--holds == 0 && yed_get_update_hz() != saved_hz) {
+            yed_set_update_hz(saved_hz);
+        }
+    }
+}
+
 static void vim_push_repeat_key(int key) {
     if (repeating) {
         return;
@@ -582,6 +791,27 @@ static void vim_repeat(void) {
     repeating = 0;
 }
 
+static int vim_take_count_digit(int key) {
+    if (!is_digit(key) || (key == '0' && count_pending == 0)) {
+        return 0;
+    }
+
+    if (count_pending < 100000000) {
+        count_pending = (count_pending * 10) + (key - '0');
+    }
+
+    return 1;
+}
+
+static int vim_take_count(void) {
+    int count;
+
+    count         = count_pending ? count_pending : 1;
+    count_pending = 0;
+
+    return count;
+}
+
 static void vim_start_repeat(int key) {
     if (repeating) {
         return;
@@ -667,6 +897,52 @@ static void vim_repeat_till(void) {
     }
 }
 
+/* '%': jump from the first bracket at or after the cursor on this line to its match. */
+static void vim_match_pair(void) {
+    yed_frame  *f;
+    yed_line   *line;
+    const char *pairs, *p;
+    char       *data, open, close;
+    int         row, idx, len, dir, depth;
+
+    f = ys->active_frame;
+    if (!f || !f->buffer) { return; }
+
+    line = yed_buff_get_line(f->buffer, f->cursor_line);
+    if (!line) { return; }
+
+    pairs = "(){}[]";
+    data  = array_data(line->chars);
+    len   = array_len(line->chars);
+
+    for (idx = vim_line_col_to_byte(line, f->cursor_col); idx < len; idx += 1) {
+        if ((p = strchr(pairs, data[idx])) && data[idx]) { break; }
+    }
+    if (idx >= len) { return; }
+
+    dir   = ((p - pairs) % 2) ? -1 : 1;
+    open  = data[idx];
+    close = dir > 0 ? p[1] : p[-1];
+    depth = 0;
+
+    for (row = f->cursor_line; row >= 1 && row <= yed_buff_n_lines(f->buffer); row += dir) {
+        line = yed_buff_get_line(f->buffer, row);
+        data = array_data(line->chars);
+        len  = array_len(line->chars);
+        if (row != f->cursor_line) { idx = dir > 0 ? 0 : len - 1; }
+
+        for (; idx >= 0 && idx < len; idx += dir) {
+            if (data[idx] == open) {
+                depth += 1;
+            } else if (data[idx] == close && --depth == 0) {
+                vim_jump_push();
+                yed_set_cursor_far_within_frame(f, row, yed_line_idx_to_col(line, idx));
+                return;
+            }
+        }
+    }
+}
+
 int vim_nav_common(int key, char *key_str) {
     if (till_pending == 1) {
         vim_do_till_fw(key);
@@ -680,123 +956,12 @@ int vim_nav_common(int key, char *key_str) {
             vim_push_repeat_key(key);
         }
         goto out;
+    } else if (section_pending) {
+        vim_sym_take_key(key);
+        goto out;
     }
 
-    switch (key) {
-        case 'h':
-        case ARROW_LEFT:
-            YEXE("cursor-left");
-            break;
-
-        case 'j':
-        case ARROW_DOWN:
-            YEXE("cursor-down");
-            break;
-
-        case 'k':
-        case ARROW_UP:
-            YEXE("cursor-up");
-            break;
-
-        case CTRL_H:
-            break;
-
-        case CTRL_J:
-            break;
-
-        case CTRL_K:
-            break;
-
-        case CTRL_L:
-            break;
-
-        case 'l':
-        case ARROW_RIGHT:
-            YEXE("cursor-right");
-            break;
-
-        case PAGE_UP:
-            YEXE("cursor-page-up");
-            break;
-
-        case PAGE_DOWN:
-            YEXE("cursor-page-down");
-            break;
-
-        case 'w':
-            YEXE("cursor-next-word");
-            break;
-
-        case 'b':
-            YEXE("cursor-prev-word");
-            break;
-
-        case 'e':
-            YEXE("cursor-next-word-end");
-            break;
-
-        case '^':
-        case '0':
-        case HOME_KEY:
-            YEXE("cursor-line-begin");
-            break;
-
-        case '$':
-        case END_KEY:
-            YEXE("cursor-line-end");
-            break;
-
-        case '{':
-            YEXE("cursor-prev-paragraph");
-            break;
-
-        case '}':
-            YEXE("cursor-next-paragraph");
-            break;
-
-        case 'g':
-            YEXE("cursor-buffer-begin");
-            break;
-
-        case 'G':
-            YEXE("cursor-buffer-end");
-            break;
-
-        case '/':
-            YEXE("find-in-buffer");
-            break;
-
-        case '?':
-            YEXE("replace-current-search");
-            break;
-
-        case 'n':
-            YEXE("find-next-in-buffer");
-            break;
-
-        case 'N':
-            YEXE("find-prev-in-buffer");
-            break;
-
-        case 'f':
-        case 't':
-            till_pending = 1;
-            last_till_op = key;
-            break;
-
-        case 'F':
-        case 'T':
-            till_pending = 2 + (key == 'T');
-            last_till_op = key;
-            break;
-
-        case ';':
-            vim_repeat_till();
-            break;
-
-        default:
-            return 0;
-    }
+    return vim_key_dispatch(vim_motion_keys, key, nav_count);
 
 out:
     return 1;
@@ -804,15 +969,17 @@ out:
 
 void vim_insert_line(int direction) {
     yed_frame *f;
-    int        row;
+    int        row, from, width;
 
     if (!ys->active_frame || !ys->active_frame->buffer)
         return;
 
     f = ys->active_frame;
-    row = (direction < 0) ? f->cursor_line : f->cursor_line + 1;
+    row  = (direction < 0) ? f->cursor_line : f->cursor_line + 1;
+    from = (direction < 0) ? f->cursor_line + 1 : f->cursor_line;
     yed_buff_insert_line(f->buffer, row);
-    yed_set_cursor_within_frame(f, row, 0);
+    width = vim_copy_indent(f->buffer, from, row);
+    yed_set_cursor_within_frame(f, row, width + 1);
 }
 
 void vim_delete_char_under_cursor() {
@@ -827,139 +994,64 @@ void vim_delete_char_under_cursor() {
 }
 
 void vim_normal(int key, char *key_str) {
-    if (vim_nav_common(key, key_str)) {
+    int count;
+
+    if (vim_replace_take_char(key)) {
         return;
     }
 
-    switch (key) {
-        case CTRL_E:
-            YEXE("frame-scroll", "1");
-            break;
-
-        case CTRL_Y:
-            YEXE("frame-scroll", "-1");
-            break;
-
-        case '*':
-            YEXE("find-in-buffer", yed_word_under_cursor());
-            break;
-
-        case 'd':
-            YEXE("select-off");
-            vim_start_repeat(key);
-            vim_change_mode(MODE_DELETE, 0, 0);
-            break;
-
-        case 'D':
-            YEXE("select-off");
-            vim_start_repeat(key);
-            vim_change_mode(MODE_DELETE, 1, 0);
-            break;
-
-        case 'y':
-            YEXE("select-off");
-            vim_change_mode(MODE_YANK, 0, 0);
-            break;
-
-        case 'Y':
-            YEXE("select-off");
-            vim_change_mode(MODE_YANK, 1, 0);
-            break;
-
-        case 'v':
-            YEXE("select");
-            break;
-
-        case 'V':
-            YEXE("select-lines");
-            break;
-
-        case 'p':
-            vim_start_repeat(key);
-            YEXE("paste-yank-buffer");
-            break;
-
-        case 'O':
-            YEXE("select-off");
-            vim_insert_line(-1);
-            goto enter_insert;
-            break;
-
-        case 'o':
-            YEXE("select-off");
-            vim_insert_line(1);
-            goto enter_insert;
-            break;
-
-        case 'a':
-            YEXE("select-off");
-            vim_start_repeat(key);
-            YEXE("cursor-right");
-            goto enter_insert;
-
-        case 'A':
-            YEXE("select-off");
-            vim_start_repeat(key);
-            YEXE("cursor-line-end");
-            goto enter_insert;
-
-        case 'I':
-            YEXE("select-off");
-            vim_start_repeat(key);
-            YEXE("cursor-line-begin");
-            goto enter_insert;
-
-        case 'i':
-            YEXE("select-off");
-            vim_start_repeat(key);
-enter_insert:
-            vim_change_mode(MODE_INSERT, 0, 0);
-            break;
+    if (vim_mark_take_key(key)) {
+        return;
+    }
 
-        case DEL_KEY:
-            YEXE("select-off");
-            vim_start_repeat(key);
-            YEXE("delete-forward");
-            break;
+    if (vim_reg_take_name(key)) {
+        return;
+    }
 
-        case 'u':
-            YEXE("undo");
-            break;
+    if (!till_pending && !section_pending && vim_take_count_digit(key)) {
+        return;
+    }
 
-        case CTRL_R:
-            YEXE("redo");
-            break;
+    count = vim_take_count();
 
-        case 'x':
-            vim_delete_char_under_cursor();
-            break;
+    if (vim_shift_take_key(key, key_str, count)) {
+        return;
+    }
 
-        case '.':
-            YEXE("select-off");
-            vim_repeat();
-            break;
+    if (vim_case_take_key(key, key_str, count)) {
+        return;
+    }
 
-        case ':':
-            YEXE("command-prompt");
-            break;
+    if (vim_fold_take_key(key, key_str, count)) {
+        return;
+    }
 
-        case ESC:
-        case CTRL_C:
-            YEXE("select-off");
-            break;
+    if (key == 'g' && !till_pending && !section_pending) {
+        /* 'g' is a prefix here; keep the count for the command after it */
+        g_pending     = 1;
+        count_pending = count > 1 ? count : 0;
+        return;
+    }
 
-        case CTRL_Z:
-            YEXE("suspend");
-            break;
+    nav_count = count;
+    if (vim_nav_common(key, key_str)) {
+        nav_count = 1;
+        return;
+    }
+    nav_count = 1;
 
-        default:
-            yed_cerr("[NORMAL] unhandled key %d", key);
+    if (!vim_key_dispatch(vim_normal_keys, key, count)) {
+        yed_cerr("[NORMAL] unhandled key %d", key);
     }
 }
 
 void vim_insert(int key, char *key_str) {
     vim_push_repeat_key(key);
 
+    if (key != CTRL_N && key != CTRL_P) {
+        vim_complete_reset();
+    }
+
     switch (key) {
         case ARROW_LEFT:
             YEXE("cursor-left");
@@ -1001,6 +1093,14 @@ void vim_insert(int key, char *key_str) {
             YEXE("delete-forward");
             break;
 
+        case CTRL_N:
+            vim_complete(1);
+            break;
+
+        case CTRL_P:
+            vim_complete(-1);
+            break;
+
         case ESC:
         case CTRL_C:
             vim_change_mode(MODE_NORMAL, 0, 1);
@@ -1024,24 +1124,9 @@ void vim_delete(int key, char *key_str) {
         return;
     }
 
-    switch (key) {
-        case 'd':
-            vim_change_mode(MODE_NORMAL, 0, 0);
-            break;
-
-        case 'c':
-            vim_change_mode(MODE_NORMAL, 0, 0);
-            vim_change_mode(MODE_INSERT, 0, 0);
-            break;
-
-        case ESC:
-        case CTRL_C:
-            vim_change_mode(MODE_NORMAL, 0, 1);
-            break;
-
-        default:
-            vim_pop_repeat_key();
-            yed_cerr("[DELETE] unhandled key %d", key);
+    if (!vim_key_dispatch(vim_delete_keys, key, 1)) {
+        vim_pop_repeat_key();
+        yed_cerr("[DELETE] unhandled key %d", key);
     }
 }
 
@@ -1050,18 +1135,8 @@ void vim_yank(int key, char *key_str) {
         return;
     }
 
-    switch (key) {
-        case 'y':
-            vim_change_mode(MODE_NORMAL, 0, 0);
-            break;
-
-        case ESC:
-        case CTRL_C:
-            vim_change_mode(MODE_NORMAL, 0, 1);
-            break;
-
-        default:
-            yed_cerr("[YANK] unhandled key %d", key);
+    if (!vim_key_dispatch(vim_yank_keys, key, 1)) {
+        yed_cerr("[YANK] unhandled key %d", key);
     }
 }
 
@@ -1094,24 +1169,6 @@ void vim_write_quit(int n_args, char **args) {
     YEXE("q");
 }
 
-void vim_vsp(int n_args, char **args) {
-    if (n_args == 0) {
-        yed_cerr("Expected file path, but got nothing");
-        return;
-    }
-    YEXE("frame-vsplit");
-    YEXE("buffer", args[0]);
-}
-
-void vim_sp(int n_args, char **args) {
-    if (n_args == 0) {
-        yed_cerr("Expected file path, but got nothing");
-        return;
-    }
-    YEXE("frame-hsplit");
-    YEXE("buffer", args[0]);
-}
-
 void enter_insert(void) {
     yed_frame  *frame;
     yed_buffer *buff;
@@ -1126,15 +1183,16 @@ void enter_insert(void) {
         }
     }
 
-    if (yed_get_var("vim-insert-no-cursor-line") && yed_get_var("cursor-line")) {
+    if (yed_get_var("vim-insert-no-cursor-line") && yed_get_var("cursor-line") && !vim_large_active()) {
         restore_cursor_line = 1;
         yed_set_var("cursor-line", "no");
     }
 }
 
 void exit_insert(void) {
-    yed_frame  *frame;
-    yed_buffer *buff;
+    yed_frame          *frame;
+    yed_buffer         *buff;
+    unsigned long long  start;
 
     frame = ys->active_frame;
 
@@ -1142,10 +1200,15 @@ void exit_insert(void) {
         buff = frame->buffer;
 
         if (buff) {
+            if (block_insert_pending) {
+                vim_block_finish_insert();
+            }
 
+            start = VIM_TRACE_BEGIN();
             while (yed_get_undo_num_records(buff) > num_undo_records_before_insert + 1) {
                 yed_merge_undo_records(buff);
             }
+            vim_trace_end("undo-merge", start, NULL, 0);
         }
     }
 
@@ -1156,7 +1219,7 @@ void exit_insert(void) {
 }
 
 void enter_delete(int by_line) {
-    yed_set_var("enable-search-cursor-move", "yes");
+    vim_set_var_if_changed("enable-search-cursor-move", "yes");
     if (by_line) {
         YEXE("select-lines");
     } else {
@@ -1166,7 +1229,7 @@ void enter_delete(int by_line) {
 }
 
 void enter_yank(int by_line) {
-    yed_set_var("enable-search-cursor-move", "yes");
+    vim_set_var_if_changed("enable-search-cursor-move", "yes");
     if (by_line) {
         YEXE("select-lines");
     } else {
@@ -1178,7 +1241,6 @@ void exit_delete(int cancel) {
     yed_frame  *frame;
     yed_buffer *buff;
     yed_range  *sel;
-    char       *preserve;
 
     if (!cancel) {
         if (ys->active_frame
@@ -1196,12 +1258,12 @@ void exit_delete(int cancel) {
                 YEXE("select-lines");
             }
 
-            preserve = "1";
-            YEXE("yank-selection", preserve);
+            vim_reg_yank_selection(1);
             YEXE("delete-back");
         }
     }
 
+    active_register = 0;
     YEXE("select-off");
 }
 
@@ -1226,9 +1288,10 @@ void exit_yank(int cancel) {
                 YEXE("select-lines");
             }
 
-            YEXE("yank-selection");
+            vim_reg_yank_selection(0);
         }
     }
 
+    active_register = 0;
     YEXE("select-off");
 }
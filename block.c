@@ -0,0 +1,367 @@
+/*
+ * Visual block mode (CTRL-V).
+ *
+ * The block is shown with a RANGE_RECT selection and described by its corner
+ * rows and columns.  Every block edit works out each row's byte span and
+ * splices only that span -- the rest of the row is left alone -- with all
+ * rows inside one undo record, instead of moving the cursor and editing row
+ * by row.  'd' and 'x' put the deleted spans in the unnamed register first,
+ * one line per row.
+ *
+ * 'I', 'A' and 'c' enter insert mode on the first row.  When insert mode is
+ * left, whatever was typed there is replicated to the other rows and merged
+ * into the same undo record as the insert itself.
+ */
+
+typedef struct {
+    int r1, r2; /* first and last row */
+    int c1, c2; /* first and last column, inclusive */
+    int to_eol; /* '$' was used: the block extends to each line's end */
+} vim_block;
+
+static int       block_anchor_row;
+static int       block_anchor_col;
+static int       block_to_eol;
+static int       block_replace_pending;
+static array_t   block_scratch;
+
+/* pending replication of an 'I'/'A'/'c' insert */
+static int       block_insert_pending;
+static vim_block block_insert;
+static int       block_insert_append;
+static int       block_insert_idx;
+static int       block_insert_len_before;
+static int       block_insert_n_lines_before;
+static int       block_undo_records_before;
+
+static int vim_block_get(vim_block *b) {
+    yed_frame *f;
+
+    f = ys->active_frame;
+    if (!f || !f->buffer) { return 0; }
+
+    b->r1     = block_anchor_row < f->cursor_line ? block_anchor_row : f->cursor_line;
+    b->r2     = block_anchor_row < f->cursor_line ? f->cursor_line   : block_anchor_row;
+    b->c1     = block_anchor_col < f->cursor_col  ? block_anchor_col : f->cursor_col;
+    b->c2     = block_anchor_col < f->cursor_col  ? f->cursor_col    : block_anchor_col;
+    b->to_eol = block_to_eol;
+
+    return 1;
+}
+
+/* Byte span [*start, *end) of the block on line. */
+static void vim_block_line_span(vim_block *b, yed_line *line, int *start, int *end) {
+    *start = vim_line_col_to_byte(line, b->c1);
+    *end   = b->to_eol ? array_len(line->chars) : vim_line_col_to_byte(line, b->c2 + 1);
+    if (*end < *start) { *end = *start; }
+}
+
+static void vim_block_scratch_reset(void) {
+    array_clear(block_scratch);
+}
+
+static void vim_block_scratch_add(const char *s, int len) {
+    if (len > 0) {
+        array_push_n(block_scratch, (char*)s, len);
+    }
+}
+
+static void vim_block_scratch_add_spaces(int n) {
+    char sp;
+
+    sp = ' ';
+    while (n-- > 0) { array_push(block_scratch, sp); }
+}
+
+static void vim_block_insert_scratch(yed_buffer *buff, int row, int idx) {
+    vim_buff_insert_bytes_at_idx(buff, row, idx, array_data(block_scratch), array_len(block_scratch));
+}
+
+/* Put the block's spans, one line per row, in the active register. */
+static void vim_block_yank(yed_buffer *buff, vim_block *b, int is_delete) {
+    vim_reg_text *text;
+    yed_line     *line;
+    int           row, start, end;
+
+    if (active_register == '_') { return; }
+
+    text = vim_reg_text_new(0, (b->r2 - b->r1 + 1) * (b->c2 - b->c1 + 2));
+
+    for (row = b->r1; row <= b->r2; row += 1) {
+        line = yed_buff_get_line(buff, row);
+        if (!line) { break; }
+
+        start = end = 0;
+        if (line->visual_width >= b->c1) {
+            vim_block_line_span(b, line, &start, &end);
+        }
+        vim_reg_text_add_lines(text, (char*)array_data(line->chars) + start, end - start, 1);
+    }
+
+    vim_reg_set(active_register, text, is_delete);
+    vim_reg_text_unref(text);
+}
+
+static void vim_block_delete(yed_buffer *buff, vim_block *b) {
+    yed_line *line;
+    int       row, start, end;
+
+    for (row = b->r1; row <= b->r2; row += 1) {
+        line = yed_buff_get_line(buff, row);
+        if (!line || line->visual_width < b->c1) { continue; }
+
+        vim_block_line_span(b, line, &start, &end);
+        vim_buff_delete_bytes(buff, row, start, end);
+    }
+}
+
+static void vim_block_replace(yed_buffer *buff, vim_block *b, char c) {
+    yed_line *line;
+    char     *data, *p;
+    int       row, start, end;
+
+    for (row = b->r1; row <= b->r2; row += 1) {
+        line = yed_buff_get_line(buff, row);
+        if (!line || line->visual_width < b->c1) { continue; }
+
+        vim_block_line_span(b, line, &start, &end);
+        data = array_data(line->chars);
+
+        vim_block_scratch_reset();
+        for (p = data + start; p < data + end; p += vim_utf8_len((unsigned char)*p)) {
+            array_push(block_scratch, c);
+        }
+
+        vim_buff_delete_bytes(buff, row, start, end);
+        vim_block_insert_scratch(buff, row, start);
+    }
+}
+
+/*
+ * Put s into every row of the block but the first: before the block for 'I',
+ * after it for 'A'.  'I' skips rows that end before the block like vim does;
+ * 'A' pads them with spaces unless the block extends to the end of line.
+ */
+static void vim_block_replicate(yed_buffer *buff, vim_block *b, int append, const char *s, int len) {
+    yed_line *line;
+    int       row, start, end, at;
+
+    for (row = b->r1 + 1; row <= b->r2; row += 1) {
+        line = yed_buff_get_line(buff, row);
+        if (!line) { break; }
+
+        vim_block_scratch_reset();
+
+        if (!append) {
+            if (line->visual_width < b->c1) { continue; }
+            vim_block_line_span(b, line, &start, &end);
+            at = start;
+        } else if (b->to_eol) {
+            at = array_len(line->chars);
+        } else if (line->visual_width < b->c2 + 1) {
+            at = array_len(line->chars);
+            vim_block_scratch_add_spaces(b->c2 - line->visual_width);
+        } else {
+            vim_block_line_span(b, line, &start, &end);
+            at = end;
+        }
+
+        vim_block_scratch_add(s, len);
+        vim_block_insert_scratch(buff, row, at);
+    }
+}
+
+/* Set up 'I' (append = 0), 'A' (append = 1) or 'c' (change = 1) and enter insert mode. */
+static void vim_block_start_insert(vim_block *b, int append, int change) {
+    yed_frame  *f;
+    yed_buffer *buff;
+    yed_line   *line;
+    int         col, start, end;
+
+    f    = ys->active_frame;
+    buff = f->buffer;
+
+    block_undo_records_before = yed_get_undo_num_records(buff);
+
+    if (change) {
+        yed_start_undo_record(f, buff);
+        vim_block_delete(buff, b);
+        yed_end_undo_record(f, buff);
+        b->c2     = b->c1 - 1;
+        b->to_eol = 0;
+    }
+
+    line = yed_buff_get_line(buff, b->r1);
+
+    if (append && !b->to_eol && line->visual_width < b->c2 + 1) {
+        yed_start_undo_record(f, buff);
+        vim_block_scratch_reset();
+        vim_block_scratch_add_spaces(b->c2 - line->visual_width);
+        vim_block_insert_scratch(buff, b->r1, array_len(line->chars));
+        yed_end_undo_record(f, buff);
+        line = yed_buff_get_line(buff, b->r1);
+    }
+
+    vim_block_line_span(b, line, &start, &end);
+    block_insert_idx = append ? end : start;
+    col              = append
+                        ? (b->to_eol ? line->visual_width + 1 : b->c2 + 1)
+                        : b->c1;
+
+    block_insert                = *b;
+    block_insert_append         = append;
+    block_insert_len_before     = array_len(line->chars);
+    block_insert_n_lines_before = yed_buff_n_lines(buff);
+    block_insert_pending        = 1;
+
+    vim_change_mode(MODE_INSERT, 0, 0);
+    yed_set_cursor_within_frame(f, b->r1, col);
+
+    /* make exit_insert() fold the delete/padding and replication into the insert's record */
+    num_undo_records_before_insert = block_undo_records_before;
+}
+
+/* Called from exit_insert() before the insert's undo records are merged. */
+static void vim_block_finish_insert(void) {
+    yed_frame  *f;
+    yed_buffer *buff;
+    yed_line   *line;
+    array_t     typed;
+    int         len;
+
+    block_insert_pending = 0;
+
+    f = ys->active_frame;
+    if (!f || !(buff = f->buffer)) { return; }
+
+    /* like vim, an insert that broke the line isn't repeated on the other rows */
+    if (yed_buff_n_lines(buff) != block_insert_n_lines_before) { return; }
+
+    line = yed_buff_get_line(buff, block_insert.r1);
+    len  = array_len(line->chars) - block_insert_len_before;
+    if (len <= 0 || block_insert_idx + len > array_len(line->chars)) { return; }
+
+    typed = array_make_with_cap(char, len);
+    array_push_n(typed, (char*)array_data(line->chars) + block_insert_idx, len);
+
+    yed_start_undo_record(f, buff);
+    vim_block_replicate(buff, &block_insert, block_insert_append, array_data(typed), len);
+    yed_end_undo_record(f, buff);
+
+    array_free(typed);
+}
+
+static void vim_block_apply(int key) {
+    yed_frame  *f;
+    yed_buffer *buff;
+    vim_block   b;
+
+    if (!vim_block_get(&b)) { return; }
+
+    f    = ys->active_frame;
+    buff = f->buffer;
+
+    switch (key) {
+        case 'I':
+        case 'A':
+        case 'c':
+            vim_change_mode(MODE_NORMAL, 0, 0);
+            if (key == 'c') {
+                vim_block_yank(buff, &b, 1);
+                active_register = 0;
+            }
+            vim_block_start_insert(&b, key == 'A', key == 'c');
+            return;
+
+        case 'd':
+        case 'x':
+            vim_change_mode(MODE_NORMAL, 0, 0);
+            vim_block_yank(buff, &b, 1);
+            active_register = 0;
+            yed_start_undo_record(f, buff);
+            vim_block_delete(buff, &b);
+            yed_end_undo_record(f, buff);
+            break;
+
+        default:
+            vim_change_mode(MODE_NORMAL, 0, 0);
+            yed_start_undo_record(f, buff);
+            vim_block_replace(buff, &b, (char)key);
+            yed_end_undo_record(f, buff);
+    }
+
+    yed_set_cursor_within_frame(f, b.r1, b.c1);
+}
+
+void vim_visual_block(int key, char *key_str) {
+    if (block_replace_pending) {
+        block_replace_pending = 0;
+        if (key == ESC || key == CTRL_C) { return; }
+        if (key < REAL_KEY_MAX && !iscntrl(key)) {
+            vim_block_apply(key);
+        } else {
+            yed_cerr("[VISUAL BLOCK] can't replace with key %d", key);
+        }
+        return;
+    }
+
+    if (key == '$') {
+        block_to_eol = 1;
+    } else if (key != END_KEY && key != ';') {
+        block_to_eol = 0;
+    }
+
+    if (vim_nav_common(key, key_str)) {
+        return;
+    }
+
+    switch (key) {
+        case 'I':
+        case 'A':
+        case 'c':
+        case 'd':
+        case 'x':
+            vim_block_apply(key);
+            break;
+
+        case 'r':
+            block_replace_pending = 1;
+            break;
+
+        case ESC:
+        case CTRL_C:
+        case CTRL_V:
+            vim_change_mode(MODE_NORMAL, 0, 1);
+            break;
+
+        default:
+            yed_cerr("[VISUAL BLOCK] unhandled key %d", key);
+    }
+}
+
+void enter_visual_block(void) {
+    yed_frame *f;
+
+    f = ys->active_frame;
+    if (!f || !f->buffer) { return; }
+
+    block_anchor_row      = f->cursor_line;
+    block_anchor_col      = f->cursor_col;
+    block_to_eol          = 0;
+    block_replace_pending = 0;
+
+    YEXE("select");
+    f->buffer->selection.kind = RANGE_RECT;
+}
+
+void exit_visual_block(int cancel) {
+    YEXE("select-off");
+}
+
+static void vim_block_make(void) {
+    block_scratch = array_make(char);
+}
+
+static void vim_block_free(void) {
+    array_free(block_scratch);
+}
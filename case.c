@@ -0,0 +1,463 @@
+/*
+ * Case operators: '~', 'gu', 'gU' and 'g~'.
+ *
+ * The affected bytes of each line are converted into a scratch buffer and the
+ * line is written once if anything changed, with the whole operation in one
+ * undo record.  Runs of ASCII are converted 16 bytes at a time with SSE2, or
+ * 8 at a time with SWAR arithmetic on other targets; only multibyte glyphs
+ * take the per-glyph path through vim_case_code_point().
+ */
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+enum {
+    CASE_LOWER,
+    CASE_UPPER,
+    CASE_TOGGLE,
+};
+
+static array_t case_scratch;
+static int     g_pending;        /* 'g' was typed in normal mode */
+static int     case_pending;     /* 'u', 'U' or '~' after 'g', waiting for a motion */
+static int     case_pending_count;
+static int     case_object_pending; /* 'i' or 'a' typed after the operator */
+
+/*
+ * Case mapping for the scripts whose cases are a fixed offset apart: Latin-1,
+ * Latin Extended-A, Greek and Cyrillic.  All of them encode to two bytes in
+ * both cases, so the converted glyph never changes length.  U+0130 (dotted I)
+ * and U+0131 (dotless i) break the pairing of Latin Extended-A; their other
+ * cases are ASCII 'i' and 'I', one byte long, so they are left alone.
+ */
+static uint32_t vim_case_code_point(uint32_t cp, int how) {
+    int upper, lower;
+    uint32_t other;
+
+    upper = lower = 0;
+    other = cp;
+
+    if (cp == 0x130 || cp == 0x131) {
+        return cp;
+    } else if (cp >= 0xC0 && cp <= 0xDE && cp != 0xD7) {
+        upper = 1; other = cp + 0x20;
+    } else if (cp >= 0xE0 && cp <= 0xFE && cp != 0xF7) {
+        lower = 1; other = cp - 0x20;
+    } else if ((cp >= 0x100 && cp <= 0x137) || (cp >= 0x14A && cp <= 0x177)) {
+        if (cp & 1) { lower = 1; other = cp - 1; }
+        else        { upper = 1; other = cp + 1; }
+    } else if ((cp >= 0x139 && cp <= 0x148) || (cp >= 0x179 && cp <= 0x17E)) {
+        if (cp & 1) { upper = 1; other = cp + 1; }
+        else        { lower = 1; other = cp - 1; }
+    } else if (cp >= 0x391 && cp <= 0x3A9 && cp != 0x3A2) {
+        upper = 1; other = cp + 0x20;
+    } else if (cp >= 0x3B1 && cp <= 0x3C9 && cp != 0x3C2) {
+        lower = 1; other = cp - 0x20;
+    } else if (cp >= 0x410 && cp <= 0x42F) {
+        upper = 1; other = cp + 0x20;
+    } else if (cp >= 0x430 && cp <= 0x44F) {
+        lower = 1; other = cp - 0x20;
+    } else if (cp >= 0x400 && cp <= 0x40F) {
+        upper = 1; other = cp + 0x50;
+    } else if (cp >= 0x450 && cp <= 0x45F) {
+        lower = 1; other = cp - 0x50;
+    }
+
+    if ((how == CASE_LOWER && upper)
+    ||  (how == CASE_UPPER && lower)
+    ||  (how == CASE_TOGGLE && (upper || lower))) {
+        return other;
+    }
+
+    return cp;
+}
+
+/* Convert one glyph in place.  Returns its length in bytes. */
+static int vim_case_glyph(unsigned char *p, int len, int how) {
+    uint32_t cp;
+    int      n;
+
+    n = vim_utf8_len(*p);
+    if (n > len) { return len; }
+
+    if (n == 1) {
+        if ((how != CASE_UPPER && *p >= 'A' && *p <= 'Z')
+        ||  (how != CASE_LOWER && *p >= 'a' && *p <= 'z')) {
+            *p ^= 0x20;
+        }
+        return 1;
+    }
+
+    /* every mapped code point is a two byte sequence */
+    if (n == 2) {
+        cp = ((p[0] & 0x1F) << 6) | (p[1] & 0x3F);
+        cp = vim_case_code_point(cp, how);
+        p[0] = 0xC0 | (cp >> 6);
+        p[1] = 0x80 | (cp & 0x3F);
+    }
+
+    return n;
+}
+
+#ifndef __SSE2__
+/* Case-flip mask (0x20 in every byte to flip) for 8 ASCII bytes packed in w. */
+static uint64_t vim_case_swar_mask(uint64_t w, int how) {
+    const uint64_t ones = 0x0101010101010101ULL;
+    const uint64_t high = 0x8080808080808080ULL;
+    uint64_t       is_upper, is_lower, mask;
+
+    /* adding 0x80 - c sets a byte's high bit iff the byte is >= c; no byte can carry */
+    is_upper = ((w + ones * (0x80 - 'A')) ^ (w + ones * (0x80 - 'Z' - 1))) & high;
+    is_lower = ((w + ones * (0x80 - 'a')) ^ (w + ones * (0x80 - 'z' - 1))) & high;
+
+    switch (how) {
+        case CASE_LOWER: mask = is_upper;            break;
+        case CASE_UPPER: mask = is_lower;            break;
+        default:         mask = is_upper | is_lower; break;
+    }
+
+    return mask >> 2;
+}
+#endif
+
+/* Convert len bytes at p in place. */
+static void vim_case_convert(unsigned char *p, int len, int how) {
+    unsigned char *end, *chunk_end;
+#ifdef __SSE2__
+    __m128i v, upper, lower, mask;
+#else
+    uint64_t w;
+#endif
+
+    end = p + len;
+
+#ifdef __SSE2__
+    while (end - p >= 16) {
+        v = _mm_loadu_si128((__m128i*)p);
+
+        if (_mm_movemask_epi8(v)) {
+            /* multibyte glyphs in this chunk: go glyph by glyph through it */
+            for (chunk_end = p + 16; p < chunk_end;) {
+                p += vim_case_glyph(p, end - p, how);
+            }
+            continue;
+        }
+
+        upper = _mm_and_si128(_mm_cmpgt_epi8(v, _mm_set1_epi8('A' - 1)),
+                              _mm_cmplt_epi8(v, _mm_set1_epi8('Z' + 1)));
+        lower = _mm_and_si128(_mm_cmpgt_epi8(v, _mm_set1_epi8('a' - 1)),
+                              _mm_cmplt_epi8(v, _mm_set1_epi8('z' + 1)));
+
+        switch (how) {
+            case CASE_LOWER: mask = upper;                      break;
+            case CASE_UPPER: mask = lower;                      break;
+            default:         mask = _mm_or_si128(upper, lower); break;
+        }
+
+        v = _mm_xor_si128(v, _mm_and_si128(mask, _mm_set1_epi8(0x20)));
+        _mm_storeu_si128((__m128i*)p, v);
+        p += 16;
+    }
+#else
+    while (end - p >= 8) {
+        memcpy(&w, p, 8);
+
+        if (w & 0x8080808080808080ULL) {
+            for (chunk_end = p + 8; p < chunk_end;) {
+                p += vim_case_glyph(p, end - p, how);
+            }
+            continue;
+        }
+
+        w ^= vim_case_swar_mask(w, how);
+        memcpy(p, &w, 8);
+        p += 8;
+    }
+#endif
+
+    while (p < end) {
+        p += vim_case_glyph(p, end - p, how);
+    }
+}
+
+/* Convert bytes [start, end) of row, writing the line only if it changed. */
+static void vim_case_line(yed_buffer *buff, int row, int start, int end, int how) {
+    yed_line *line;
+    char     *data;
+
+    line = yed_buff_get_line(buff, row);
+    if (!line) { return; }
+
+    if (end > array_len(line->chars)) { end = array_len(line->chars); }
+    if (end <= start) { return; }
+
+    data = array_data(line->chars);
+
+    array_clear(case_scratch);
+    array_push_n(case_scratch, data, array_len(line->chars));
+    vim_case_convert((unsigned char*)array_data(case_scratch) + start, end - start, how);
+
+    if (memcmp(array_data(case_scratch), data, array_len(line->chars)) != 0) {
+        vim_buff_set_line_bytes(buff, row, array_data(case_scratch), array_len(case_scratch));
+    }
+}
+
+/*
+ * Convert from (r1, c1) up to but not including (r2, c2), or rows r1..r2 whole
+ * if linewise.  The positions may be given in either order.
+ */
+static void vim_case_range(int r1, int c1, int r2, int c2, int linewise, int how) {
+    yed_frame  *f;
+    yed_buffer *buff;
+    yed_line   *line;
+    int         row, start, end, tmp;
+
+    f = ys->active_frame;
+    if (!f || !(buff = f->buffer)) { return; }
+
+    if (r1 > r2 || (r1 == r2 && c1 > c2)) {
+        tmp = r1; r1 = r2; r2 = tmp;
+        tmp = c1; c1 = c2; c2 = tmp;
+    }
+
+    yed_start_undo_record(f, buff);
+
+    for (row = r1; row <= r2; row += 1) {
+        if (!(line = yed_buff_get_line(buff, row))) { break; }
+
+        start = 0;
+        end   = array_len(line->chars);
+        if (!linewise) {
+            if (row == r1) { start = vim_line_col_to_byte(line, c1); }
+            if (row == r2) { end   = vim_line_col_to_byte(line, c2); }
+        }
+
+        vim_case_line(buff, row, start, end, how);
+    }
+
+    yed_end_undo_record(f, buff);
+
+    yed_set_cursor_within_frame(f, r1, linewise ? f->cursor_col : c1);
+}
+
+static int vim_case_how(int op) {
+    switch (op) {
+        case 'u': return CASE_LOWER;
+        case 'U': return CASE_UPPER;
+    }
+    return CASE_TOGGLE;
+}
+
+/* '~': toggle count characters under and after the cursor and move past them. */
+static void vim_case_toggle_chars(int count) {
+    yed_frame  *f;
+    yed_buffer *buff;
+    yed_line   *line;
+    char       *data;
+    int         start, end, col;
+
+    f = ys->active_frame;
+    if (!f || !(buff = f->buffer)) { return; }
+
+    line = yed_buff_get_line(buff, f->cursor_line);
+    if (!line || line->visual_width == 0) { return; }
+
+    data  = array_data(line->chars);
+    start = vim_line_col_to_byte(line, f->cursor_col);
+    for (end = start; end < array_len(line->chars) && count > 0; count -= 1) {
+        end += vim_utf8_len((unsigned char)data[end]);
+    }
+
+    yed_start_undo_record(f, buff);
+    vim_case_line(buff, f->cursor_line, start, end, CASE_TOGGLE);
+    yed_end_undo_record(f, buff);
+
+    line = yed_buff_get_line(buff, f->cursor_line);
+    col  = end < array_len(line->chars)
+            ? yed_line_idx_to_col(line, end)
+            : line->visual_width;
+    yed_set_cursor_within_frame(f, f->cursor_line, col);
+}
+
+/* Byte span of the word under the cursor for 'iw' (around = 0) and 'aw'. */
+static int vim_word_object(yed_line *line, int idx, int around, int *start, int *end) {
+    char *data;
+    int   len, cls;
+
+    data = array_data(line->chars);
+    len  = array_len(line->chars);
+    if (idx >= len) { return 0; }
+
+#define VIM_CHAR_CLASS(c) (isspace((unsigned char)(c)) ? 0 : vim_is_word_char((unsigned char)(c)) ? 1 : 2)
+
+    cls    = VIM_CHAR_CLASS(data[idx]);
+    *start = idx;
+    *end   = idx;
+    while (*start > 0 && VIM_CHAR_CLASS(data[*start - 1]) == cls) { *start -= 1; }
+    while (*end < len && VIM_CHAR_CLASS(data[*end]) == cls)       { *end   += 1; }
+
+    if (around) {
+        if (*end < len && isspace((unsigned char)data[*end])) {
+            while (*end < len && isspace((unsigned char)data[*end])) { *end += 1; }
+        } else {
+            while (*start > 0 && isspace((unsigned char)data[*start - 1])) { *start -= 1; }
+        }
+    }
+
+#undef VIM_CHAR_CLASS
+
+    return 1;
+}
+
+/* '~' on a selection, or 'gu', 'gU', 'g~' on one. */
+static void vim_case_selection(int op) {
+    yed_buffer *buff;
+    yed_range  *sel;
+
+    buff = ys->active_frame->buffer;
+    sel  = &buff->selection;
+
+    vim_case_range(sel->anchor_row, sel->anchor_col, sel->cursor_row, sel->cursor_col,
+                   sel->kind == RANGE_LINE, vim_case_how(op));
+    YEXE("select-off");
+}
+
+/* Normal mode '~'. */
+static void vim_case_tilde(int count) {
+    if (ys->active_frame && ys->active_frame->buffer && ys->active_frame->buffer->has_selection) {
+        vim_case_selection('~');
+    } else {
+        vim_case_toggle_chars(count);
+    }
+}
+
+/*
+ * Keys after 'g' in normal mode, and the motion or text object after
+ * 'gu'/'gU'/'g~'.  Returns 1 if the key was consumed.
+ */
+static int vim_case_take_key(int key, char *key_str, int count) {
+    yed_frame *f;
+    yed_line  *line;
+    int        op, start_row, start_col, start, end, linewise, inclusive;
+
+    f = ys->active_frame;
+
+    if (g_pending) {
+        g_pending = 0;
+
+        switch (key) {
+            case 'g':
+                vim_jump_push();
+                if (!vim_large_goto_row(1)) {
+                    YEXE("cursor-buffer-begin");
+                }
+                break;
+
+            case 'J':
+                vim_join(count, 0);
+                break;
+
+            case 'd':
+            case 'D':
+                vim_sym_goto_definition(key == 'D');
+                break;
+
+            case 'u':
+            case 'U':
+            case '~':
+                if (f && f->buffer && f->buffer->has_selection) {
+                    vim_case_selection(key);
+                } else {
+                    case_pending       = key;
+                    case_pending_count = count;
+                }
+                break;
+
+            default:
+                yed_cerr("[NORMAL] unhandled key g%c", key);
+        }
+
+        return 1;
+    }
+
+    if (!case_pending) { return 0; }
+
+    op           = case_pending;
+    case_pending = 0;
+    count       *= case_pending_count;
+
+    if (!f || !f->buffer || key == ESC || key == CTRL_C) {
+        case_object_pending = 0;
+        return 1;
+    }
+
+    if (case_object_pending) {
+        line = yed_buff_get_line(f->buffer, f->cursor_line);
+        if (key == 'w' && line
+        &&  vim_word_object(line, vim_line_col_to_byte(line, f->cursor_col),
+                            case_object_pending == 'a', &start, &end)) {
+            vim_case_range(f->cursor_line, yed_line_idx_to_col(line, start),
+                           f->cursor_line, end < array_len(line->chars) ? yed_line_idx_to_col(line, end) : line->visual_width + 1,
+                           0, vim_case_how(op));
+        } else {
+            yed_cerr("[NORMAL] unsupported text object %c%c", case_object_pending, key);
+        }
+        case_object_pending = 0;
+        return 1;
+    }
+
+    /* guu, gUU, g~~ */
+    if (key == op) {
+        vim_case_range(f->cursor_line, 1, f->cursor_line + count - 1, 1, 1, vim_case_how(op));
+        return 1;
+    }
+
+    if (key == 'i' || key == 'a') {
+        case_pending        = op;
+        case_pending_count  = count;
+        case_object_pending = key;
+        return 1;
+    }
+
+    start_row = f->cursor_line;
+    start_col = f->cursor_col;
+    inclusive = till_pending != 0 || key == 'e' || key == '$' || key == END_KEY;
+
+    nav_count = count;
+    if (!vim_nav_common(key, key_str)) {
+        nav_count = 1;
+        yed_cerr("[NORMAL] '%c' is not a motion", key);
+        return 1;
+    }
+    nav_count = 1;
+
+    if (till_pending || section_pending) {
+        case_pending       = op;
+        case_pending_count = count;
+        return 1;
+    }
+
+    linewise = key == 'j' || key == 'k' || key == 'G'
+            || key == ARROW_UP || key == ARROW_DOWN || key == PAGE_UP || key == PAGE_DOWN;
+
+    end = f->cursor_col;
+    if (inclusive) {
+        line = yed_buff_get_line(f->buffer, f->cursor_line);
+        if (line && line->visual_width > 0) {
+            end += yed_get_glyph_width(*yed_line_col_to_glyph(line, f->cursor_col));
+        }
+    }
+
+    vim_case_range(start_row, start_col, f->cursor_line, end, linewise, vim_case_how(op));
+
+    return 1;
+}
+
+static void vim_case_make(void) {
+    case_scratch = array_make(char);
+}
+
+static void vim_case_free(void) {
+    array_free(case_scratch);
+}
@@ -1,3 +1,173 @@
+/*
+ * Ex command line.  A command may be preceded by a line range:
+ *
+ *     :[range]command [args]
+ *
+ * where the range is '%', or one or two addresses separated by ','.  An
+ * address is a line number, '.', '$', '\'<' or '\'>' (the selection), any of
+ * them followed by +N or -N.  The parsed range is left in ex_range while the
+ * command runs, for the commands that take one; a range with no command moves
+ * the cursor to its last line.
+ */
+
+typedef struct {
+    int given; /* a range was typed */
+    int r1, r2;
+} Ex_Range;
+
+static Ex_Range ex_range;
+static char    *ex_args; /* the arguments of the running command, before splitting */
+
+static int
+ex_parse_number (char **s, int *n)
+{
+    if (!is_digit(**s))
+        return 0;
+
+    *n = 0;
+    while (is_digit(**s)) {
+        *n = (*n * 10) + (**s - '0');
+        (*s)++;
+    }
+    return 1;
+}
+
+static int
+ex_parse_address (char **s, int *row)
+{
+    yed_frame  *f = ys->active_frame;
+    yed_buffer *buff = f ? f->buffer : NULL;
+    int         n, found = 1;
+
+    if (!buff)
+        return 0;
+
+    if (**s == '.') {
+        *row = f->cursor_line;
+        (*s)++;
+    } else if (**s == '$') {
+        *row = yed_buff_n_lines(buff);
+        (*s)++;
+    } else if (**s == '\'' && ((*s)[1] == '<' || (*s)[1] == '>')) {
+        if (!buff->has_selection)
+            return -1;
+        int a = buff->selection.anchor_row;
+        int c = buff->selection.cursor_row;
+        if ((*s)[1] == '<')
+            *row = a < c ? a : c;
+        else
+            *row = a < c ? c : a;
+        *s += 2;
+    } else if (!ex_parse_number(s, row)) {
+        found = 0;
+        *row = f->cursor_line;
+    }
+
+    while (**s == '+' || **s == '-') {
+        int sign = **s == '+' ? 1 : -1;
+        (*s)++;
+        if (!ex_parse_number(s, &n))
+            n = 1;
+        *row += sign * n;
+        found = 1;
+    }
+
+    return found;
+}
+
+/* Parse the range at the start of *s into range and skip it.  Returns 0 on a bad range. */
+static int
+ex_parse_range (char **s, Ex_Range *range)
+{
+    yed_buffer *buff = ys->active_frame ? ys->active_frame->buffer : NULL;
+    int         r;
+
+    range->given = 0;
+
+    while (**s == ' ')
+        (*s)++;
+
+    if (**s == '%') {
+        if (!buff)
+            return 0;
+        range->given = 1;
+        range->r1 = 1;
+        range->r2 = yed_buff_n_lines(buff);
+        (*s)++;
+        return 1;
+    }
+
+    if ((r = ex_parse_address(s, &range->r1)) < 0)
+        return 0;
+    range->given = r;
+    range->r2 = range->r1;
+
+    if (**s == ',') {
+        (*s)++;
+        if (ex_parse_address(s, &range->r2) < 0)
+            return 0;
+        range->given = 1;
+    }
+
+    if (range->given) {
+        if (range->r1 > range->r2) {
+            int tmp = range->r1;
+            range->r1 = range->r2;
+            range->r2 = tmp;
+        }
+        if (range->r1 < 1 || range->r2 > yed_buff_n_lines(buff))
+            return 0;
+    }
+
+    return 1;
+}
+
+/* Run one line typed at the ':' prompt. */
+static void
+ex_execute (char *line)
+{
+    char  *s = line;
+    char  *args[32];
+    int    n_args = 0;
+    char  *name;
+
+    if (!ex_parse_range(&s, &ex_range)) {
+        yed_cerr("invalid range");
+        ex_range.given = 0;
+        return;
+    }
+
+    while (*s == ' ')
+        s++;
+
+    if (*s == 0) {
+        if (ex_range.given)
+            yed_set_cursor_far_within_frame(ys->active_frame, ex_range.r2, 1);
+        ex_range.given = 0;
+        return;
+    }
+
+    /* split into the command name and its arguments */
+    name = s;
+    while (*s && *s != ' ')
+        s++;
+    while (*s == ' ')
+        *s++ = 0;
+    ex_args = strdup(s);
+    while (*s && n_args < 32) {
+        args[n_args++] = s;
+        while (*s && *s != ' ')
+            s++;
+        while (*s == ' ')
+            *s++ = 0;
+    }
+
+    yed_execute_command(name, n_args, args);
+    ex_range.given = 0;
+    free(ex_args);
+    ex_args = NULL;
+}
+
 void
 vim_interactive_mode_start ()
 {
@@ -66,5 +236,5 @@ vim_command (int n_args, char **args)
 
     /* won't get here unless interactive mode finishes */
     is_running = 0;
-    YEXE(array_data(_cmd));
+    ex_execute(array_data(_cmd));
 }
@@ -0,0 +1,752 @@
+/*
+ * Insert mode keyword completion (CTRL-N, CTRL-P).
+ *
+ * Every word of the indexed buffers is interned once in a hash table that
+ * holds its total count across all of them, so candidates from every open
+ * buffer come out of the same lookup.  Prefix lookups binary search an array
+ * of the word ids sorted by text; words seen for the first time since the
+ * array was last merged sit in a short unsorted tail that is scanned as well.
+ *
+ * A buffer is indexed when it is loaded: its text is copied and handed to a
+ * worker thread, which counts and sorts the words of the copy in a table of
+ * its own.  The result is merged into the shared table on the next pump.
+ * Edits only ever touch the lines they change: a line's words are subtracted
+ * before its first modification and added back, as they are then, on the next
+ * pump.  Edits made while the worker is still busy are counted against the
+ * copy it is scanning, so the counts come out right once its result is merged.
+ */
+
+/* Lookups look at no more than this many words with the typed prefix. */
+#define VIM_COMPL_MAX_SCAN       (50000)
+#define VIM_COMPL_MAX_CANDIDATES (32)
+/* Past this many new words the tail is sorted into the main array. */
+#define VIM_COMPL_MAX_TAIL       (1024)
+
+typedef struct {
+    int      off;   /* into the table's text */
+    int      len;
+    int      count; /* may dip below 0 while the buffer's first scan is pending */
+    unsigned hash;
+} vim_compl_word;
+
+typedef struct {
+    array_t  text;    /* char: every word, back to back */
+    array_t  words;   /* vim_compl_word */
+    int     *slots;   /* open addressing: word id + 1, 0 if empty */
+    int      n_slots; /* power of two */
+} vim_word_table;
+
+typedef struct {
+    yed_buffer *buffer;
+    array_t     dirty; /* int rows whose words are subtracted until the next pump, sorted */
+} vim_compl_buffer;
+
+typedef struct {
+    yed_buffer     *buffer;
+    char           *text; /* copy of the buffer, lines separated by '\n' */
+    int             len;
+    vim_word_table  table;
+    array_t         sorted; /* int ids of table, sorted by text */
+} vim_compl_job;
+
+static vim_word_table compl_table;
+static array_t        compl_sorted;  /* int ids of compl_table, sorted by text */
+static array_t        compl_tail;    /* int ids of compl_table not in compl_sorted yet */
+static array_t        compl_buffers; /* vim_compl_buffer */
+static array_t        compl_jobs;    /* vim_compl_job*; the first is running if compl_thread_running */
+static pthread_t      compl_thread;
+static int            compl_thread_running;
+static atomic_int     compl_job_done;
+
+/* the completion in progress */
+static int            compl_active;
+static array_t        compl_candidates; /* int ids */
+static int            compl_idx;        /* -1 while the original prefix is shown */
+static int            compl_row;
+static int            compl_start;      /* byte index of the word being completed */
+static int            compl_shown_len;  /* bytes of the word currently shown */
+static array_t        compl_prefix;     /* char */
+
+static void vim_word_table_init(vim_word_table *t) {
+    t->text    = array_make(char);
+    t->words   = array_make(vim_compl_word);
+    t->n_slots = 1024;
+    t->slots   = calloc(t->n_slots, sizeof(int));
+}
+
+static void vim_word_table_free(vim_word_table *t) {
+    array_free(t->text);
+    array_free(t->words);
+    free(t->slots);
+}
+
+static unsigned vim_word_hash(const char *s, int len) {
+    unsigned h;
+
+    h = 2166136261u;
+    while (len-- > 0) {
+        h = (h ^ (unsigned char)*s++) * 16777619u;
+    }
+
+    return h;
+}
+
+static const char *vim_word_text(vim_word_table *t, vim_compl_word *w) {
+    return (char*)array_data(t->text) + w->off;
+}
+
+static void vim_word_table_grow(vim_word_table *t) {
+    vim_compl_word *w;
+    int             id, i;
+
+    free(t->slots);
+    t->n_slots *= 2;
+    t->slots    = calloc(t->n_slots, sizeof(int));
+
+    id = 0;
+    array_traverse(t->words, w) {
+        for (i = w->hash & (t->n_slots - 1); t->slots[i]; i = (i + 1) & (t->n_slots - 1));
+        t->slots[i] = id + 1;
+        id += 1;
+    }
+}
+
+/* Add delta to the count of the word s, creating it if needed.  Returns its id. */
+static int vim_word_table_add(vim_word_table *t, const char *s, int len, int delta) {
+    vim_compl_word *w, new_word;
+    unsigned        hash;
+    int             i;
+
+    hash = vim_word_hash(s, len);
+
+    for (i = hash & (t->n_slots - 1); t->slots[i]; i = (i + 1) & (t->n_slots - 1)) {
+        w = array_item(t->words, t->slots[i] - 1);
+        if (w->hash == hash && w->len == len && memcmp(vim_word_text(t, w), s, len) == 0) {
+            w->count += delta;
+            return t->slots[i] - 1;
+        }
+    }
+
+    new_word.off   = array_len(t->text);
+    new_word.len   = len;
+    new_word.count = delta;
+    new_word.hash  = hash;
+    array_push_n(t->text, (char*)s, len);
+    array_push(t->words, new_word);
+    t->slots[i] = array_len(t->words);
+
+    if (array_len(t->words) * 2 > t->n_slots) {
+        vim_word_table_grow(t);
+    }
+
+    return array_len(t->words) - 1;
+}
+
+static int vim_word_cmp(vim_word_table *t, int a, int b) {
+    vim_compl_word *wa, *wb;
+    int             r;
+
+    wa = array_item(t->words, a);
+    wb = array_item(t->words, b);
+    r  = memcmp(vim_word_text(t, wa), vim_word_text(t, wb), wa->len < wb->len ? wa->len : wb->len);
+
+    return r ? r : wa->len - wb->len;
+}
+
+/* Bottom-up merge sort of word ids by text. */
+static void vim_word_table_sort(vim_word_table *t, int *ids, int n) {
+    int *tmp, *src, *dst, *swap;
+    int  width, i, m, r, a, b, k;
+
+    if (n < 2) { return; }
+
+    tmp = malloc(n * sizeof(int));
+    src = ids;
+    dst = tmp;
+
+    for (width = 1; width < n; width *= 2) {
+        for (i = 0; i < n; i += 2 * width) {
+            m = i + width     < n ? i + width     : n;
+            r = i + 2 * width < n ? i + 2 * width : n;
+            a = i;
+            b = m;
+            k = i;
+            while (a < m && b < r) { dst[k++] = vim_word_cmp(t, src[a], src[b]) <= 0 ? src[a++] : src[b++]; }
+            while (a < m)          { dst[k++] = src[a++]; }
+            while (b < r)          { dst[k++] = src[b++]; }
+        }
+        swap = src; src = dst; dst = swap;
+    }
+
+    if (src != ids) { memcpy(ids, src, n * sizeof(int)); }
+    free(tmp);
+}
+
+/*
+ * Count the words of s in t.  If new_ids is given, the ids of words that
+ * weren't in t before are pushed onto it.
+ */
+static void vim_word_table_add_text(vim_word_table *t, const char *s, int len, int delta, array_t *new_ids) {
+    int i, start, id, n_before;
+
+    for (i = 0; i < len;) {
+        if (!vim_is_word_char((unsigned char)s[i])) {
+            i += 1;
+            continue;
+        }
+
+        start = i;
+        while (i < len && vim_is_word_char((unsigned char)s[i])) { i += 1; }
+
+        /* single characters aren't worth completing */
+        if (i - start < 2) { continue; }
+
+        n_before = array_len(t->words);
+        id       = vim_word_table_add(t, s + start, i - start, delta);
+        if (new_ids && id == n_before) {
+            array_push(*new_ids, id);
+        }
+    }
+}
+
+/* Merge ids, sorted and not yet in compl_sorted, into it. */
+static void vim_compl_merge_sorted(array_t *ids) {
+    array_t merged;
+    int    *a, *b, na, nb, i, j;
+
+    if (array_len(*ids) == 0) { return; }
+
+    a  = array_data(compl_sorted);
+    na = array_len(compl_sorted);
+    b  = array_data(*ids);
+    nb = array_len(*ids);
+
+    merged = array_make_with_cap(int, na + nb);
+    for (i = j = 0; i < na || j < nb;) {
+        if (j == nb || (i < na && vim_word_cmp(&compl_table, a[i], b[j]) <= 0)) {
+            array_push(merged, a[i]);
+            i += 1;
+        } else {
+            array_push(merged, b[j]);
+            j += 1;
+        }
+    }
+
+    array_free(compl_sorted);
+    compl_sorted = merged;
+}
+
+static void vim_compl_add_line(yed_line *line, int delta) {
+    if (!line || array_len(line->chars) == 0) { return; }
+
+    vim_word_table_add_text(&compl_table, array_data(line->chars), array_len(line->chars), delta, &compl_tail);
+
+    if (array_len(compl_tail) > VIM_COMPL_MAX_TAIL) {
+        vim_word_table_sort(&compl_table, array_data(compl_tail), array_len(compl_tail));
+        vim_compl_merge_sorted(&compl_tail);
+        array_clear(compl_tail);
+    }
+}
+
+/* Count and sort the words of a job's copy.  Touches nothing but the job. */
+static void vim_compl_scan_job(vim_compl_job *job) {
+    int id, n;
+
+    vim_word_table_add_text(&job->table, job->text, job->len, 1, NULL);
+
+    n = array_len(job->table.words);
+    for (id = 0; id < n; id += 1) {
+        array_push(job->sorted, id);
+    }
+    vim_word_table_sort(&job->table, array_data(job->sorted), n);
+}
+
+static void *vim_compl_worker(void *arg) {
+    vim_compl_scan_job(arg);
+    atomic_store_explicit(&compl_job_done, 1, memory_order_release);
+
+    return NULL;
+}
+
+static void vim_compl_merge_job(vim_compl_job *job) {
+    vim_compl_word *w;
+    array_t         new_ids;
+    int            *id, n_before, gid;
+
+    new_ids = array_make(int);
+
+    array_traverse(job->sorted, id) {
+        w        = array_item(job->table.words, *id);
+        n_before = array_len(compl_table.words);
+        gid      = vim_word_table_add(&compl_table, vim_word_text(&job->table, w), w->len, w->count);
+        if (gid == n_before) {
+            array_push(new_ids, gid);
+        }
+    }
+
+    vim_compl_merge_sorted(&new_ids);
+    array_free(new_ids);
+}
+
+static void vim_compl_free_job(vim_compl_job *job) {
+    free(job->text);
+    vim_word_table_free(&job->table);
+    array_free(job->sorted);
+    free(job);
+}
+
+static void vim_compl_start_next_job(void) {
+    vim_compl_job *job;
+
+    if (compl_thread_running || array_len(compl_jobs) == 0) { return; }
+
+    job = *(vim_compl_job**)array_item(compl_jobs, 0);
+
+    atomic_store(&compl_job_done, 0);
+    if (pthread_create(&compl_thread, NULL, vim_compl_worker, job) == 0) {
+        compl_thread_running = 1;
+    } else {
+        /* no thread available; do it here */
+        vim_compl_scan_job(job);
+        vim_compl_merge_job(job);
+        vim_compl_free_job(job);
+        array_delete(compl_jobs, 0);
+    }
+}
+
+/* Make sure the first scan of buff, if any is pending, is merged. */
+static void vim_compl_finish_job(yed_buffer *buff) {
+    vim_compl_job *job;
+    int            i;
+
+    for (i = 0; i < array_len(compl_jobs); i += 1) {
+        job = *(vim_compl_job**)array_item(compl_jobs, i);
+        if (job->buffer != buff) { continue; }
+
+        if (i == 0 && compl_thread_running) {
+            pthread_join(compl_thread, NULL);
+            compl_thread_running = 0;
+        } else {
+            vim_compl_scan_job(job);
+        }
+
+        vim_compl_merge_job(job);
+        vim_compl_free_job(job);
+        array_delete(compl_jobs, i);
+        break;
+    }
+
+    vim_compl_start_next_job();
+}
+
+static vim_compl_buffer *vim_compl_buffer_for(yed_buffer *buff) {
+    vim_compl_buffer *cb;
+
+    array_traverse(compl_buffers, cb) {
+        if (cb->buffer == buff) { return cb; }
+    }
+
+    return NULL;
+}
+
+/* Start indexing buff: copy its text and queue it for the worker. */
+static void vim_compl_track(yed_buffer *buff) {
+    vim_compl_buffer  new_cb;
+    vim_compl_job    *job;
+    yed_line         *line;
+    int               row, n_lines, len;
+
+    if (vim_compl_buffer_for(buff)) { return; }
+
+    new_cb.buffer = buff;
+    new_cb.dirty  = array_make(int);
+    array_push(compl_buffers, new_cb);
+
+    n_lines = yed_buff_n_lines(buff);
+    len     = 0;
+    for (row = 1; row <= n_lines; row += 1) {
+        len += array_len(yed_buff_get_line(buff, row)->chars) + 1;
+    }
+
+    job         = calloc(1, sizeof(*job));
+    job->buffer = buff;
+    job->text   = malloc(len + 1);
+    job->sorted = array_make(int);
+    vim_word_table_init(&job->table);
+
+    for (row = 1; row <= n_lines; row += 1) {
+        line = yed_buff_get_line(buff, row);
+        memcpy(job->text + job->len, array_data(line->chars), array_len(line->chars));
+        job->len               += array_len(line->chars);
+        job->text[job->len++]   = '\n';
+    }
+
+    array_push(compl_jobs, job);
+    vim_compl_start_next_job();
+}
+
+static void vim_compl_flush(vim_compl_buffer *cb) {
+    int *row;
+
+    array_traverse(cb->dirty, row) {
+        vim_compl_add_line(yed_buff_get_line(cb->buffer, *row), 1);
+    }
+    array_clear(cb->dirty);
+}
+
+/* Stop indexing buff and take its words out of the index. */
+static void vim_compl_untrack(yed_buffer *buff) {
+    vim_compl_buffer *cb;
+    int               row, n_lines, i;
+
+    if (!(cb = vim_compl_buffer_for(buff))) { return; }
+
+    vim_compl_finish_job(buff);
+    vim_compl_flush(cb);
+
+    n_lines = yed_buff_n_lines(buff);
+    for (row = 1; row <= n_lines; row += 1) {
+        vim_compl_add_line(yed_buff_get_line(buff, row), -1);
+    }
+
+    array_free(cb->dirty);
+    i = 0;
+    array_traverse(compl_buffers, cb) {
+        if (cb->buffer == buff) {
+            array_delete(compl_buffers, i);
+            break;
+        }
+        i += 1;
+    }
+}
+
+static int vim_compl_dirty_lower_bound(vim_compl_buffer *cb, int row) {
+    int lo, hi, mid;
+
+    lo = 0;
+    hi = array_len(cb->dirty);
+    while (lo < hi) {
+        mid = lo + (hi - lo) / 2;
+        if (*(int*)array_item(cb->dirty, mid) < row) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+
+    return lo;
+}
+
+static void vim_compl_shift_dirty(vim_compl_buffer *cb, int from_idx, int d) {
+    int i;
+
+    for (i = from_idx; i < array_len(cb->dirty); i += 1) {
+        *(int*)array_item(cb->dirty, i) += d;
+    }
+}
+
+static void vim_compl_buffer_pre_mod(yed_event *event) {
+    vim_compl_buffer *cb;
+    int               i, row, n_lines, is_dirty;
+
+    if (event->buffer == NULL || !(cb = vim_compl_buffer_for(event->buffer))) { return; }
+
+    row      = event->row;
+    i        = vim_compl_dirty_lower_bound(cb, row);
+    is_dirty = i < array_len(cb->dirty) && *(int*)array_item(cb->dirty, i) == row;
+
+    switch (event->buff_mod_event) {
+        case BUFF_MOD_ADD_LINE:
+            break;
+
+        case BUFF_MOD_INSERT_LINE:
+            vim_compl_shift_dirty(cb, i, 1);
+            break;
+
+        case BUFF_MOD_DELETE_LINE:
+            if (is_dirty) {
+                array_delete(cb->dirty, i);
+            } else {
+                vim_compl_add_line(yed_buff_get_line(event->buffer, row), -1);
+            }
+            vim_compl_shift_dirty(cb, i, -1);
+            break;
+
+        case BUFF_MOD_CLEAR:
+            n_lines = yed_buff_n_lines(event->buffer);
+            for (row = 1, i = 0; row <= n_lines; row += 1) {
+                if (i < array_len(cb->dirty) && *(int*)array_item(cb->dirty, i) == row) {
+                    i += 1;
+                    continue;
+                }
+                vim_compl_add_line(yed_buff_get_line(event->buffer, row), -1);
+            }
+            array_clear(cb->dirty);
+            break;
+
+        default:
+            if (!is_dirty) {
+                vim_compl_add_line(yed_buff_get_line(event->buffer, row), -1);
+                if (i == array_len(cb->dirty)) {
+                    array_push(cb->dirty, row);
+                } else {
+                    array_insert(cb->dirty, i, row);
+                }
+            }
+    }
+}
+
+static void vim_compl_pump(yed_event *event) {
+    vim_compl_buffer *cb;
+    vim_compl_job    *job;
+
+    array_traverse(compl_buffers, cb) {
+        vim_compl_flush(cb);
+    }
+
+    if (compl_thread_running && atomic_load_explicit(&compl_job_done, memory_order_acquire)) {
+        pthread_join(compl_thread, NULL);
+        compl_thread_running = 0;
+
+        job = *(vim_compl_job**)array_item(compl_jobs, 0);
+        vim_compl_merge_job(job);
+        vim_compl_free_job(job);
+        array_delete(compl_jobs, 0);
+
+        vim_compl_start_next_job();
+    }
+}
+
+static void vim_compl_buffer_pre_load(yed_event *event) {
+    if (event->buffer) { vim_compl_untrack(event->buffer); }
+}
+
+static void vim_compl_buffer_post_load(yed_event *event) {
+    /* large files are indexed on the first completion in them instead */
+    if (event->buffer && !vim_large_for(event->buffer)) { vim_compl_track(event->buffer); }
+}
+
+static void vim_compl_buffer_pre_delete(yed_event *event) {
+    if (event->buffer) { vim_compl_untrack(event->buffer); }
+}
+
+/* Keep id in the best VIM_COMPL_MAX_CANDIDATES of compl_candidates, most frequent first. */
+static void vim_compl_consider(int id) {
+    vim_compl_word *w;
+    int             i, n, *ids;
+
+    w = array_item(compl_table.words, id);
+    if (w->count <= 0 || w->len <= array_len(compl_prefix)) { return; }
+
+    n   = array_len(compl_candidates);
+    ids = array_data(compl_candidates);
+    for (i = n; i > 0 && ((vim_compl_word*)array_item(compl_table.words, ids[i - 1]))->count < w->count; i -= 1);
+
+    if (i == VIM_COMPL_MAX_CANDIDATES) { return; }
+
+    if (i == n) {
+        array_push(compl_candidates, id);
+    } else {
+        array_insert(compl_candidates, i, id);
+    }
+    if (array_len(compl_candidates) > VIM_COMPL_MAX_CANDIDATES) {
+        array_pop(compl_candidates);
+    }
+}
+
+static void vim_compl_lookup(void) {
+    vim_compl_buffer *cb;
+    vim_compl_word   *w;
+    const char       *prefix;
+    int               plen, lo, hi, mid, r, scanned, *id;
+
+    array_traverse(compl_buffers, cb) {
+        vim_compl_flush(cb);
+    }
+
+    array_clear(compl_candidates);
+
+    prefix = array_data(compl_prefix);
+    plen   = array_len(compl_prefix);
+
+    lo = 0;
+    hi = array_len(compl_sorted);
+    while (lo < hi) {
+        mid = lo + (hi - lo) / 2;
+        w   = array_item(compl_table.words, *(int*)array_item(compl_sorted, mid));
+        r   = memcmp(vim_word_text(&compl_table, w), prefix, w->len < plen ? w->len : plen);
+        if (r < 0 || (r == 0 && w->len < plen)) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+
+    for (scanned = 0; lo < array_len(compl_sorted) && scanned < VIM_COMPL_MAX_SCAN; lo += 1, scanned += 1) {
+        id = array_item(compl_sorted, lo);
+        w  = array_item(compl_table.words, *id);
+        if (w->len < plen || memcmp(vim_word_text(&compl_table, w), prefix, plen) != 0) { break; }
+        vim_compl_consider(*id);
+    }
+
+    array_traverse(compl_tail, id) {
+        w = array_item(compl_table.words, *id);
+        if (w->len >= plen && memcmp(vim_word_text(&compl_table, w), prefix, plen) == 0) {
+            vim_compl_consider(*id);
+        }
+    }
+}
+
+/* Replace the word shown at the completion point with s. */
+static void vim_compl_show(const char *s, int len) {
+    yed_frame  *f;
+    yed_buffer *buff;
+    yed_line   *line;
+    array_t     new_line;
+    char       *data;
+    int         end;
+
+    f    = ys->active_frame;
+    buff = f->buffer;
+    line = yed_buff_get_line(buff, compl_row);
+    data = array_data(line->chars);
+    end  = compl_start + compl_shown_len;
+
+    new_line = array_make_with_cap(char, array_len(line->chars) - compl_shown_len + len + 1);
+    array_push_n(new_line, data, compl_start);
+    array_push_n(new_line, (char*)s, len);
+    array_push_n(new_line, data + end, array_len(line->chars) - end);
+
+    vim_buff_set_line_bytes(buff, compl_row, array_data(new_line), array_len(new_line));
+    array_free(new_line);
+
+    compl_shown_len = len;
+
+    line = yed_buff_get_line(buff, compl_row);
+    yed_set_cursor_within_frame(f, compl_row,
+                                compl_start + len < array_len(line->chars)
+                                    ? yed_line_idx_to_col(line, compl_start + len)
+                                    : line->visual_width + 1);
+}
+
+static void vim_complete_reset(void) {
+    compl_active = 0;
+}
+
+/* CTRL-N (direction 1) and CTRL-P (direction -1) in insert mode. */
+static void vim_complete(int direction) {
+    yed_frame      *f;
+    yed_line       *line;
+    vim_compl_word *w;
+    char           *data;
+    int             idx, n;
+
+    f = ys->active_frame;
+    if (!f || !f->buffer) { return; }
+
+    if (!compl_active) {
+        line = yed_buff_get_line(f->buffer, f->cursor_line);
+        if (!line) { return; }
+
+        if (!vim_compl_buffer_for(f->buffer)) {
+            /* not loaded from a file, or loaded before the plugin: index it now */
+            vim_compl_track(f->buffer);
+            if (yed_buff_n_lines(f->buffer) < 10000) {
+                vim_compl_finish_job(f->buffer);
+            }
+        }
+
+        data = array_data(line->chars);
+        idx  = vim_line_col_to_byte(line, f->cursor_col);
+        for (compl_start = idx; compl_start > 0 && vim_is_word_char((unsigned char)data[compl_start - 1]); compl_start -= 1);
+
+        if (compl_start == idx) {
+            yed_cerr("no word before the cursor to complete");
+            return;
+        }
+
+        array_clear(compl_prefix);
+        array_push_n(compl_prefix, data + compl_start, idx - compl_start);
+
+        vim_compl_lookup();
+        if (array_len(compl_candidates) == 0) {
+            array_zero_term(compl_prefix);
+            yed_cerr("no completions for '%s'", (char*)array_data(compl_prefix));
+            return;
+        }
+
+        compl_active    = 1;
+        compl_row       = f->cursor_line;
+        compl_shown_len = array_len(compl_prefix);
+        compl_idx       = -1;
+    }
+
+    /* cycle through the candidates and back to what was typed, like vim */
+    n = array_len(compl_candidates);
+    compl_idx += direction;
+    if (compl_idx < -1) { compl_idx = n - 1; }
+    if (compl_idx >= n) { compl_idx = -1; }
+
+    if (compl_idx < 0) {
+        vim_compl_show(array_data(compl_prefix), array_len(compl_prefix));
+    } else {
+        w = array_item(compl_table.words, *(int*)array_item(compl_candidates, compl_idx));
+        vim_compl_show(vim_word_text(&compl_table, w), w->len);
+    }
+}
+
+static void vim_complete_make(void) {
+    yed_event_handler h;
+
+    vim_word_table_init(&compl_table);
+    compl_sorted     = array_make(int);
+    compl_tail       = array_make(int);
+    compl_buffers    = array_make(vim_compl_buffer);
+    compl_jobs       = array_make(vim_compl_job*);
+    compl_candidates = array_make(int);
+    compl_prefix     = array_make(char);
+
+    h.kind = EVENT_BUFFER_PRE_MOD;
+    h.fn   = vim_compl_buffer_pre_mod;
+    yed_plugin_add_event_handler(Self, h);
+
+    h.kind = EVENT_PRE_PUMP;
+    h.fn   = vim_compl_pump;
+    yed_plugin_add_event_handler(Self, h);
+
+    h.kind = EVENT_BUFFER_PRE_LOAD;
+    h.fn   = vim_compl_buffer_pre_load;
+    yed_plugin_add_event_handler(Self, h);
+
+    h.kind = EVENT_BUFFER_POST_LOAD;
+    h.fn   = vim_compl_buffer_post_load;
+    yed_plugin_add_event_handler(Self, h);
+
+    h.kind = EVENT_BUFFER_PRE_DELETE;
+    h.fn   = vim_compl_buffer_pre_delete;
+    yed_plugin_add_event_handler(Self, h);
+}
+
+static void vim_complete_free(void) {
+    vim_compl_buffer  *cb;
+    vim_compl_job    **job;
+
+    if (compl_thread_running) {
+        pthread_join(compl_thread, NULL);
+        compl_thread_running = 0;
+    }
+    array_traverse(compl_jobs, job) {
+        vim_compl_free_job(*job);
+    }
+    array_traverse(compl_buffers, cb) {
+        array_free(cb->dirty);
+    }
+
+    vim_word_table_free(&compl_table);
+    array_free(compl_sorted);
+    array_free(compl_tail);
+    array_free(compl_buffers);
+    array_free(compl_jobs);
+    array_free(compl_candidates);
+    array_free(compl_prefix);
+}
@@ -0,0 +1,174 @@
+/*
+ * Buffer editing primitives shared by the operators.
+ *
+ * yed's line API works one glyph at a time; these helpers move runs of raw
+ * UTF-8 bytes in and out of lines so that operators can build their result
+ * once and then apply it with a single pass per line.  None of them start an
+ * undo record -- callers wrap a whole operation in one.
+ */
+
+static int vim_utf8_len(unsigned char c) {
+    if (c < 0x80)           { return 1; }
+    if ((c & 0xE0) == 0xC0) { return 2; }
+    if ((c & 0xF0) == 0xE0) { return 3; }
+    if ((c & 0xF8) == 0xF0) { return 4; }
+    return 1;
+}
+
+static yed_glyph vim_glyph_at(const char *s, int len) {
+    yed_glyph g;
+    int       n;
+
+    n = vim_utf8_len((unsigned char)*s);
+    if (n > len) { n = len; }
+
+    g.data = 0;
+    memcpy(g.bytes, s, n);
+
+    return g;
+}
+
+/* Byte index of a 1-based column.  Columns past the end map to the line length. */
+static int vim_line_col_to_byte(yed_line *line, int col) {
+    if (col <= 1)                  { return 0;                        }
+    if (col > line->visual_width)  { return array_len(line->chars);   }
+    return yed_line_col_to_idx(line, col);
+}
+
+static void vim_buff_append_bytes(yed_buffer *buff, int row, const char *s, int len) {
+    yed_glyph g;
+    int       n;
+
+    while (len > 0) {
+        g = vim_glyph_at(s, len);
+        n = vim_utf8_len(g.bytes[0]);
+        yed_append_to_line(buff, row, g);
+        s   += n;
+        len -= n;
+    }
+}
+
+/* Insert bytes that don't contain a newline at col. */
+static void vim_buff_insert_bytes(yed_buffer *buff, int row, int col, const char *s, int len) {
+    yed_line  *line;
+    yed_glyph  g;
+    int        n;
+
+    line = yed_buff_get_line(buff, row);
+    if (!line) { return; }
+
+    if (col > line->visual_width) {
+        vim_buff_append_bytes(buff, row, s, len);
+        return;
+    }
+
+    while (len > 0) {
+        g = vim_glyph_at(s, len);
+        n = vim_utf8_len(g.bytes[0]);
+        yed_insert_into_line(buff, row, col, g);
+        col += yed_get_glyph_width(g);
+        s   += n;
+        len -= n;
+    }
+}
+
+/* Drop everything from byte idx to the end of the line. */
+static void vim_buff_truncate_line(yed_buffer *buff, int row, int idx) {
+    yed_line *line;
+
+    while ((line = yed_buff_get_line(buff, row)) && array_len(line->chars) > idx) {
+        yed_pop_from_line(buff, row);
+    }
+}
+
+/* Remove bytes [start, end) of row; both must be on glyph boundaries. */
+static void vim_buff_delete_bytes(yed_buffer *buff, int row, int start, int end) {
+    yed_line *line;
+    int       col;
+
+    line = yed_buff_get_line(buff, row);
+    if (!line || start >= end) { return; }
+
+    if (end >= array_len(line->chars)) {
+        vim_buff_truncate_line(buff, row, start);
+        return;
+    }
+
+    col = yed_line_idx_to_col(line, start);
+    while (end > start) {
+        line  = yed_buff_get_line(buff, row);
+        end  -= vim_utf8_len(((unsigned char*)array_data(line->chars))[start]);
+        yed_delete_from_line(buff, row, col);
+    }
+}
+
+/* Insert bytes that don't contain a newline at byte idx. */
+static void vim_buff_insert_bytes_at_idx(yed_buffer *buff, int row, int idx, const char *s, int len) {
+    yed_line *line;
+
+    line = yed_buff_get_line(buff, row);
+    if (!line) { return; }
+
+    if (idx >= array_len(line->chars)) {
+        vim_buff_append_bytes(buff, row, s, len);
+    } else {
+        vim_buff_insert_bytes(buff, row, yed_line_idx_to_col(line, idx), s, len);
+    }
+}
+
+/* Replace the whole contents of row. */
+static void vim_buff_set_line_bytes(yed_buffer *buff, int row, const char *s, int len) {
+    yed_line_clear(buff, row);
+    vim_buff_append_bytes(buff, row, s, len);
+}
+
+/* Insert a new line holding s before row. */
+static void vim_buff_insert_line_bytes(yed_buffer *buff, int row, const char *s, int len) {
+    yed_buff_insert_line(buff, row);
+    vim_buff_append_bytes(buff, row, s, len);
+}
+
+/*
+ * Insert text that may span lines at (row, col).  Returns the number of new
+ * lines created.
+ */
+static int vim_buff_insert_text(yed_buffer *buff, int row, int col, const char *s, int len) {
+    yed_line   *line;
+    array_t     tail;
+    const char *nl;
+    int         idx, n_new;
+
+    nl = memchr(s, '\n', len);
+    if (nl == NULL) {
+        vim_buff_insert_bytes(buff, row, col, s, len);
+        return 0;
+    }
+
+    line = yed_buff_get_line(buff, row);
+    if (!line) { return 0; }
+
+    /* split the line at col and keep what was after it for the last line */
+    idx  = vim_line_col_to_byte(line, col);
+    tail = array_make_with_cap(char, array_len(line->chars) - idx + 1);
+    array_push_n(tail, (char*)array_data(line->chars) + idx, array_len(line->chars) - idx);
+    vim_buff_truncate_line(buff, row, idx);
+
+    vim_buff_append_bytes(buff, row, s, nl - s);
+    len -= nl - s + 1;
+    s    = nl + 1;
+
+    n_new = 0;
+    for (;;) {
+        nl     = memchr(s, '\n', len);
+        n_new += 1;
+        vim_buff_insert_line_bytes(buff, row + n_new, s, nl ? nl - s : len);
+        if (nl == NULL) { break; }
+        len -= nl - s + 1;
+        s    = nl + 1;
+    }
+
+    vim_buff_append_bytes(buff, row + n_new, array_data(tail), array_len(tail));
+    array_free(tail);
+
+    return n_new;
+}
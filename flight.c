@@ -0,0 +1,265 @@
+/*
+ * Flight recorder: the last VIM_FLIGHT_RING_SIZE keys typed, each with the
+ * mode, the time, the active buffer's line count and the cursor, in a fixed
+ * binary ring.  Recording a key is a struct copy.
+ *
+ * The ring is written to vim-flight-file (by default /tmp/yed-vim-flight-<pid>)
+ * when yed crashes on SIGSEGV, SIGBUS, SIGFPE, SIGILL or SIGABRT, or on
+ * demand with vim-flight-dump.  vim-flight-replay feeds a dump back through
+ * yed's key handling one key at a time, checking the recorded state before
+ * each one, so a session that crashed or stalled can be run again from the
+ * same file.
+ */
+
+#include <fcntl.h>
+#include <signal.h>
+#include <time.h>
+
+#define VIM_FLIGHT_MAGIC     (0x4c465659) /* "YVFL" */
+#define VIM_FLIGHT_VERSION   (1)
+#define VIM_FLIGHT_RING_SIZE (4096) /* power of two */
+
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t rec_size;
+    uint32_t n_recs;
+    uint64_t start_unix; /* wall clock time the recording started */
+} vim_flight_header;
+
+typedef struct {
+    uint64_t us;      /* since the recording started */
+    int32_t  key;
+    int32_t  n_lines; /* of the active buffer, 0 if there is none */
+    int32_t  row;
+    int32_t  col;
+    uint8_t  mode;
+    uint8_t  prompt;  /* typed into a prompt */
+    uint8_t  pad[6];
+} vim_flight_rec;
+
+static const int crash_signals[] = { SIGSEGV, SIGBUS, SIGFPE, SIGILL, SIGABRT };
+
+static vim_flight_rec     flight_ring[VIM_FLIGHT_RING_SIZE];
+static unsigned           flight_head;
+static unsigned long long flight_start_us;
+static uint64_t           flight_start_unix;
+static int                flight_replaying;
+static char               flight_crash_path[4096];
+static struct sigaction   flight_old_actions[sizeof(crash_signals) / sizeof(crash_signals[0])];
+
+static void vim_flight_record(int key) {
+    vim_flight_rec *r;
+    yed_frame      *f;
+
+    if (flight_replaying) { return; }
+
+    r = flight_ring + (flight_head++ & (VIM_FLIGHT_RING_SIZE - 1));
+    f = ys->active_frame;
+
+    r->us      = vim_stats_now_us() - flight_start_us;
+    r->key     = key;
+    r->mode    = mode;
+    r->prompt  = ys->interactive_command != NULL;
+    r->n_lines = (f && f->buffer) ? yed_buff_n_lines(f->buffer) : 0;
+    r->row     = f ? f->cursor_line : 0;
+    r->col     = f ? f->cursor_col  : 0;
+}
+
+/* Only uses write(), so it's safe in a signal handler.  Returns 0 on failure. */
+static int vim_flight_write(int fd) {
+    vim_flight_header h;
+    unsigned          n, first;
+
+    n     = flight_head < VIM_FLIGHT_RING_SIZE ? flight_head : VIM_FLIGHT_RING_SIZE;
+    first = (flight_head - n) & (VIM_FLIGHT_RING_SIZE - 1);
+
+    h.magic      = VIM_FLIGHT_MAGIC;
+    h.version    = VIM_FLIGHT_VERSION;
+    h.rec_size   = sizeof(vim_flight_rec);
+    h.n_recs     = n;
+    h.start_unix = flight_start_unix;
+
+    if (write(fd, &h, sizeof(h)) != sizeof(h)) { return 0; }
+
+    /* oldest first: the tail of the array, then its head */
+    if (first + n > VIM_FLIGHT_RING_SIZE) {
+        if (write(fd, flight_ring + first, (VIM_FLIGHT_RING_SIZE - first) * sizeof(vim_flight_rec)) < 0) { return 0; }
+        n -= VIM_FLIGHT_RING_SIZE - first;
+        first = 0;
+    }
+
+    return write(fd, flight_ring + first, n * sizeof(vim_flight_rec)) >= 0;
+}
+
+static void vim_flight_crash(int sig) {
+    int fd, i;
+
+    if ((fd = open(flight_crash_path, O_WRONLY | O_CREAT | O_TRUNC, 0600)) >= 0) {
+        vim_flight_write(fd);
+        close(fd);
+    }
+
+    /* let whatever was handling the signal before have it */
+    for (i = 0; i < (int)(sizeof(crash_signals) / sizeof(crash_signals[0])); i += 1) {
+        if (crash_signals[i] == sig) {
+            sigaction(sig, &flight_old_actions[i], NULL);
+        }
+    }
+    raise(sig);
+}
+
+static void vim_flight_set_path(void) {
+    char *path;
+
+    if ((path = yed_get_var("vim-flight-file"))) {
+        snprintf(flight_crash_path, sizeof(flight_crash_path), "%s", path);
+    } else {
+        snprintf(flight_crash_path, sizeof(flight_crash_path), "/tmp/yed-vim-flight-%d", getpid());
+    }
+}
+
+static void vim_flight_var_changed(yed_event *event) {
+    if (event->var_name && strcmp(event->var_name, "vim-flight-file") == 0) {
+        vim_flight_set_path();
+    }
+}
+
+void vim_flight_dump(int n_args, char **args) {
+    const char *path;
+    int         fd, ok;
+
+    if (n_args > 1) {
+        yed_cerr("expected 0 or 1 arguments, but got %d", n_args);
+        return;
+    }
+
+    path = n_args ? args[0] : flight_crash_path;
+
+    if ((fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0600)) < 0) {
+        yed_cerr("could not open '%s' for writing", path);
+        return;
+    }
+    ok = vim_flight_write(fd);
+    close(fd);
+
+    if (!ok) {
+        yed_cerr("could not write '%s'", path);
+        return;
+    }
+
+    yed_cprint("wrote %u keys to '%s'", flight_head < VIM_FLIGHT_RING_SIZE ? flight_head : VIM_FLIGHT_RING_SIZE, path);
+}
+
+/*
+ * Feed a dump back one key at a time.  Before each key the active buffer's
+ * line count, the cursor and the mode are checked against the recording, and
+ * the replay stops at the first difference.  Start it with the same file open
+ * and the cursor where the recording starts.  The slowest key is reported.
+ */
+void vim_flight_replay(int n_args, char **args) {
+    vim_flight_header   h;
+    vim_flight_rec     *recs, *r;
+    yed_frame          *f;
+    FILE               *fp;
+    unsigned long long  start, us, slowest_us;
+    int                 i, n_lines, slowest;
+
+    if (n_args != 1) {
+        yed_cerr("expected 1 argument, but got %d", n_args);
+        return;
+    }
+
+    if (!(fp = fopen(args[0], "r"))) {
+        yed_cerr("could not open '%s'", args[0]);
+        return;
+    }
+
+    if (fread(&h, sizeof(h), 1, fp) != 1
+    ||  h.magic != VIM_FLIGHT_MAGIC || h.version != VIM_FLIGHT_VERSION || h.rec_size != sizeof(vim_flight_rec)) {
+        yed_cerr("'%s' is not a flight recorder dump", args[0]);
+        fclose(fp);
+        return;
+    }
+
+    recs = malloc((h.n_recs ? h.n_recs : 1) * sizeof(*recs));
+    if (fread(recs, sizeof(*recs), h.n_recs, fp) != h.n_recs) {
+        yed_cerr("'%s' is truncated", args[0]);
+        free(recs);
+        fclose(fp);
+        return;
+    }
+    fclose(fp);
+
+    slowest    = -1;
+    slowest_us = 0;
+
+    flight_replaying = 1;
+
+    for (i = 0; i < (int)h.n_recs; i += 1) {
+        r       = recs + i;
+        f       = ys->active_frame;
+        n_lines = (f && f->buffer) ? yed_buff_n_lines(f->buffer) : 0;
+
+        if (r->n_lines != n_lines
+        ||  r->row != (f ? f->cursor_line : 0)
+        ||  r->col != (f ? f->cursor_col : 0)
+        ||  r->mode != mode) {
+            yed_cerr("replay diverged before key %d of %u (%d): recorded %d lines at %d:%d in %s, have %d lines at %d:%d in %s",
+                     i + 1, h.n_recs, r->key,
+                     r->n_lines, r->row, r->col, mode_strs[r->mode < N_MODES ? r->mode : 0],
+                     n_lines, f ? f->cursor_line : 0, f ? f->cursor_col : 0, mode_strs[mode]);
+            break;
+        }
+
+        start = vim_stats_now_us();
+        yed_take_key(r->key);
+        us    = vim_stats_now_us() - start;
+
+        if (us > slowest_us) {
+            slowest_us = us;
+            slowest    = i;
+        }
+    }
+
+    flight_replaying = 0;
+
+    if (i == (int)h.n_recs) {
+        if (slowest >= 0) {
+            yed_cprint("replayed %u keys; the slowest was key %d (%d) at %llu us", h.n_recs, slowest + 1, recs[slowest].key, slowest_us);
+        } else {
+            yed_cprint("replayed %u keys", h.n_recs);
+        }
+    }
+
+    free(recs);
+}
+
+static void vim_flight_make(void) {
+    yed_event_handler h;
+    struct sigaction  sa;
+    int               i;
+
+    flight_start_us   = vim_stats_now_us();
+    flight_start_unix = time(NULL);
+    vim_flight_set_path();
+
+    h.kind = EVENT_VAR_POST_SET;
+    h.fn   = vim_flight_var_changed;
+    yed_plugin_add_event_handler(Self, h);
+
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = vim_flight_crash;
+    sigemptyset(&sa.sa_mask);
+    for (i = 0; i < (int)(sizeof(crash_signals) / sizeof(crash_signals[0])); i += 1) {
+        sigaction(crash_signals[i], &sa, &flight_old_actions[i]);
+    }
+}
+
+static void vim_flight_free(void) {
+    int i;
+
+    for (i = 0; i < (int)(sizeof(crash_signals) / sizeof(crash_signals[0])); i += 1) {
+        sigaction(crash_signals[i], &flight_old_actions[i], NULL);
+    }
+}
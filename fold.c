@@ -0,0 +1,617 @@
+/*
+ * Folding: 'zf', 'zF', 'zo', 'zc', 'zR', 'zM', 'zd', 'zE' and indent folds.
+ *
+ * The folds of a buffer are kept in an interval tree: a treap ordered by the
+ * first row, where every node also knows the largest last row in its subtree
+ * and the largest last row of the closed folds in its subtree.  With that,
+ * the outermost closed fold around a row is found in one walk down the tree,
+ * so 'j' and 'k' step over closed folds in O(log n).  Row changes from line
+ * insertions and deletions are applied to the folds below the edit with a
+ * lazy delta on one split-off subtree; only folds that span the edited row
+ * are touched individually.
+ *
+ * yed can't hide lines from a plugin, so the rows of a closed fold are drawn
+ * with vim-fold-attrs instead, and the cursor never stops inside one.
+ */
+
+typedef struct vim_fold_t {
+    struct vim_fold_t *left, *right;
+    int                start, end;     /* first and last row */
+    int                closed;
+    int                max_end;        /* largest end in this subtree */
+    int                max_closed_end; /* largest end of a closed fold in this subtree, 0 if none */
+    int                lazy;           /* row delta not yet applied to the children */
+    unsigned           prio;
+} vim_fold;
+
+typedef struct {
+    yed_buffer *buffer;
+    vim_fold   *root;
+} vim_fold_tree;
+
+static array_t  fold_trees;         /* vim_fold_tree */
+static unsigned fold_seed = 2463534242u;
+static int      fold_pending;       /* 'z' was typed in normal mode */
+static int      fold_create_pending; /* 'zf' waiting for a motion */
+static int      fold_create_count;
+
+static vim_fold_tree *vim_fold_tree_for(yed_buffer *buff, int create) {
+    vim_fold_tree *t, new_tree;
+
+    array_traverse(fold_trees, t) {
+        if (t->buffer == buff) { return t; }
+    }
+
+    if (!create) { return NULL; }
+
+    new_tree.buffer = buff;
+    new_tree.root   = NULL;
+    array_push(fold_trees, new_tree);
+
+    return array_last(fold_trees);
+}
+
+static void vim_fold_apply(vim_fold *n, int d) {
+    if (!n) { return; }
+
+    n->start   += d;
+    n->end     += d;
+    n->max_end += d;
+    if (n->max_closed_end) { n->max_closed_end += d; }
+    n->lazy    += d;
+}
+
+static void vim_fold_push(vim_fold *n) {
+    if (n->lazy) {
+        vim_fold_apply(n->left, n->lazy);
+        vim_fold_apply(n->right, n->lazy);
+        n->lazy = 0;
+    }
+}
+
+static void vim_fold_pull(vim_fold *n) {
+    n->max_end        = n->end;
+    n->max_closed_end = n->closed ? n->end : 0;
+
+    if (n->left) {
+        if (n->left->max_end > n->max_end)               { n->max_end        = n->left->max_end;        }
+        if (n->left->max_closed_end > n->max_closed_end) { n->max_closed_end = n->left->max_closed_end; }
+    }
+    if (n->right) {
+        if (n->right->max_end > n->max_end)               { n->max_end        = n->right->max_end;        }
+        if (n->right->max_closed_end > n->max_closed_end) { n->max_closed_end = n->right->max_closed_end; }
+    }
+}
+
+/* Every start in a must be <= every start in b. */
+static vim_fold *vim_fold_merge(vim_fold *a, vim_fold *b) {
+    if (!a) { return b; }
+    if (!b) { return a; }
+
+    if (a->prio > b->prio) {
+        vim_fold_push(a);
+        a->right = vim_fold_merge(a->right, b);
+        vim_fold_pull(a);
+        return a;
+    }
+
+    vim_fold_push(b);
+    b->left = vim_fold_merge(a, b->left);
+    vim_fold_pull(b);
+    return b;
+}
+
+/* l gets the folds starting before row, r the rest. */
+static void vim_fold_split(vim_fold *n, int row, vim_fold **l, vim_fold **r) {
+    if (!n) {
+        *l = *r = NULL;
+        return;
+    }
+
+    vim_fold_push(n);
+
+    if (n->start < row) {
+        vim_fold_split(n->right, row, &n->right, r);
+        *l = n;
+    } else {
+        vim_fold_split(n->left, row, l, &n->left);
+        *r = n;
+    }
+
+    vim_fold_pull(n);
+}
+
+static void vim_fold_free_tree(vim_fold *n) {
+    if (!n) { return; }
+
+    vim_fold_free_tree(n->left);
+    vim_fold_free_tree(n->right);
+    free(n);
+}
+
+static void vim_fold_add(vim_fold_tree *t, int start, int end, int closed) {
+    vim_fold *n, *l, *r;
+
+    n = calloc(1, sizeof(*n));
+
+    fold_seed ^= fold_seed << 13;
+    fold_seed ^= fold_seed >> 17;
+    fold_seed ^= fold_seed << 5;
+
+    n->start  = start;
+    n->end    = end;
+    n->closed = closed;
+    n->prio   = fold_seed;
+    vim_fold_pull(n);
+
+    vim_fold_split(t->root, start, &l, &r);
+    t->root = vim_fold_merge(vim_fold_merge(l, n), r);
+}
+
+/* The outermost closed fold containing row, or NULL. */
+static vim_fold *vim_fold_outer_closed(vim_fold *n, int row) {
+    while (n && n->max_closed_end >= row) {
+        vim_fold_push(n);
+
+        if (n->start > row) {
+            n = n->left;
+        } else if (n->left && n->left->max_closed_end >= row) {
+            /* everything on the left starts before row, so this one contains it */
+            n = n->left;
+        } else if (n->closed && n->end >= row) {
+            return n;
+        } else {
+            n = n->right;
+        }
+    }
+
+    return NULL;
+}
+
+/* The innermost fold containing row whose closed state is closed, or any if closed < 0. */
+static vim_fold *vim_fold_inner(vim_fold *n, int row, int closed) {
+    vim_fold *best, *sub;
+
+    if (!n || n->max_end < row) { return NULL; }
+
+    vim_fold_push(n);
+
+    best = vim_fold_inner(n->left, row, closed);
+
+    if (n->start <= row) {
+        if (n->end >= row
+        &&  (closed < 0 || n->closed == closed)
+        &&  (!best || n->start > best->start || (n->start == best->start && n->end < best->end))) {
+            best = n;
+        }
+
+        sub = vim_fold_inner(n->right, row, closed);
+        if (sub && (!best || sub->start > best->start || (sub->start == best->start && sub->end < best->end))) {
+            best = sub;
+        }
+    }
+
+    return best;
+}
+
+/* Recompute the subtree data on the path from n down to target. */
+static int vim_fold_repull(vim_fold *n, vim_fold *target) {
+    if (!n) { return 0; }
+
+    vim_fold_push(n);
+
+    if (n == target
+    ||  (target->start <= n->start && vim_fold_repull(n->left, target))
+    ||  (target->start >= n->start && vim_fold_repull(n->right, target))) {
+        vim_fold_pull(n);
+        return 1;
+    }
+
+    return 0;
+}
+
+/* Take target out of the subtree n; start is target's first row.  Sets *removed once it's gone. */
+static vim_fold *vim_fold_remove(vim_fold *n, vim_fold *target, int start, int *removed) {
+    vim_fold *merged;
+
+    if (!n || *removed) { return n; }
+
+    vim_fold_push(n);
+
+    if (n == target) {
+        merged = vim_fold_merge(n->left, n->right);
+        free(n);
+        *removed = 1;
+        return merged;
+    }
+
+    if (start <= n->start) { n->left  = vim_fold_remove(n->left, target, start, removed);  }
+    if (start >= n->start) { n->right = vim_fold_remove(n->right, target, start, removed); }
+
+    vim_fold_pull(n);
+
+    return n;
+}
+
+static void vim_fold_set_closed(vim_fold_tree *t, vim_fold *fold, int closed) {
+    fold->closed = closed;
+    vim_fold_repull(t->root, fold);
+}
+
+static void vim_fold_set_all(vim_fold *n, int closed) {
+    if (!n) { return; }
+
+    vim_fold_push(n);
+    n->closed = closed;
+    vim_fold_set_all(n->left, closed);
+    vim_fold_set_all(n->right, closed);
+    vim_fold_pull(n);
+}
+
+/* Move the end of every fold in n that ends at or after row by d. */
+static void vim_fold_shift_ends(vim_fold *n, int row, int d) {
+    if (!n || n->max_end < row) { return; }
+
+    vim_fold_push(n);
+
+    if (n->end >= row) { n->end += d; }
+    vim_fold_shift_ends(n->left, row, d);
+    vim_fold_shift_ends(n->right, row, d);
+
+    vim_fold_pull(n);
+}
+
+/* The folds of n all start on a row that was deleted; shrink them and drop the empty ones. */
+static vim_fold *vim_fold_shrink(vim_fold *n) {
+    vim_fold *merged;
+
+    if (!n) { return NULL; }
+
+    vim_fold_push(n);
+
+    n->left  = vim_fold_shrink(n->left);
+    n->right = vim_fold_shrink(n->right);
+
+    n->end -= 1;
+    if (n->end < n->start) {
+        merged = vim_fold_merge(n->left, n->right);
+        free(n);
+        return merged;
+    }
+
+    vim_fold_pull(n);
+
+    return n;
+}
+
+static void vim_fold_buffer_post_mod(yed_event *event) {
+    vim_fold_tree *t;
+    vim_fold      *l, *m, *r;
+
+    if (event->buffer == NULL || !(t = vim_fold_tree_for(event->buffer, 0)) || !t->root) { return; }
+
+    switch (event->buff_mod_event) {
+        case BUFF_MOD_INSERT_LINE:
+            vim_fold_split(t->root, event->row, &l, &r);
+            vim_fold_apply(r, 1);
+            vim_fold_shift_ends(l, event->row, 1);
+            t->root = vim_fold_merge(l, r);
+            break;
+
+        case BUFF_MOD_DELETE_LINE:
+            vim_fold_split(t->root, event->row, &l, &r);
+            vim_fold_split(r, event->row + 1, &m, &r);
+            vim_fold_apply(r, -1);
+            vim_fold_shift_ends(l, event->row, -1);
+            m       = vim_fold_shrink(m);
+            t->root = vim_fold_merge(l, vim_fold_merge(m, r));
+            break;
+
+        case BUFF_MOD_CLEAR:
+            vim_fold_free_tree(t->root);
+            t->root = NULL;
+            break;
+    }
+}
+
+static void vim_fold_buffer_pre_delete(yed_event *event) {
+    vim_fold_tree *t;
+    int            i;
+
+    i = 0;
+    array_traverse(fold_trees, t) {
+        if (t->buffer == event->buffer) {
+            vim_fold_free_tree(t->root);
+            array_delete(fold_trees, i);
+            return;
+        }
+        i += 1;
+    }
+}
+
+static void vim_fold_line_pre_draw(yed_event *event) {
+    vim_fold_tree *t;
+    yed_attrs      attrs;
+    char          *s;
+
+    if (!event->frame
+    ||  !event->frame->buffer
+    ||  !(t = vim_fold_tree_for(event->frame->buffer, 0))
+    ||  !vim_fold_outer_closed(t->root, event->row)) {
+        return;
+    }
+
+    if ((s = yed_get_var("vim-fold-attrs"))) {
+        attrs = yed_parse_attrs(s);
+        yed_combine_attrs(&event->row_base_attr, &attrs);
+    }
+}
+
+/* 'j' (direction 1) and 'k' (direction -1) over count lines, treating each closed fold as one line. */
+static void vim_fold_move(int direction, int count) {
+    yed_frame     *f;
+    vim_fold_tree *t;
+    vim_fold      *fold;
+    int            row, next, n_lines;
+
+    f = ys->active_frame;
+    if (!f || !f->buffer) { return; }
+
+    t = vim_fold_tree_for(f->buffer, 0);
+    if (!t || !t->root || t->root->max_closed_end == 0) {
+        while (count-- > 0) {
+            YEXE(direction > 0 ? "cursor-down" : "cursor-up");
+        }
+        return;
+    }
+
+    n_lines = yed_buff_n_lines(f->buffer);
+    row     = f->cursor_line;
+
+    while (count-- > 0) {
+        fold = vim_fold_outer_closed(t->root, row);
+        if (direction > 0) {
+            next = (fold ? fold->end : row) + 1;
+        } else {
+            next = (fold ? fold->start : row) - 1;
+        }
+        if (next < 1 || next > n_lines) { break; }
+
+        if ((fold = vim_fold_outer_closed(t->root, next))) {
+            next = fold->start;
+        }
+        row = next;
+    }
+
+    if (row == f->cursor_line + direction) {
+        YEXE(direction > 0 ? "cursor-down" : "cursor-up");
+    } else if (row != f->cursor_line) {
+        yed_set_cursor_within_frame(f, row, f->cursor_col);
+    }
+}
+
+static void vim_fold_create(int r1, int r2) {
+    yed_frame *f;
+    int        tmp;
+
+    f = ys->active_frame;
+    if (!f || !f->buffer) { return; }
+
+    if (r1 > r2) { tmp = r1; r1 = r2; r2 = tmp; }
+    if (r1 < 1)  { r1 = 1; }
+    if (r2 > yed_buff_n_lines(f->buffer)) { r2 = yed_buff_n_lines(f->buffer); }
+
+    /* like vim, a new fold is closed */
+    vim_fold_add(vim_fold_tree_for(f->buffer, 1), r1, r2, 1);
+    yed_set_cursor_within_frame(f, r1, f->cursor_col);
+}
+
+/* Replace the folds of buff with one fold per run of lines indented deeper than their surroundings. */
+static void vim_fold_by_indent(yed_buffer *buff) {
+    vim_fold_tree *t;
+    array_t        starts;
+    int            row, n_lines, level, next_level, depth, width, sw, start;
+
+    t = vim_fold_tree_for(buff, 1);
+    vim_fold_free_tree(t->root);
+    t->root = NULL;
+
+    starts  = array_make(int);
+    n_lines = yed_buff_n_lines(buff);
+    sw      = vim_shift_width();
+    level   = 0;
+
+    for (row = 1; row <= n_lines; row += 1) {
+        /* blank lines take the lower level of the lines around them */
+        if (array_len(yed_buff_get_line(buff, row)->chars) == 0) {
+            for (next_level = 0, width = row + 1; width <= n_lines; width += 1) {
+                if (array_len(yed_buff_get_line(buff, width)->chars) > 0) {
+                    next_level = vim_get_indent(buff, width).width / sw;
+                    break;
+                }
+            }
+            if (next_level < level) { level = next_level; }
+        } else {
+            level = vim_get_indent(buff, row).width / sw;
+        }
+
+        depth = array_len(starts);
+        while (depth < level) {
+            array_push(starts, row);
+            depth += 1;
+        }
+        while (depth > level) {
+            start = *(int*)array_last(starts);
+            array_pop(starts);
+            vim_fold_add(t, start, row - 1, 1);
+            depth -= 1;
+        }
+    }
+
+    while (array_len(starts) > 0) {
+        start = *(int*)array_last(starts);
+        array_pop(starts);
+        vim_fold_add(t, start, n_lines, 1);
+    }
+
+    array_free(starts);
+}
+
+/* 'z' in normal mode */
+static void vim_fold_start(void) {
+    fold_pending = 1;
+}
+
+/*
+ * The key after 'z', or the motion after 'zf'.  Returns 1 if the key was
+ * consumed.
+ */
+static int vim_fold_take_key(int key, char *key_str, int count) {
+    yed_frame     *f;
+    yed_buffer    *buff;
+    vim_fold_tree *t;
+    vim_fold      *fold;
+    int            start_row, removed;
+
+    if (!fold_pending && !fold_create_pending) { return 0; }
+
+    f = ys->active_frame;
+    if (!f || !(buff = f->buffer)) {
+        fold_pending = fold_create_pending = 0;
+        return 1;
+    }
+
+    if (fold_create_pending) {
+        fold_create_pending = 0;
+
+        if (key == ESC || key == CTRL_C) { return 1; }
+
+        count *= fold_create_count;
+
+        start_row = f->cursor_line;
+        nav_count = count;
+        if (!vim_nav_common(key, key_str)) {
+            nav_count = 1;
+            yed_cerr("[NORMAL] '%c' is not a motion", key);
+            return 1;
+        }
+        nav_count = 1;
+        if (till_pending || section_pending) {
+            fold_create_pending = 1;
+            fold_create_count   = count;
+            return 1;
+        }
+        vim_fold_create(start_row, f->cursor_line);
+        return 1;
+    }
+
+    fold_pending = 0;
+    t            = vim_fold_tree_for(buff, 0);
+
+    switch (key) {
+        case 'f':
+            if (buff->has_selection) {
+                vim_fold_create(buff->selection.anchor_row, buff->selection.cursor_row);
+                YEXE("select-off");
+            } else {
+                fold_create_pending = 1;
+                fold_create_count   = count;
+            }
+            break;
+
+        case 'F':
+            vim_fold_create(f->cursor_line, f->cursor_line + count - 1);
+            break;
+
+        case 'o':
+            if (t && (fold = vim_fold_outer_closed(t->root, f->cursor_line))) {
+                vim_fold_set_closed(t, fold, 0);
+            }
+            break;
+
+        case 'c':
+            if (t && (fold = vim_fold_inner(t->root, f->cursor_line, 0))) {
+                vim_fold_set_closed(t, fold, 1);
+                yed_set_cursor_within_frame(f, vim_fold_outer_closed(t->root, f->cursor_line)->start, f->cursor_col);
+            }
+            break;
+
+        case 'R':
+        case 'M':
+            if (t) {
+                vim_fold_set_all(t->root, key == 'M');
+                if (key == 'M' && (fold = vim_fold_outer_closed(t->root, f->cursor_line))) {
+                    yed_set_cursor_within_frame(f, fold->start, f->cursor_col);
+                }
+            }
+            break;
+
+        case 'd':
+            if (t && (fold = vim_fold_inner(t->root, f->cursor_line, -1))) {
+                removed = 0;
+                t->root = vim_fold_remove(t->root, fold, fold->start, &removed);
+            }
+            break;
+
+        case 'E':
+            if (t) {
+                vim_fold_free_tree(t->root);
+                t->root = NULL;
+            }
+            break;
+
+        case ESC:
+        case CTRL_C:
+            break;
+
+        default:
+            yed_cerr("[NORMAL] unhandled key z%c", key);
+    }
+
+    return 1;
+}
+
+/* vim-fold-indent: fold the active buffer by indentation, all folds closed. */
+void vim_fold_indent(int n_args, char **args) {
+    yed_frame *f;
+
+    if (n_args != 0) {
+        yed_cerr("expected 0 arguments, but got %d", n_args);
+        return;
+    }
+
+    f = ys->active_frame;
+    if (!f || !f->buffer) {
+        yed_cerr("no active buffer");
+        return;
+    }
+
+    vim_fold_by_indent(f->buffer);
+}
+
+static void vim_fold_make(void) {
+    yed_event_handler h;
+
+    fold_trees = array_make(vim_fold_tree);
+
+    h.kind = EVENT_BUFFER_POST_MOD;
+    h.fn   = vim_fold_buffer_post_mod;
+    yed_plugin_add_event_handler(Self, h);
+
+    h.kind = EVENT_BUFFER_PRE_DELETE;
+    h.fn   = vim_fold_buffer_pre_delete;
+    yed_plugin_add_event_handler(Self, h);
+
+    h.kind = EVENT_LINE_PRE_DRAW;
+    h.fn   = vim_fold_line_pre_draw;
+    yed_plugin_add_event_handler(Self, h);
+}
+
+static void vim_fold_free(void) {
+    vim_fold_tree *t;
+
+    array_traverse(fold_trees, t) {
+        vim_fold_free_tree(t->root);
+    }
+    array_free(fold_trees);
+}
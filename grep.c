@@ -0,0 +1,724 @@
+/*
+ * :vimgrep (and :grep) and the quickfix list.
+ *
+ *     :vimgrep /pattern/ {glob} ...
+ *
+ * searches the files matching the globs for the literal pattern.  In a glob,
+ * '*' and '?' don't match '/', and a '**' component matches any number of
+ * directories.  Directories whose name starts with '.' aren't searched.
+ *
+ * The search runs on a pool of worker threads, one per processor up to
+ * VIM_GREP_MAX_WORKERS.  Each worker has a deque of tasks, a directory to list
+ * or a file to search: it pushes what it finds in a directory onto its own
+ * deque and takes from the end of it, and when it runs dry it steals from the
+ * front of the others', so the walk spreads over the pool as it goes.  A
+ * worker with nothing to take sleeps until a task is pushed or the walk is
+ * over.  Files are mmapped and searched in place.  A file's matches are
+ * handed over together, and every pump appends whatever has arrived to the
+ * quickfix list, so :cn, :cp and :copen work while the search is still
+ * running.  Files come in the order the pool gets to them, not in directory
+ * order.
+ */
+
+#include <dirent.h>
+#include <sys/mman.h>
+
+#define VIM_GREP_MAX_WORKERS  (8)
+#define VIM_GREP_BINARY_PEEK  (8000) /* a NUL in this many leading bytes means binary */
+#define VIM_GREP_MAX_TEXT     (256)  /* bytes of the matching line kept for the list */
+
+typedef struct {
+    char *path;
+    int   row;
+    int   idx;  /* byte index into the line */
+    char *text;
+} vim_qf_entry;
+
+typedef struct {
+    char *path;
+    int   is_dir;
+    int   depth;
+} vim_grep_task;
+
+struct vim_grep_job_t;
+
+typedef struct {
+    struct vim_grep_job_t *job;
+    int                    id;
+    pthread_t              thread;
+    int                    threaded;
+    pthread_mutex_t        lock;
+    array_t                tasks;  /* vim_grep_task, guarded by lock */
+} vim_grep_worker;
+
+typedef struct vim_grep_job_t {
+    char               *pat;
+    int                 pat_len;
+    array_t             globs;     /* char* */
+    int                 max_depth; /* -1 with a '**' glob */
+    int                 n_workers;
+    int                 n_started; /* workers running, on threads or not */
+    vim_grep_worker     workers[VIM_GREP_MAX_WORKERS];
+    atomic_int          pending;   /* tasks queued or running */
+    atomic_int          n_queued;  /* tasks queued */
+    pthread_mutex_t     idle_lock;
+    pthread_cond_t      idle_cond; /* a task was pushed, pending hit 0 or cancelled */
+    atomic_int          cancel;
+    atomic_int          n_idle;    /* workers that have exited */
+    atomic_int          n_files;   /* files searched */
+    pthread_mutex_t     results_lock;
+    array_t             results;   /* vim_qf_entry, guarded by results_lock */
+    unsigned long long  start_us;
+} vim_grep_job;
+
+static vim_grep_job *grep_job;
+static array_t       qf_entries; /* vim_qf_entry */
+static int           qf_idx = -1;
+
+static int vim_grep_glob_match(const char *g, const char *p) {
+    for (;;) {
+        if (g[0] == '*' && g[1] == '*' && (g[2] == '/' || g[2] == 0)) {
+            if (g[2] == 0) { return 1; }
+
+            /* zero or more whole directories */
+            g += 3;
+            for (;;) {
+                if (vim_grep_glob_match(g, p)) { return 1; }
+                if (!(p = strchr(p, '/')))     { return 0; }
+                p += 1;
+            }
+        }
+
+        switch (*g) {
+            case 0:
+                return *p == 0;
+            case '*':
+                for (g += 1;; p += 1) {
+                    if (vim_grep_glob_match(g, p)) { return 1; }
+                    if (*p == 0 || *p == '/')      { return 0; }
+                }
+            case '?':
+                if (*p == 0 || *p == '/') { return 0; }
+                break;
+            default:
+                if (*g != *p) { return 0; }
+        }
+
+        g += 1;
+        p += 1;
+    }
+}
+
+static int vim_grep_wanted(vim_grep_job *job, const char *path) {
+    char **g;
+
+    array_traverse(job->globs, g) {
+        if (vim_grep_glob_match(*g, path)) { return 1; }
+    }
+
+    return 0;
+}
+
+static void vim_grep_wake(vim_grep_job *job, int all) {
+    pthread_mutex_lock(&job->idle_lock);
+    if (all) {
+        pthread_cond_broadcast(&job->idle_cond);
+    } else {
+        pthread_cond_signal(&job->idle_cond);
+    }
+    pthread_mutex_unlock(&job->idle_lock);
+}
+
+static void vim_grep_push(vim_grep_worker *w, char *path, int is_dir, int depth) {
+    vim_grep_task t;
+
+    t.path   = path;
+    t.is_dir = is_dir;
+    t.depth  = depth;
+
+    atomic_fetch_add(&w->job->pending, 1);
+
+    pthread_mutex_lock(&w->lock);
+    array_push(w->tasks, t);
+    pthread_mutex_unlock(&w->lock);
+
+    atomic_fetch_add(&w->job->n_queued, 1);
+    vim_grep_wake(w->job, 0);
+}
+
+/* Take the newest of our own tasks, or else the oldest of someone else's. */
+static int vim_grep_take(vim_grep_worker *w, vim_grep_task *t) {
+    vim_grep_worker *other;
+    int              i, got;
+
+    pthread_mutex_lock(&w->lock);
+    got = array_len(w->tasks) > 0;
+    if (got) {
+        *t = *(vim_grep_task*)array_last(w->tasks);
+        array_pop(w->tasks);
+    }
+    pthread_mutex_unlock(&w->lock);
+
+    for (i = 1; !got && i < w->job->n_workers; i += 1) {
+        other = &w->job->workers[(w->id + i) % w->job->n_workers];
+
+        pthread_mutex_lock(&other->lock);
+        got = array_len(other->tasks) > 0;
+        if (got) {
+            *t = *(vim_grep_task*)array_item(other->tasks, 0);
+            array_delete(other->tasks, 0);
+        }
+        pthread_mutex_unlock(&other->lock);
+    }
+
+    if (got) {
+        atomic_fetch_sub(&w->job->n_queued, 1);
+    }
+
+    return got;
+}
+
+static void vim_grep_dir(vim_grep_worker *w, vim_grep_task *t) {
+    DIR           *dir;
+    struct dirent *ent;
+    struct stat    st;
+    char          *path;
+    int            is_dir;
+
+    if (!(dir = opendir(t->path[0] ? t->path : "."))) { return; }
+
+    while ((ent = readdir(dir)) && !atomic_load(&w->job->cancel)) {
+        if (ent->d_name[0] == '.') { continue; }
+
+        path = malloc(strlen(t->path) + strlen(ent->d_name) + 2);
+        sprintf(path, "%s%s%s", t->path, (t->path[0] && t->path[strlen(t->path) - 1] != '/') ? "/" : "", ent->d_name);
+
+        if (ent->d_type == DT_DIR || ent->d_type == DT_REG) {
+            is_dir = ent->d_type == DT_DIR;
+        } else if (stat(path, &st) == 0 && (S_ISDIR(st.st_mode) || S_ISREG(st.st_mode))) {
+            is_dir = S_ISDIR(st.st_mode);
+        } else {
+            free(path);
+            continue;
+        }
+
+        if (is_dir ? (w->job->max_depth >= 0 && t->depth + 1 >= w->job->max_depth)
+                   : !vim_grep_wanted(w->job, path)) {
+            free(path);
+            continue;
+        }
+
+        vim_grep_push(w, path, is_dir, t->depth + 1);
+    }
+
+    closedir(dir);
+}
+
+static void vim_grep_file(vim_grep_worker *w, vim_grep_task *t) {
+    vim_grep_job *job;
+    vim_qf_entry  e;
+    array_t       found;
+    struct stat   st;
+    const char   *data, *p, *end;
+    int           fd, len, idx, row, line_start, counted, text_len;
+
+    job = w->job;
+
+    if ((fd = open(t->path, O_RDONLY)) < 0) { return; }
+    if (fstat(fd, &st) < 0 || !S_ISREG(st.st_mode) || st.st_size == 0 || st.st_size > INT_MAX) {
+        close(fd);
+        return;
+    }
+
+    len  = st.st_size;
+    data = mmap(NULL, len, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED) { return; }
+
+    atomic_fetch_add(&job->n_files, 1);
+
+    if (memchr(data, 0, len < VIM_GREP_BINARY_PEEK ? len : VIM_GREP_BINARY_PEEK)) {
+        munmap((void*)data, len);
+        return;
+    }
+
+    madvise((void*)data, len, MADV_SEQUENTIAL);
+
+    found      = array_make(vim_qf_entry);
+    row        = 1;
+    line_start = 0;
+    counted    = 0;
+    idx        = 0;
+
+    while ((idx = vim_find_in_bytes(data, len, job->pat, job->pat_len, 0, idx)) >= 0) {
+        for (p = data + counted; (p = memchr(p, '\n', data + idx - p)); p += 1) {
+            row        += 1;
+            line_start  = p - data + 1;
+        }
+        counted = idx;
+
+        end      = memchr(data + idx, '\n', len - idx);
+        text_len = (end ? end - data : len) - line_start;
+
+        e.path = strdup(t->path);
+        e.row  = row;
+        e.idx  = idx - line_start;
+        e.text = strndup(data + line_start, text_len < VIM_GREP_MAX_TEXT ? text_len : VIM_GREP_MAX_TEXT);
+        array_push(found, e);
+
+        /* one entry per line */
+        if (!end) { break; }
+        idx = end - data;
+    }
+
+    munmap((void*)data, len);
+
+    if (array_len(found)) {
+        pthread_mutex_lock(&job->results_lock);
+        array_push_n(job->results, array_data(found), array_len(found));
+        pthread_mutex_unlock(&job->results_lock);
+    }
+    array_free(found);
+}
+
+static void *vim_grep_worker_main(void *arg) {
+    vim_grep_worker *w;
+    vim_grep_job    *job;
+    vim_grep_task    t;
+
+    w   = arg;
+    job = w->job;
+
+    while (!atomic_load(&job->cancel)) {
+        if (!vim_grep_take(w, &t)) {
+            if (atomic_load(&job->pending) == 0) { break; }
+
+            pthread_mutex_lock(&job->idle_lock);
+            while (!atomic_load(&job->cancel)
+            &&     atomic_load(&job->pending) > 0
+            &&     atomic_load(&job->n_queued) == 0) {
+                pthread_cond_wait(&job->idle_cond, &job->idle_lock);
+            }
+            pthread_mutex_unlock(&job->idle_lock);
+            continue;
+        }
+
+        if (t.is_dir) {
+            vim_grep_dir(w, &t);
+        } else {
+            vim_grep_file(w, &t);
+        }
+
+        free(t.path);
+        if (atomic_fetch_sub(&job->pending, 1) == 1) {
+            vim_grep_wake(job, 1);
+        }
+    }
+
+    atomic_fetch_add(&job->n_idle, 1);
+
+    return NULL;
+}
+
+static void vim_qf_entry_free(vim_qf_entry *e) {
+    free(e->path);
+    free(e->text);
+}
+
+static void vim_grep_job_free(vim_grep_job *job) {
+    vim_grep_task  *t;
+    vim_qf_entry   *e;
+    char          **g;
+    int             i;
+
+    atomic_store(&job->cancel, 1);
+    vim_grep_wake(job, 1);
+
+    for (i = 0; i < job->n_workers; i += 1) {
+        if (job->workers[i].threaded) {
+            pthread_join(job->workers[i].thread, NULL);
+        }
+    }
+
+    for (i = 0; i < job->n_workers; i += 1) {
+        array_traverse(job->workers[i].tasks, t) {
+            free(t->path);
+        }
+        array_free(job->workers[i].tasks);
+        pthread_mutex_destroy(&job->workers[i].lock);
+    }
+
+    array_traverse(job->results, e) {
+        vim_qf_entry_free(e);
+    }
+    array_free(job->results);
+    pthread_mutex_destroy(&job->results_lock);
+    pthread_mutex_destroy(&job->idle_lock);
+    pthread_cond_destroy(&job->idle_cond);
+
+    array_traverse(job->globs, g) {
+        free(*g);
+    }
+    array_free(job->globs);
+    free(job->pat);
+    free(job);
+}
+
+static void vim_grep_cancel(void) {
+    if (!grep_job) { return; }
+
+    vim_grep_job_free(grep_job);
+    grep_job = NULL;
+    vim_hold_pumps(0);
+}
+
+static void vim_qf_clear(void) {
+    vim_qf_entry *e;
+
+    array_traverse(qf_entries, e) {
+        vim_qf_entry_free(e);
+    }
+    array_clear(qf_entries);
+    qf_idx = -1;
+}
+
+/* Append entries from..the end of the list to *quickfix. */
+static void vim_qf_buffer_append(yed_buffer *buff, int from) {
+    vim_qf_entry *e;
+    array_t       text;
+    char          loc[64];
+    int           i, n_lines;
+
+    text = array_make(char);
+
+    for (i = from; i < array_len(qf_entries); i += 1) {
+        e = array_item(qf_entries, i);
+        snprintf(loc, sizeof(loc), "|%d col %d| ", e->row, e->idx + 1);
+        array_push_n(text, e->path, strlen(e->path));
+        array_push_n(text, loc, strlen(loc));
+        array_push_n(text, e->text, strlen(e->text));
+        loc[0] = '\n';
+        array_push(text, loc[0]);
+    }
+    array_zero_term(text);
+
+    n_lines = yed_buff_n_lines(buff);
+
+    buff->flags &= ~BUFF_RD_ONLY;
+    yed_buff_insert_string_no_undo(buff, array_data(text), n_lines, 1);
+    buff->flags |= BUFF_RD_ONLY;
+
+    array_free(text);
+}
+
+static void vim_qf_jump(int i) {
+    vim_qf_entry *e;
+    yed_frame    *f;
+    yed_line     *line;
+
+    if (i < 0 || i >= array_len(qf_entries)) { return; }
+
+    qf_idx = i;
+    e      = array_item(qf_entries, i);
+
+    f = ys->active_frame;
+    if (!f || !f->buffer || !f->buffer->path || strcmp(f->buffer->name, e->path) != 0) {
+        vim_open(e->path);
+    }
+
+    if (!(f = ys->active_frame) || !f->buffer) { return; }
+
+    vim_jump_push();
+
+    line = yed_buff_get_line(f->buffer, e->row);
+    yed_set_cursor_far_within_frame(f, e->row,
+                                    line && e->idx < array_len(line->chars) ? yed_line_idx_to_col(line, e->idx) : 1);
+
+    yed_cprint("(%d of %d%s): %s", i + 1, array_len(qf_entries), grep_job ? "+" : "", e->text);
+}
+
+/* Hand the workers' results to the list, on every pump. */
+static void vim_grep_drain(yed_event *event) {
+    yed_buffer         *qf_buff;
+    unsigned long long  us;
+    int                 from, done;
+
+    if (!grep_job) { return; }
+
+    done = atomic_load(&grep_job->n_idle) == grep_job->n_started;
+    from = array_len(qf_entries);
+
+    pthread_mutex_lock(&grep_job->results_lock);
+    if (array_len(grep_job->results)) {
+        array_push_n(qf_entries, array_data(grep_job->results), array_len(grep_job->results));
+        array_clear(grep_job->results);
+    }
+    pthread_mutex_unlock(&grep_job->results_lock);
+
+    if (array_len(qf_entries) > from) {
+        if ((qf_buff = yed_get_buffer("*quickfix"))) {
+            vim_qf_buffer_append(qf_buff, from);
+        }
+        if (qf_idx < 0) {
+            vim_qf_jump(0);
+        }
+    }
+
+    if (done) {
+        us = vim_stats_now_us() - grep_job->start_us;
+        if (array_len(qf_entries)) {
+            yed_cprint("%d matches in %d files (%llu ms)", array_len(qf_entries), atomic_load(&grep_job->n_files), us / 1000);
+        } else {
+            yed_cerr("pattern not found in %d files: %s", atomic_load(&grep_job->n_files), grep_job->pat);
+        }
+        vim_grep_cancel();
+    }
+}
+
+/* Where to start walking for glob: its leading directories without wildcards. */
+static char *vim_grep_root(const char *glob) {
+    const char *wild, *p, *slash;
+
+    wild  = strpbrk(glob, "*?");
+    slash = NULL;
+    for (p = glob; p < wild; p += 1) {
+        if (*p == '/') { slash = p; }
+    }
+
+    if (!slash)        { return strdup("");  }
+    if (slash == glob) { return strdup("/"); }
+
+    return strndup(glob, slash - glob);
+}
+
+/* Is root walked anyway for another glob, one before which in globs if it's the same root? */
+static int vim_grep_root_covered(vim_grep_job *job, int which, const char *root) {
+    char *other;
+    int   i, len, covered;
+
+    covered = 0;
+
+    for (i = 0; !covered && i < array_len(job->globs); i += 1) {
+        if (i == which || !strpbrk(*(char**)array_item(job->globs, i), "*?")) { continue; }
+
+        other = vim_grep_root(*(char**)array_item(job->globs, i));
+        len   = strlen(other);
+
+        if (strcmp(other, root) == 0) {
+            covered = i < which;
+        } else if (len == 0) {
+            covered = root[0] != '/';
+        } else {
+            covered = strncmp(root, other, len) == 0 && (root[len] == '/' || other[len - 1] == '/');
+        }
+
+        free(other);
+    }
+
+    return covered;
+}
+
+void vim_grep_command(int n_args, char **args) {
+    vim_grep_job  *job;
+    array_t        line;
+    struct stat    st;
+    char          *s, *glob, *root, **g;
+    char           delim, sp;
+    int            i, j, n_procs, depth;
+
+    /* the whole argument string: the pattern may contain spaces */
+    line = array_make(char);
+    if (ex_args) {
+        array_push_n(line, ex_args, strlen(ex_args));
+    } else {
+        for (i = 0; i < n_args; i += 1) {
+            if (i) {
+                sp = ' ';
+                array_push(line, sp);
+            }
+            array_push_n(line, args[i], strlen(args[i]));
+        }
+    }
+    array_zero_term(line);
+    s = array_data(line);
+
+    job        = calloc(1, sizeof(*job));
+    job->globs = array_make(char*);
+
+    /* /pattern/ or a word */
+    delim = *s;
+    if (delim && !isalnum((unsigned char)delim) && delim != ' ') {
+        s += 1;
+        for (i = 0; s[i] && s[i] != delim; i += 1);
+        job->pat = strndup(s, i);
+        s += s[i] ? i + 1 : i;
+    } else {
+        for (i = 0; s[i] && s[i] != ' '; i += 1);
+        job->pat = strndup(s, i);
+        s += i;
+    }
+    job->pat_len = strlen(job->pat);
+
+    while (*s) {
+        while (*s == ' ') { s += 1; }
+        for (i = 0; s[i] && s[i] != ' '; i += 1);
+        if (i) {
+            glob = strndup(s, i);
+            array_push(job->globs, glob);
+        }
+        s += i;
+    }
+
+    array_free(line);
+
+    if (job->pat_len == 0 || array_len(job->globs) == 0) {
+        yed_cerr("usage: vimgrep /pattern/ {glob} ...");
+        vim_grep_job_free(job);
+        return;
+    }
+
+    vim_grep_cancel();
+    vim_qf_clear();
+
+    if (yed_get_buffer("*quickfix")) {
+        yed_buff_clear_no_undo(yed_get_buffer("*quickfix"));
+    }
+
+    n_procs = sysconf(_SC_NPROCESSORS_ONLN);
+    job->n_workers = n_procs < 1 ? 1 : n_procs > VIM_GREP_MAX_WORKERS ? VIM_GREP_MAX_WORKERS : n_procs;
+    job->max_depth = 0;
+    job->results   = array_make(vim_qf_entry);
+    job->start_us  = vim_stats_now_us();
+    pthread_mutex_init(&job->results_lock, NULL);
+    pthread_mutex_init(&job->idle_lock, NULL);
+    pthread_cond_init(&job->idle_cond, NULL);
+
+    for (i = 0; i < job->n_workers; i += 1) {
+        job->workers[i].job   = job;
+        job->workers[i].id    = i;
+        job->workers[i].tasks = array_make(vim_grep_task);
+        pthread_mutex_init(&job->workers[i].lock, NULL);
+    }
+
+    array_traverse(job->globs, g) {
+        if (strstr(*g, "**")) {
+            job->max_depth = -1;
+        } else if (job->max_depth >= 0) {
+            for (depth = 1, s = *g; (s = strchr(s, '/')); s += 1, depth += 1);
+            if (depth > job->max_depth) { job->max_depth = depth; }
+        }
+    }
+
+    /* held at 1 until the pool is seeded, so no worker sees it empty and leaves */
+    atomic_store(&job->pending, 1);
+
+    for (i = 0; i < job->n_workers; i += 1) {
+        if (pthread_create(&job->workers[i].thread, NULL, vim_grep_worker_main, &job->workers[i]) == 0) {
+            job->workers[i].threaded  = 1;
+            job->n_started           += 1;
+        }
+    }
+
+    /* one task per glob, spread over the workers */
+    j = 0;
+    array_traverse(job->globs, g) {
+        i = g - (char**)array_data(job->globs);
+
+        if (!strpbrk(*g, "*?")) {
+            if (stat(*g, &st) == 0 && S_ISREG(st.st_mode)) {
+                vim_grep_push(&job->workers[j++ % job->n_workers], strdup(*g), 0, 0);
+            }
+            continue;
+        }
+
+        root = vim_grep_root(*g);
+        if (vim_grep_root_covered(job, i, root)) {
+            free(root);
+            continue;
+        }
+        for (depth = root[0] ? 1 : 0, s = root; (s = strchr(s, '/')); s += 1, depth += 1);
+        vim_grep_push(&job->workers[j++ % job->n_workers], root, 1, depth);
+    }
+
+    if (atomic_fetch_sub(&job->pending, 1) == 1) {
+        vim_grep_wake(job, 1);
+    }
+
+    grep_job = job;
+    vim_hold_pumps(1);
+
+    if (job->n_started == 0) {
+        /* no threads to be had: search right here */
+        job->n_started = 1;
+        vim_grep_worker_main(&job->workers[0]);
+    }
+}
+
+void vim_qf_next(int n_args, char **args) {
+    if (qf_idx + 1 >= array_len(qf_entries)) {
+        yed_cerr(grep_job ? "no more items yet" : "no more items");
+        return;
+    }
+
+    vim_qf_jump(qf_idx + 1);
+}
+
+void vim_qf_prev(int n_args, char **args) {
+    if (qf_idx <= 0) {
+        yed_cerr("no previous item");
+        return;
+    }
+
+    vim_qf_jump(qf_idx - 1);
+}
+
+void vim_qf_goto(int n_args, char **args) {
+    int n;
+
+    if (n_args > 1) {
+        yed_cerr("expected 0 or 1 arguments, but got %d", n_args);
+        return;
+    }
+
+    n = qf_idx + 1;
+    if (n_args && sscanf(args[0], "%d", &n) != 1) {
+        yed_cerr("expected a number, but got '%s'", args[0]);
+        return;
+    }
+
+    if (n < 1 || n > array_len(qf_entries)) {
+        yed_cerr("no item %d", n);
+        return;
+    }
+
+    vim_qf_jump(n - 1);
+}
+
+void vim_qf_open(int n_args, char **args) {
+    yed_buffer *buff;
+
+    buff = yed_get_or_create_special_rdonly_buffer("*quickfix");
+    buff->flags &= ~BUFF_RD_ONLY;
+    yed_buff_clear_no_undo(buff);
+    buff->flags |= BUFF_RD_ONLY;
+    vim_qf_buffer_append(buff, 0);
+
+    YEXE("frame-hsplit");
+    YEXE("buffer", "*quickfix");
+}
+
+static void vim_grep_make(void) {
+    yed_event_handler h;
+
+    qf_entries = array_make(vim_qf_entry);
+
+    h.kind = EVENT_PRE_PUMP;
+    h.fn   = vim_grep_drain;
+    yed_plugin_add_event_handler(Self, h);
+}
+
+static void vim_grep_free(void) {
+    vim_grep_cancel();
+    vim_qf_clear();
+    array_free(qf_entries);
+}
@@ -0,0 +1,392 @@
+/*
+ * Per-buffer indent cache, shift operators and auto-indent for 'o'/'O'.
+ *
+ * For every buffer the cache keeps the width and byte length of each line's
+ * leading whitespace, filled in on demand.  Buffer modification events only
+ * forget the rows they touch; line insertions and deletions shift the
+ * entries after them, or drop the tail of the cache when that would mean
+ * moving a lot of entries (it is refilled lazily as rows are asked for).
+ *
+ * '>>', '<<', '>{motion}', '<{motion}', ':>' and ':<' compute the new indent
+ * of every row from the cache and splice only the part of the indent that
+ * changes, with the whole range in one undo record.  A row whose indent has a
+ * tab in it is re-indented with tabs (and spaces for the remainder) unless
+ * vim-expandtab is set; other rows get spaces.
+ */
+
+typedef struct {
+    int width; /* -1 if unknown */
+    int len;   /* bytes of leading whitespace */
+} vim_indent;
+
+typedef struct {
+    yed_buffer *buffer;
+    array_t     indents; /* vim_indent, row 1 at index 0 */
+} vim_indent_cache;
+
+/* Shifting more cached rows than this on a line insert/delete drops them instead. */
+#define VIM_INDENT_MAX_SHIFT (4096)
+
+static array_t indent_caches; /* vim_indent_cache */
+static array_t indent_scratch;
+static int     shift_pending; /* '>' or '<' waiting for a motion, 0 if none */
+static int     shift_pending_count;
+
+static vim_indent_cache *vim_indent_cache_for(yed_buffer *buff, int create) {
+    vim_indent_cache *c, new_cache;
+
+    array_traverse(indent_caches, c) {
+        if (c->buffer == buff) { return c; }
+    }
+
+    if (!create) { return NULL; }
+
+    new_cache.buffer  = buff;
+    new_cache.indents = array_make(vim_indent);
+    array_push(indent_caches, new_cache);
+
+    return array_last(indent_caches);
+}
+
+static int vim_tab_width(void) {
+    char *s;
+    int   w;
+
+    if ((s = yed_get_var("tab-width")) && (w = atoi(s)) > 0) { return w; }
+    return 4;
+}
+
+static int vim_shift_width(void) {
+    char *s;
+    int   w;
+
+    if ((s = yed_get_var("vim-shiftwidth")) && (w = atoi(s)) > 0) { return w; }
+    return vim_tab_width();
+}
+
+static vim_indent vim_indent_scan(yed_line *line) {
+    vim_indent  ind;
+    char       *data;
+    int         tab_width;
+
+    ind.width = 0;
+    ind.len   = 0;
+    if (!line) { return ind; }
+
+    data      = array_data(line->chars);
+    tab_width = vim_tab_width();
+
+    for (; ind.len < array_len(line->chars); ind.len += 1) {
+        if (data[ind.len] == ' ') {
+            ind.width += 1;
+        } else if (data[ind.len] == '\t') {
+            ind.width += tab_width - (ind.width % tab_width);
+        } else {
+            break;
+        }
+    }
+
+    return ind;
+}
+
+static vim_indent vim_get_indent(yed_buffer *buff, int row) {
+    vim_indent_cache *c;
+    vim_indent       *ind, unknown;
+
+    c = vim_indent_cache_for(buff, 1);
+
+    unknown.width = -1;
+    unknown.len   = 0;
+    while (array_len(c->indents) < row) {
+        array_push(c->indents, unknown);
+    }
+
+    ind = array_item(c->indents, row - 1);
+    if (ind->width < 0) {
+        *ind = vim_indent_scan(yed_buff_get_line(buff, row));
+    }
+
+    return *ind;
+}
+
+static void vim_indent_forget_from(vim_indent_cache *c, int row) {
+    while (array_len(c->indents) >= row) {
+        array_pop(c->indents);
+    }
+}
+
+static void vim_indent_buffer_post_mod(yed_event *event) {
+    vim_indent_cache *c;
+    vim_indent       *ind, unknown;
+    int               row;
+
+    if (event->buffer == NULL || !(c = vim_indent_cache_for(event->buffer, 0))) { return; }
+
+    unknown.width = -1;
+    unknown.len   = 0;
+
+    switch (event->buff_mod_event) {
+        case BUFF_MOD_ADD_LINE:
+            break;
+
+        case BUFF_MOD_INSERT_LINE:
+        case BUFF_MOD_DELETE_LINE:
+            row = event->row;
+            if (row > array_len(c->indents)) { break; }
+
+            if (array_len(c->indents) - row > VIM_INDENT_MAX_SHIFT) {
+                vim_indent_forget_from(c, row);
+            } else if (event->buff_mod_event == BUFF_MOD_INSERT_LINE) {
+                array_insert(c->indents, row - 1, unknown);
+            } else {
+                array_delete(c->indents, row - 1);
+            }
+            break;
+
+        case BUFF_MOD_CLEAR:
+            array_clear(c->indents);
+            break;
+
+        default:
+            if (event->row <= array_len(c->indents)) {
+                ind        = array_item(c->indents, event->row - 1);
+                ind->width = -1;
+            }
+    }
+}
+
+static void vim_indent_buffer_pre_delete(yed_event *event) {
+    vim_indent_cache *c;
+    int               i;
+
+    i = 0;
+    array_traverse(indent_caches, c) {
+        if (c->buffer == event->buffer) {
+            array_free(c->indents);
+            array_delete(indent_caches, i);
+            return;
+        }
+        i += 1;
+    }
+}
+
+/* Build an indent of width columns in indent_scratch, with tabs if use_tabs. */
+static void vim_indent_build(int width, int use_tabs) {
+    int  tab_width;
+    char c;
+
+    array_clear(indent_scratch);
+
+    if (use_tabs) {
+        tab_width = vim_tab_width();
+        c         = '\t';
+        for (; width >= tab_width; width -= tab_width) {
+            array_push(indent_scratch, c);
+        }
+    }
+
+    c = ' ';
+    for (; width > 0; width -= 1) {
+        array_push(indent_scratch, c);
+    }
+}
+
+/* Shift rows r1..r2 by count shift widths; direction is 1 for '>' and -1 for '<'. */
+static void vim_shift_rows(int r1, int r2, int direction, int count) {
+    yed_frame  *f;
+    yed_buffer *buff;
+    yed_line   *line;
+    vim_indent  ind, *cached;
+    char       *data, *new_data;
+    int         row, width, tmp, expandtab, new_len, same;
+
+    f = ys->active_frame;
+    if (!f || !(buff = f->buffer)) { return; }
+
+    if (r1 > r2) { tmp = r1; r1 = r2; r2 = tmp; }
+    if (r1 < 1)  { r1 = 1; }
+    if (r2 > yed_buff_n_lines(buff)) { r2 = yed_buff_n_lines(buff); }
+
+    expandtab = yed_get_var("vim-expandtab") != NULL;
+
+    yed_start_undo_record(f, buff);
+
+    for (row = r1; row <= r2; row += 1) {
+        line = yed_buff_get_line(buff, row);
+        if (!line || array_len(line->chars) == 0) { continue; }
+
+        ind   = vim_get_indent(buff, row);
+        width = ind.width + direction * count * vim_shift_width();
+        if (width < 0) { width = 0; }
+
+        data = array_data(line->chars);
+        vim_indent_build(width, !expandtab && memchr(data, '\t', ind.len) != NULL);
+
+        new_data = array_data(indent_scratch);
+        new_len  = array_len(indent_scratch);
+
+        /* keep what the old and new indents start with; replace the rest */
+        for (same = 0; same < ind.len && same < new_len && data[same] == new_data[same]; same += 1);
+        if (same == ind.len && same == new_len) { continue; }
+
+        vim_buff_delete_bytes(buff, row, same, ind.len);
+        vim_buff_insert_bytes_at_idx(buff, row, same, new_data + same, new_len - same);
+
+        /* we know the answer; don't make the next lookup rescan the row */
+        cached        = array_item(vim_indent_cache_for(buff, 1)->indents, row - 1);
+        cached->width = width;
+        cached->len   = new_len;
+    }
+
+    yed_end_undo_record(f, buff);
+
+    yed_set_cursor_within_frame(f, r1, vim_get_indent(buff, r1).width + 1);
+}
+
+/* '>' or '<' in normal mode: shift the selection if there is one, otherwise wait for a motion. */
+static void vim_shift_start(int key, int count) {
+    yed_buffer *buff;
+    yed_range  *sel;
+
+    if (!ys->active_frame || !(buff = ys->active_frame->buffer)) { return; }
+
+    if (buff->has_selection) {
+        sel = &buff->selection;
+        vim_shift_rows(sel->anchor_row, sel->cursor_row, key == '>' ? 1 : -1, count);
+        YEXE("select-off");
+        return;
+    }
+
+    shift_pending       = key;
+    shift_pending_count = count;
+}
+
+/*
+ * The key after '>' or '<'.  '>>' and '<<' shift count lines; anything else
+ * is taken as a motion and the rows it moved over are shifted.  Returns 1 if
+ * the key was consumed.
+ */
+static int vim_shift_take_key(int key, char *key_str, int count) {
+    yed_frame *f;
+    int        op, start_row;
+
+    if (!shift_pending) { return 0; }
+
+    op            = shift_pending;
+    shift_pending = 0;
+    count        *= shift_pending_count;
+
+    f = ys->active_frame;
+    if (!f || !f->buffer) { return 1; }
+
+    if (key == op) {
+        vim_shift_rows(f->cursor_line, f->cursor_line + count - 1, op == '>' ? 1 : -1, 1);
+        return 1;
+    }
+
+    if (key == ESC || key == CTRL_C) { return 1; }
+
+    start_row = f->cursor_line;
+    nav_count = count;
+    if (!vim_nav_common(key, key_str)) {
+        nav_count = 1;
+        yed_cerr("[NORMAL] '%c' is not a motion", key);
+        return 1;
+    }
+    nav_count = 1;
+
+    /* f/t/F/T still need their target character, '[' and ']' their second key */
+    if (till_pending || section_pending) {
+        shift_pending       = op;
+        shift_pending_count = count;
+        return 1;
+    }
+
+    vim_shift_rows(start_row, f->cursor_line, op == '>' ? 1 : -1, 1);
+
+    return 1;
+}
+
+/* ':>' and ':<' with an optional count of lines */
+static void vim_shift_command(int direction, int n_args, char **args) {
+    yed_frame  *f;
+    yed_buffer *buff;
+    yed_range  *sel;
+    int         n;
+
+    f = ys->active_frame;
+    if (!f || !(buff = f->buffer)) {
+        yed_cerr("no active buffer");
+        return;
+    }
+
+    n = 1;
+    if (n_args > 1) {
+        yed_cerr("expected 0 or 1 arguments, but got %d", n_args);
+        return;
+    }
+    if (n_args == 1 && sscanf(args[0], "%d", &n) != 1) {
+        yed_cerr("expected a line count, but got '%s'", args[0]);
+        return;
+    }
+
+    if (ex_range.given) {
+        vim_shift_rows(ex_range.r1, ex_range.r2, direction, 1);
+    } else if (buff->has_selection) {
+        sel = &buff->selection;
+        vim_shift_rows(sel->anchor_row, sel->cursor_row, direction, 1);
+        YEXE("select-off");
+    } else {
+        vim_shift_rows(f->cursor_line, f->cursor_line + n - 1, direction, 1);
+    }
+}
+
+void vim_shift_right(int n_args, char **args) {
+    vim_shift_command(1, n_args, args);
+}
+
+void vim_shift_left(int n_args, char **args) {
+    vim_shift_command(-1, n_args, args);
+}
+
+/* Copy the indent of row from into row to, which is assumed to be empty.  Returns the new width. */
+static int vim_copy_indent(yed_buffer *buff, int from, int to) {
+    yed_line   *line;
+    vim_indent  ind;
+
+    if (yed_get_var("vim-no-autoindent")) { return 0; }
+
+    line = yed_buff_get_line(buff, from);
+    ind  = vim_get_indent(buff, from);
+
+    if (!line || ind.len == 0) { return 0; }
+
+    vim_buff_append_bytes(buff, to, array_data(line->chars), ind.len);
+
+    return ind.width;
+}
+
+static void vim_indent_make(void) {
+    yed_event_handler h;
+
+    indent_caches  = array_make(vim_indent_cache);
+    indent_scratch = array_make(char);
+
+    h.kind = EVENT_BUFFER_POST_MOD;
+    h.fn   = vim_indent_buffer_post_mod;
+    yed_plugin_add_event_handler(Self, h);
+
+    h.kind = EVENT_BUFFER_PRE_DELETE;
+    h.fn   = vim_indent_buffer_pre_delete;
+    yed_plugin_add_event_handler(Self, h);
+}
+
+static void vim_indent_free(void) {
+    vim_indent_cache *c;
+
+    array_traverse(indent_caches, c) {
+        array_free(c->indents);
+    }
+    array_free(indent_caches);
+    array_free(indent_scratch);
+}
@@ -0,0 +1,134 @@
+/*
+ * 'J', 'gJ' and ':join'.
+ *
+ * The joined line is built once in a buffer sized for all of the source
+ * lines and written over the first row, instead of joining one pair of lines
+ * at a time.  yed has no call that removes a range of lines, so the rest of
+ * the rows are still deleted one by one, all in one undo record.  Each delete
+ * moves every line after it, so joining k lines costs O(k * lines below):
+ * that part of the cost is not removed.
+ */
+
+/*
+ * Join rows r1..r2 into r1.  With spaces set (J), leading whitespace of the
+ * joined lines is dropped and a single space separates the parts, like vim;
+ * otherwise (gJ) the lines are concatenated as they are.
+ */
+static void vim_join_rows(int r1, int r2, int spaces) {
+    yed_frame  *f;
+    yed_buffer *buff;
+    yed_line   *line;
+    array_t     joined;
+    char       *data, sp;
+    int         row, n_lines, cap, start, len, join_idx, tmp;
+
+    f = ys->active_frame;
+    if (!f || !(buff = f->buffer)) { return; }
+
+    if (r1 > r2) { tmp = r1; r1 = r2; r2 = tmp; }
+
+    n_lines = yed_buff_n_lines(buff);
+    if (r2 > n_lines) { r2 = n_lines; }
+    if (r1 < 1 || r1 >= r2) { return; }
+
+    cap = 0;
+    for (row = r1; row <= r2; row += 1) {
+        cap += array_len(yed_buff_get_line(buff, row)->chars) + 1;
+    }
+
+    joined = array_make_with_cap(char, cap);
+
+    sp       = ' ';
+    join_idx = 0;
+    line     = yed_buff_get_line(buff, r1);
+    array_push_n(joined, array_data(line->chars), array_len(line->chars));
+
+    for (row = r1 + 1; row <= r2; row += 1) {
+        line  = yed_buff_get_line(buff, row);
+        data  = array_data(line->chars);
+        len   = array_len(line->chars);
+        start = 0;
+
+        if (spaces) {
+            while (start < len && (data[start] == ' ' || data[start] == '\t')) { start += 1; }
+
+            /* drop trailing whitespace before the join point, then separate with one space */
+            while (array_len(joined) > 0
+            &&     (((char*)array_data(joined))[array_len(joined) - 1] == ' '
+                 || ((char*)array_data(joined))[array_len(joined) - 1] == '\t')) {
+                array_pop(joined);
+            }
+
+            join_idx = array_len(joined);
+
+            if (start < len && array_len(joined) > 0 && data[start] != ')') {
+                array_push(joined, sp);
+            }
+        } else {
+            join_idx = array_len(joined);
+        }
+
+        array_push_n(joined, data + start, len - start);
+    }
+
+    yed_start_undo_record(f, buff);
+
+    vim_buff_set_line_bytes(buff, r1, array_data(joined), array_len(joined));
+    /* bottom up, so the rows left to delete don't move (a line selection delete loops too) */
+    for (row = r2; row > r1; row -= 1) {
+        yed_buff_delete_line(buff, row);
+    }
+
+    yed_end_undo_record(f, buff);
+
+    array_free(joined);
+
+    line = yed_buff_get_line(buff, r1);
+    yed_set_cursor_within_frame(f, r1,
+                                join_idx < array_len(line->chars)
+                                    ? yed_line_idx_to_col(line, join_idx)
+                                    : line->visual_width + 1);
+}
+
+/* 'J' (spaces = 1) and 'gJ': join count lines, at least two, or the selected lines. */
+static void vim_join(int count, int spaces) {
+    yed_frame *f;
+    yed_range *sel;
+
+    f = ys->active_frame;
+    if (!f || !f->buffer) { return; }
+
+    if (f->buffer->has_selection) {
+        sel = &f->buffer->selection;
+        vim_join_rows(sel->anchor_row, sel->cursor_row, spaces);
+        YEXE("select-off");
+        return;
+    }
+
+    if (count < 2) { count = 2; }
+
+    vim_join_rows(f->cursor_line, f->cursor_line + count - 1, spaces);
+}
+
+/* :join [count] */
+void vim_join_command(int n_args, char **args) {
+    int count;
+
+    count = 2;
+    if (n_args > 1) {
+        yed_cerr("expected 0 or 1 arguments, but got %d", n_args);
+        return;
+    }
+    if (n_args == 1 && sscanf(args[0], "%d", &count) != 1) {
+        yed_cerr("expected a line count, but got '%s'", args[0]);
+        return;
+    }
+
+    if (ex_range.given) {
+        /* ':N,Mjoin' joins the range; a single address joins it with the next line */
+        vim_join_rows(ex_range.r1, ex_range.r2 > ex_range.r1 ? ex_range.r2 : ex_range.r1 + 1, 1);
+        return;
+    }
+
+    vim_join(count, 1);
+}
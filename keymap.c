@@ -0,0 +1,259 @@
+/*
+ * The key grammar of normal, delete and yank mode as tables.
+ *
+ * Each mode has a static array indexed by VIM_KEY_SLOT(key) (motions.c), built
+ * by the compiler from the rows below, and vim_key_dispatch() looks a key up
+ * in it instead of going through a switch.  The motions of motions.c come
+ * first in all three modes (vim_nav_common()); the rest are per mode.  A row
+ * runs its fn if it has one, otherwise its yed command count times, after the
+ * steps its flags ask for.  Keys that need more than one key (counts,
+ * registers, marks, 'g', 'z', ...) are taken before the tables are looked at.
+ */
+
+#define VIM_KEY_SELECT_OFF (1 << 0) /* select-off first */
+#define VIM_KEY_REPEAT     (1 << 1) /* the key starts what '.' repeats */
+#define VIM_KEY_JUMP       (1 << 2) /* push a jump first */
+#define VIM_KEY_LINEWISE   (1 << 3) /* vim_act_mode(): enter the mode by line */
+#define VIM_KEY_CANCEL     (1 << 4) /* vim_act_mode(): leave the mode cancelling it */
+
+typedef struct vim_key_action vim_key_action;
+
+typedef void (*vim_key_fn)(int key, int count, const vim_key_action *act);
+
+struct vim_key_action {
+    char       *cmd;
+    vim_key_fn  fn;
+    int         flags;
+    Mode        mode; /* for vim_act_mode() */
+};
+
+static void vim_act_nothing(int key, int count, const vim_key_action *act) { }
+
+static void vim_act_vertical(int key, int count, const vim_key_action *act) {
+    vim_fold_move(key == 'j' || key == ARROW_DOWN ? 1 : -1, count);
+}
+
+static void vim_act_paragraph(int key, int count, const vim_key_action *act) {
+    if (!vim_large_paragraph(key == '}' ? 1 : -1, count)) {
+        while (count-- > 0) {
+            YEXE(act->cmd);
+        }
+    }
+}
+
+static void vim_act_WORD(int key, int count, const vim_key_action *act) {
+    while (count-- > 0) {
+        vim_WORD_motion(key);
+    }
+}
+
+static void vim_act_buffer_end(int key, int count, const vim_key_action *act) {
+    if (!vim_large_goto_row(0)) {
+        YEXE(act->cmd);
+    }
+}
+
+static void vim_act_match_pair(int key, int count, const vim_key_action *act) {
+    vim_match_pair();
+}
+
+static void vim_act_search(int key, int count, const vim_key_action *act) {
+    if (key == '/') {
+        YEXE("vim-search");
+    } else {
+        YEXE("replace-current-search");
+    }
+}
+
+static void vim_act_search_again(int key, int count, const vim_key_action *act) {
+    vim_search_repeat(key == 'n' ? 1 : -1);
+}
+
+static void vim_act_till(int key, int count, const vim_key_action *act) {
+    till_pending = key == 'f' || key == 't' ? 1 : 2 + (key == 'T');
+    last_till_op = key;
+}
+
+static void vim_act_repeat_till(int key, int count, const vim_key_action *act) {
+    vim_repeat_till();
+}
+
+static void vim_act_section(int key, int count, const vim_key_action *act) {
+    section_pending = key;
+    section_count   = count;
+}
+
+/* Run cmd if there is one, then change to mode. */
+static void vim_act_mode(int key, int count, const vim_key_action *act) {
+    if (act->cmd) {
+        YEXE(act->cmd);
+    }
+    vim_change_mode(act->mode, !!(act->flags & VIM_KEY_LINEWISE), !!(act->flags & VIM_KEY_CANCEL));
+}
+
+static void vim_act_change(int key, int count, const vim_key_action *act) {
+    vim_change_mode(MODE_NORMAL, 0, 0);
+    vim_change_mode(MODE_INSERT, 0, 0);
+}
+
+static void vim_act_open_line(int key, int count, const vim_key_action *act) {
+    vim_insert_line(key == 'o' ? 1 : -1);
+    vim_change_mode(MODE_INSERT, 0, 0);
+}
+
+static void vim_act_scroll(int key, int count, const vim_key_action *act) {
+    YEXE(act->cmd, key == CTRL_E ? "1" : "-1");
+}
+
+static void vim_act_search_word(int key, int count, const vim_key_action *act) {
+    vim_search_word_under_cursor(key == '*' ? 1 : -1);
+}
+
+static void vim_act_register(int key, int count, const vim_key_action *act) {
+    register_pending = 1;
+}
+
+static void vim_act_fold(int key, int count, const vim_key_action *act) {
+    vim_fold_start();
+    /* 'z' is a prefix; keep the count for the command after it, like 'g' */
+    count_pending = count > 1 ? count : 0;
+}
+
+static void vim_act_mark(int key, int count, const vim_key_action *act) {
+    vim_mark_start(key);
+}
+
+static void vim_act_jump(int key, int count, const vim_key_action *act) {
+    vim_jump_travel(key == CTRL_O ? -1 : 1, count);
+}
+
+static void vim_act_shift(int key, int count, const vim_key_action *act) {
+    vim_shift_start(key, count);
+}
+
+static void vim_act_tilde(int key, int count, const vim_key_action *act) {
+    vim_case_tilde(count);
+}
+
+static void vim_act_join(int key, int count, const vim_key_action *act) {
+    vim_join(count, 1);
+}
+
+static void vim_act_replace_char(int key, int count, const vim_key_action *act) {
+    vim_replace_start_char(count);
+}
+
+static void vim_act_put(int key, int count, const vim_key_action *act) {
+    vim_reg_put(active_register, key == 'p', count);
+    active_register = 0;
+}
+
+static void vim_act_undo(int key, int count, const vim_key_action *act) {
+    if (!vim_undo_step(key == 'u' ? -1 : 1)) {
+        YEXE(act->cmd);
+    }
+}
+
+static void vim_act_delete_char(int key, int count, const vim_key_action *act) {
+    vim_delete_char_under_cursor();
+}
+
+static void vim_act_repeat(int key, int count, const vim_key_action *act) {
+    vim_repeat();
+}
+
+static void vim_act_command(int key, int count, const vim_key_action *act) {
+    vim_state_load_cmd_history();
+    YEXE(act->cmd);
+}
+
+#define VIM_KEY(k, ...) [VIM_KEY_SLOT(k)] = { __VA_ARGS__ }
+
+#define X(k, c, f, fl) VIM_KEY((k), .cmd = (c), .fn = (f), .flags = (fl)),
+static const vim_key_action vim_motion_keys[VIM_KEY_SLOTS] = {
+    VIM_MOTIONS(X)
+};
+#undef X
+
+static const vim_key_action vim_normal_keys[VIM_KEY_SLOTS] = {
+    VIM_KEY(CTRL_E,  .cmd = "frame-scroll",                                  .fn = vim_act_scroll),
+    VIM_KEY(CTRL_Y,  .cmd = "frame-scroll",                                  .fn = vim_act_scroll),
+    VIM_KEY('*',                                                             .fn = vim_act_search_word),
+    VIM_KEY('#',                                                             .fn = vim_act_search_word),
+    VIM_KEY('d',                                  .mode = MODE_DELETE,       .fn = vim_act_mode,         .flags = VIM_KEY_SELECT_OFF | VIM_KEY_REPEAT),
+    VIM_KEY('D',                                  .mode = MODE_DELETE,       .fn = vim_act_mode,         .flags = VIM_KEY_SELECT_OFF | VIM_KEY_REPEAT | VIM_KEY_LINEWISE),
+    VIM_KEY('y',                                  .mode = MODE_YANK,         .fn = vim_act_mode,         .flags = VIM_KEY_SELECT_OFF),
+    VIM_KEY('Y',                                  .mode = MODE_YANK,         .fn = vim_act_mode,         .flags = VIM_KEY_SELECT_OFF | VIM_KEY_LINEWISE),
+    VIM_KEY('v',     .cmd = "select"),
+    VIM_KEY('V',     .cmd = "select-lines"),
+    VIM_KEY(CTRL_V,                               .mode = MODE_VISUAL_BLOCK, .fn = vim_act_mode,         .flags = VIM_KEY_SELECT_OFF),
+    VIM_KEY('"',                                                             .fn = vim_act_register),
+    VIM_KEY('z',                                                             .fn = vim_act_fold),
+    VIM_KEY('m',                                                             .fn = vim_act_mark),
+    VIM_KEY('\'',                                                            .fn = vim_act_mark),
+    VIM_KEY('`',                                                             .fn = vim_act_mark),
+    VIM_KEY(CTRL_O,                                                          .fn = vim_act_jump),
+    VIM_KEY(TAB,                                                             .fn = vim_act_jump), /* CTRL-I */
+    VIM_KEY('>',                                                             .fn = vim_act_shift),
+    VIM_KEY('<',                                                             .fn = vim_act_shift),
+    VIM_KEY('~',                                                             .fn = vim_act_tilde),
+    VIM_KEY('J',                                                             .fn = vim_act_join),
+    VIM_KEY('r',                                                             .fn = vim_act_replace_char, .flags = VIM_KEY_SELECT_OFF | VIM_KEY_REPEAT),
+    VIM_KEY('R',                                  .mode = MODE_REPLACE,      .fn = vim_act_mode,         .flags = VIM_KEY_SELECT_OFF | VIM_KEY_REPEAT),
+    VIM_KEY('p',                                                             .fn = vim_act_put,          .flags = VIM_KEY_REPEAT),
+    VIM_KEY('P',                                                             .fn = vim_act_put,          .flags = VIM_KEY_REPEAT),
+    VIM_KEY('O',                                                             .fn = vim_act_open_line,    .flags = VIM_KEY_SELECT_OFF),
+    VIM_KEY('o',                                                             .fn = vim_act_open_line,    .flags = VIM_KEY_SELECT_OFF),
+    VIM_KEY('a',     .cmd = "cursor-right",       .mode = MODE_INSERT,       .fn = vim_act_mode,         .flags = VIM_KEY_SELECT_OFF | VIM_KEY_REPEAT),
+    VIM_KEY('A',     .cmd = "cursor-line-end",    .mode = MODE_INSERT,       .fn = vim_act_mode,         .flags = VIM_KEY_SELECT_OFF | VIM_KEY_REPEAT),
+    VIM_KEY('I',     .cmd = "cursor-line-begin",  .mode = MODE_INSERT,       .fn = vim_act_mode,         .flags = VIM_KEY_SELECT_OFF | VIM_KEY_REPEAT),
+    VIM_KEY('i',                                  .mode = MODE_INSERT,       .fn = vim_act_mode,         .flags = VIM_KEY_SELECT_OFF | VIM_KEY_REPEAT),
+    VIM_KEY(DEL_KEY, .cmd = "delete-forward",                                                            .flags = VIM_KEY_SELECT_OFF | VIM_KEY_REPEAT),
+    VIM_KEY('u',     .cmd = "undo",                                          .fn = vim_act_undo),
+    VIM_KEY(CTRL_R,  .cmd = "redo",                                          .fn = vim_act_undo),
+    VIM_KEY('x',                                                             .fn = vim_act_delete_char),
+    VIM_KEY('.',                                                             .fn = vim_act_repeat,       .flags = VIM_KEY_SELECT_OFF),
+    VIM_KEY(':',     .cmd = "vim-command",                                   .fn = vim_act_command),
+    VIM_KEY(ESC,     .cmd = "select-off"),
+    VIM_KEY(CTRL_C,  .cmd = "select-off"),
+    VIM_KEY(CTRL_Z,  .cmd = "suspend"),
+};
+
+static const vim_key_action vim_delete_keys[VIM_KEY_SLOTS] = {
+    VIM_KEY('d',                                  .mode = MODE_NORMAL,       .fn = vim_act_mode),
+    VIM_KEY('c',                                                             .fn = vim_act_change),
+    VIM_KEY(ESC,                                  .mode = MODE_NORMAL,       .fn = vim_act_mode,         .flags = VIM_KEY_CANCEL),
+    VIM_KEY(CTRL_C,                               .mode = MODE_NORMAL,       .fn = vim_act_mode,         .flags = VIM_KEY_CANCEL),
+};
+
+static const vim_key_action vim_yank_keys[VIM_KEY_SLOTS] = {
+    VIM_KEY('y',                                  .mode = MODE_NORMAL,       .fn = vim_act_mode),
+    VIM_KEY(ESC,                                  .mode = MODE_NORMAL,       .fn = vim_act_mode,         .flags = VIM_KEY_CANCEL),
+    VIM_KEY(CTRL_C,                               .mode = MODE_NORMAL,       .fn = vim_act_mode,         .flags = VIM_KEY_CANCEL),
+};
+
+/* Run key's action in table.  Returns 0 if the table has none for it. */
+static int vim_key_dispatch(const vim_key_action *table, int key, int count) {
+    const vim_key_action *act;
+    int                   slot;
+
+    slot = VIM_KEY_SLOT(key);
+    if (slot < 0) { return 0; }
+
+    act = table + slot;
+    if (!act->fn && !act->cmd) { return 0; }
+
+    if (act->flags & VIM_KEY_SELECT_OFF) { YEXE("select-off");  }
+    if (act->flags & VIM_KEY_REPEAT)     { vim_start_repeat(key); }
+    if (act->flags & VIM_KEY_JUMP)       { vim_jump_push();       }
+
+    if (act->fn) {
+        act->fn(key, count, act);
+    } else {
+        while (count-- > 0) {
+            YEXE(act->cmd);
+        }
+    }
+
+    return 1;
+}
@@ -0,0 +1,472 @@
+/*
+ * Large file profile.
+ *
+ * A buffer whose file is bigger than vim-large-file-threshold bytes (64 MiB by
+ * default) when it's loaded gets a lighter profile:
+ *
+ *   - '{' and '}' use an index of its empty lines instead of yed's paragraph
+ *     commands, and a count is one cursor move instead of one per paragraph;
+ *   - 'gg' and 'G' set the cursor directly;
+ *   - insert mode doesn't toggle cursor-line, and 'n' and 'N' don't rewrite
+ *     vim-search-match on every jump;
+ *   - keyword completion indexes it on the first CTRL-N or CTRL-P rather than
+ *     copying the whole buffer for the worker when it's loaded.
+ *
+ * The empty line index covers rows 1..scanned and grows only as far as a
+ * motion needs.  An edit inside it rechecks only the edited row.  Its entries
+ * are kept in blocks of a few hundred, each with a row offset, and the
+ * offsets are the prefix sums of a Fenwick tree over the blocks like the one
+ * marks.c uses: an inserted or deleted line moves the rest of its own block
+ * by one and adds one to the tree, so an edit costs a block plus O(log n)
+ * rather than a walk over every entry after it.  Only splitting or dropping a
+ * block folds the tree into the blocks, which is linear in the blocks and
+ * happens at most once every few hundred entries.
+ */
+
+#include <sys/stat.h>
+
+#define VIM_LARGE_DEFAULT_THRESHOLD (64 * 1024 * 1024)
+#define VIM_LARGE_SCAN_CHUNK        (4096) /* rows scanned at a time looking for a boundary */
+#define VIM_LARGE_BLOCK             (512)  /* entries a block is filled to; it's split at twice that */
+
+typedef struct {
+    array_t rows;  /* int, ascending, less the block's offset */
+    int     shift; /* the part of the block's offset that isn't in the tree */
+} vim_large_block;
+
+typedef struct {
+    yed_buffer *buffer;
+    array_t     blocks;  /* vim_large_block of the empty lines in 1..scanned, none of them empty */
+    array_t     delta;   /* int, Fenwick tree of the blocks' offsets, 1-based (index 0 unused) */
+    int         scanned;
+} vim_large_buffer;
+
+static array_t large_buffers; /* vim_large_buffer */
+
+static int vim_large_threshold(void) {
+    int threshold;
+
+    if (!yed_get_var_as_int("vim-large-file-threshold", &threshold) || threshold <= 0) {
+        threshold = VIM_LARGE_DEFAULT_THRESHOLD;
+    }
+
+    return threshold;
+}
+
+static vim_large_buffer *vim_large_for(yed_buffer *buff) {
+    vim_large_buffer *lb;
+
+    if (!buff) { return NULL; }
+
+    array_traverse(large_buffers, lb) {
+        if (lb->buffer == buff) { return lb; }
+    }
+
+    return NULL;
+}
+
+/* Is the active frame's buffer using the large file profile? */
+static int vim_large_active(void) {
+    return ys->active_frame && vim_large_for(ys->active_frame->buffer);
+}
+
+static vim_large_block *vim_large_block_at(vim_large_buffer *lb, int b) {
+    return array_item(lb->blocks, b);
+}
+
+/* Add d to the offsets of blocks b.. (0-based). */
+static void vim_large_shift_blocks_from(vim_large_buffer *lb, int b, int d) {
+    int n;
+
+    n = array_len(lb->blocks);
+    for (b += 1; b <= n; b += b & -b) {
+        *(int*)array_item(lb->delta, b) += d;
+    }
+}
+
+static int vim_large_offset(vim_large_buffer *lb, int b) {
+    int offset;
+
+    offset = vim_large_block_at(lb, b)->shift;
+    for (b += 1; b > 0; b -= b & -b) {
+        offset += *(int*)array_item(lb->delta, b);
+    }
+
+    return offset;
+}
+
+static int vim_large_row(vim_large_buffer *lb, int b, int j) {
+    return *(int*)array_item(vim_large_block_at(lb, b)->rows, j) + vim_large_offset(lb, b);
+}
+
+/* Move the tree into the blocks' shifts before blocks are added or dropped. */
+static void vim_large_fold(vim_large_buffer *lb) {
+    int b, zero;
+
+    for (b = array_len(lb->blocks) - 1; b >= 0; b -= 1) {
+        vim_large_block_at(lb, b)->shift = vim_large_offset(lb, b);
+    }
+
+    zero = 0;
+    array_clear(lb->delta);
+    for (b = 0; b <= array_len(lb->blocks); b += 1) {
+        array_push(lb->delta, zero);
+    }
+}
+
+/* The first entry >= row as block b, index j.  Returns 0 (with b past the last block) if there isn't one. */
+static int vim_large_find(vim_large_buffer *lb, int row, int *b, int *j) {
+    vim_large_block *blk;
+    int              lo, hi, mid, offset;
+
+    lo = 0;
+    hi = array_len(lb->blocks);
+    while (lo < hi) {
+        mid = lo + (hi - lo) / 2;
+        blk = vim_large_block_at(lb, mid);
+        if (vim_large_row(lb, mid, array_len(blk->rows) - 1) < row) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+
+    *b = lo;
+    *j = 0;
+    if (lo == array_len(lb->blocks)) { return 0; }
+
+    blk    = vim_large_block_at(lb, lo);
+    offset = vim_large_offset(lb, lo);
+    lo     = 0;
+    hi     = array_len(blk->rows);
+    while (lo < hi) {
+        mid = lo + (hi - lo) / 2;
+        if (*(int*)array_item(blk->rows, mid) + offset < row) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    *j = lo;
+
+    return 1;
+}
+
+static int vim_large_is_empty(vim_large_buffer *lb, int row) {
+    int b, j;
+
+    return vim_large_find(lb, row, &b, &j) && vim_large_row(lb, b, j) == row;
+}
+
+/* Add the entry for row, which comes after every entry there is. */
+static void vim_large_append(vim_large_buffer *lb, int row) {
+    vim_large_block  new_blk;
+    vim_large_block *blk;
+    int              n;
+
+    n = array_len(lb->blocks);
+    if (n == 0 || array_len(vim_large_block_at(lb, n - 1)->rows) >= VIM_LARGE_BLOCK) {
+        vim_large_fold(lb);
+        new_blk.rows  = array_make(int);
+        new_blk.shift = 0;
+        array_push(lb->blocks, new_blk);
+        array_push(lb->delta, new_blk.shift); /* 0: the tree is folded */
+        n += 1;
+    }
+
+    blk  = vim_large_block_at(lb, n - 1);
+    row -= vim_large_offset(lb, n - 1);
+    array_push(blk->rows, row);
+}
+
+/* Add the entry for row at block b, index j (from vim_large_find()). */
+static void vim_large_insert(vim_large_buffer *lb, int b, int j, int row) {
+    vim_large_block  new_blk;
+    vim_large_block *blk;
+    int              n, k, zero;
+
+    if (b == array_len(lb->blocks)) {
+        vim_large_append(lb, row);
+        return;
+    }
+
+    blk  = vim_large_block_at(lb, b);
+    row -= vim_large_offset(lb, b);
+    array_insert(blk->rows, j, row);
+
+    n = array_len(blk->rows);
+    if (n < 2 * VIM_LARGE_BLOCK) { return; }
+
+    vim_large_fold(lb);
+    blk           = vim_large_block_at(lb, b);
+    new_blk.rows  = array_make(int);
+    new_blk.shift = blk->shift;
+    for (k = n / 2; k < n; k += 1) {
+        array_push(new_blk.rows, *(int*)array_item(blk->rows, k));
+    }
+    while (array_len(blk->rows) > n / 2) {
+        array_pop(blk->rows);
+    }
+    array_insert(lb->blocks, b + 1, new_blk);
+    zero = 0;
+    array_push(lb->delta, zero);
+}
+
+/* Drop the entry at block b, index j. */
+static void vim_large_remove(vim_large_buffer *lb, int b, int j) {
+    vim_large_block *blk;
+
+    blk = vim_large_block_at(lb, b);
+    array_delete(blk->rows, j);
+    if (array_len(blk->rows) > 0) { return; }
+
+    vim_large_fold(lb);
+    blk = vim_large_block_at(lb, b);
+    array_free(blk->rows);
+    array_delete(lb->blocks, b);
+    array_pop(lb->delta);
+}
+
+/* Move the entries from row down by delta. */
+static void vim_large_shift(vim_large_buffer *lb, int row, int delta) {
+    vim_large_block *blk;
+    int              b, j;
+
+    if (vim_large_find(lb, row, &b, &j)) {
+        blk = vim_large_block_at(lb, b);
+        for (; j < array_len(blk->rows); j += 1) {
+            *(int*)array_item(blk->rows, j) += delta;
+        }
+        vim_large_shift_blocks_from(lb, b + 1, delta);
+    }
+    lb->scanned += delta;
+}
+
+static void vim_large_scan_to(vim_large_buffer *lb, int row) {
+    yed_line *line;
+    int       n_lines;
+
+    n_lines = yed_buff_n_lines(lb->buffer);
+    if (row > n_lines) { row = n_lines; }
+
+    while (lb->scanned < row) {
+        lb->scanned += 1;
+        line = yed_buff_get_line(lb->buffer, lb->scanned);
+        if (line && array_len(line->chars) == 0) {
+            vim_large_append(lb, lb->scanned);
+        }
+    }
+}
+
+/* Forget the whole index. */
+static void vim_large_clear(vim_large_buffer *lb) {
+    vim_large_block *blk;
+    int              zero;
+
+    array_traverse(lb->blocks, blk) {
+        array_free(blk->rows);
+    }
+    array_clear(lb->blocks);
+    array_clear(lb->delta);
+    zero = 0;
+    array_push(lb->delta, zero);
+    lb->scanned = 0;
+}
+
+/* Add or drop row's entry to match the line as it is now. */
+static void vim_large_rescan_row(vim_large_buffer *lb, int row) {
+    yed_line *line;
+    int       b, j, was_empty, is_empty;
+
+    was_empty = vim_large_find(lb, row, &b, &j) && vim_large_row(lb, b, j) == row;
+    line      = yed_buff_get_line(lb->buffer, row);
+    is_empty  = line && array_len(line->chars) == 0;
+
+    if (is_empty && !was_empty) {
+        vim_large_insert(lb, b, j, row);
+    } else if (!is_empty && was_empty) {
+        vim_large_remove(lb, b, j);
+    }
+}
+
+/* The first empty line at or after row, scanning as far as needed, or 0 if there isn't one. */
+static int vim_large_next_empty(vim_large_buffer *lb, int row) {
+    int n_lines, b, j;
+
+    n_lines = yed_buff_n_lines(lb->buffer);
+
+    while (!vim_large_find(lb, row, &b, &j)) {
+        if (lb->scanned >= n_lines) { return 0; }
+        vim_large_scan_to(lb, lb->scanned + VIM_LARGE_SCAN_CHUNK);
+    }
+
+    return vim_large_row(lb, b, j);
+}
+
+/* The last empty line at or before row (which must be scanned), or 0 if there isn't one. */
+static int vim_large_prev_empty(vim_large_buffer *lb, int row) {
+    int b, j;
+
+    vim_large_find(lb, row + 1, &b, &j);
+    if (j > 0)  { return vim_large_row(lb, b, j - 1); }
+    if (b == 0) { return 0; }
+
+    return vim_large_row(lb, b - 1, array_len(vim_large_block_at(lb, b - 1)->rows) - 1);
+}
+
+/* '}' from row: the next empty line that follows a non-empty one, or the last line. */
+static int vim_large_next_paragraph(vim_large_buffer *lb, int row) {
+    int e;
+
+    vim_large_scan_to(lb, row);
+
+    for (e = row; (e = vim_large_next_empty(lb, e + 1)); ) {
+        if (!vim_large_is_empty(lb, e - 1)) { return e; }
+    }
+
+    return yed_buff_n_lines(lb->buffer);
+}
+
+/* '{' from row: the last empty line before it that precedes a non-empty one, or the first line. */
+static int vim_large_prev_paragraph(vim_large_buffer *lb, int row) {
+    int e;
+
+    vim_large_scan_to(lb, row);
+
+    for (e = row; (e = vim_large_prev_empty(lb, e - 1)); ) {
+        if (!vim_large_is_empty(lb, e + 1)) { return e; }
+    }
+
+    return 1;
+}
+
+/* '{' (direction -1) and '}' count times.  Returns 0 if the active buffer isn't large. */
+static int vim_large_paragraph(int direction, int count) {
+    vim_large_buffer *lb;
+    yed_frame        *f;
+    int               row;
+
+    f = ys->active_frame;
+    if (!f || !(lb = vim_large_for(f->buffer))) { return 0; }
+
+    row = f->cursor_line;
+    while (count-- > 0) {
+        row = direction > 0 ? vim_large_next_paragraph(lb, row) : vim_large_prev_paragraph(lb, row);
+    }
+
+    yed_set_cursor_far_within_frame(f, row, 1);
+
+    return 1;
+}
+
+/* 'gg' (row 1) and 'G' (row 0 for the last line).  Returns 0 if the active buffer isn't large. */
+static int vim_large_goto_row(int row) {
+    yed_frame *f;
+
+    f = ys->active_frame;
+    if (!f || !vim_large_for(f->buffer)) { return 0; }
+
+    if (row <= 0) { row = yed_buff_n_lines(f->buffer); }
+
+    yed_set_cursor_far_within_frame(f, row, 1);
+
+    return 1;
+}
+
+static void vim_large_buffer_post_load(yed_event *event) {
+    vim_large_buffer  new_lb;
+    struct stat       st;
+    int               zero;
+
+    if (!event->buffer || !event->buffer->path || vim_large_for(event->buffer)) { return; }
+
+    if (stat(event->buffer->path, &st) < 0 || st.st_size <= vim_large_threshold()) { return; }
+
+    new_lb.buffer  = event->buffer;
+    new_lb.blocks  = array_make(vim_large_block);
+    new_lb.delta   = array_make(int);
+    new_lb.scanned = 0;
+    zero           = 0;
+    array_push(new_lb.delta, zero);
+    array_push(large_buffers, new_lb);
+}
+
+static void vim_large_buffer_post_mod(yed_event *event) {
+    vim_large_buffer *lb;
+    int               row, b, j;
+
+    if (!(lb = vim_large_for(event->buffer))) { return; }
+
+    row = event->row;
+
+    switch (event->buff_mod_event) {
+        case BUFF_MOD_CLEAR:
+            vim_large_clear(lb);
+            break;
+
+        case BUFF_MOD_ADD_LINE:
+        case BUFF_MOD_INSERT_LINE:
+            if (row > lb->scanned) { break; }
+            vim_large_shift(lb, row, 1);
+            vim_large_rescan_row(lb, row);
+            break;
+
+        case BUFF_MOD_DELETE_LINE:
+            if (row > lb->scanned) { break; }
+            if (vim_large_find(lb, row, &b, &j) && vim_large_row(lb, b, j) == row) {
+                vim_large_remove(lb, b, j);
+            }
+            vim_large_shift(lb, row + 1, -1);
+            break;
+
+        default:
+            if (row > lb->scanned) { break; }
+            vim_large_rescan_row(lb, row);
+    }
+}
+
+static void vim_large_buffer_pre_delete(yed_event *event) {
+    vim_large_buffer *lb;
+    int               i;
+
+    for (i = 0; i < array_len(large_buffers); i += 1) {
+        lb = array_item(large_buffers, i);
+        if (lb->buffer == event->buffer) {
+            vim_large_clear(lb);
+            array_free(lb->blocks);
+            array_free(lb->delta);
+            array_delete(large_buffers, i);
+            return;
+        }
+    }
+}
+
+static void vim_large_make(void) {
+    yed_event_handler h;
+
+    large_buffers = array_make(vim_large_buffer);
+
+    /* registered before completion's and the symbol index's, which look at the profile on load */
+    h.kind = EVENT_BUFFER_POST_LOAD;
+    h.fn   = vim_large_buffer_post_load;
+    yed_plugin_add_event_handler(Self, h);
+
+    h.kind = EVENT_BUFFER_POST_MOD;
+    h.fn   = vim_large_buffer_post_mod;
+    yed_plugin_add_event_handler(Self, h);
+
+    h.kind = EVENT_BUFFER_PRE_DELETE;
+    h.fn   = vim_large_buffer_pre_delete;
+    yed_plugin_add_event_handler(Self, h);
+}
+
+static void vim_large_free(void) {
+    vim_large_buffer *lb;
+
+    array_traverse(large_buffers, lb) {
+        vim_large_clear(lb);
+        array_free(lb->blocks);
+        array_free(lb->delta);
+    }
+    array_free(large_buffers);
+}
@@ -0,0 +1,444 @@
+/*
+ * Marks ('m', ''', '`') and the jump list (CTRL-O, CTRL-I).
+ *
+ * Every buffer has one position set holding its marks and the jump list
+ * entries that point into it, kept sorted by row.  The rows aren't rewritten
+ * when lines are inserted or deleted: each set carries a Fenwick tree of row
+ * deltas over its sorted slots, so a line insertion or deletion is a binary
+ * search plus a suffix add -- O(log^2 n) in the number of positions -- and a
+ * 10k line deletion never walks the marks.  Positions on a deleted line are
+ * flagged dead in place, which keeps the slots sorted.  The deltas are folded
+ * back into the rows only when a position is added.
+ *
+ * Columns are not adjusted; they are clamped to the line when jumped to.
+ */
+
+#define VIM_JUMP_LIST_MAX (100)
+
+/* owners of positions that aren't named marks */
+#define VIM_MARK_CONTEXT  ('\'')
+#define VIM_MARK_JUMP     (256) /* + jump id */
+
+typedef struct {
+    int row;   /* without the deltas in the set's tree */
+    int col;
+    int owner; /* 'a'..'z', VIM_MARK_CONTEXT or VIM_MARK_JUMP + id */
+    int dead;
+} vim_pos;
+
+typedef struct {
+    yed_buffer *buffer;
+    array_t     pos;   /* vim_pos, sorted by row */
+    array_t     delta; /* int, Fenwick tree over pos, 1-based (index 0 unused) */
+} vim_pos_set;
+
+typedef struct {
+    yed_buffer *buffer;
+    int         id;
+} vim_jump;
+
+static array_t pos_sets;    /* vim_pos_set */
+static array_t jump_list;   /* vim_jump, oldest first */
+static int     jump_idx;    /* current entry; array_len(jump_list) when not travelling */
+static int     jump_next_id;
+static int     mark_pending; /* 'm', ''' or '`' waiting for a mark name, 0 if none */
+
+static vim_pos_set *vim_pos_set_for(yed_buffer *buff, int create) {
+    vim_pos_set *s, new_set;
+    int          zero;
+
+    array_traverse(pos_sets, s) {
+        if (s->buffer == buff) { return s; }
+    }
+
+    if (!create) { return NULL; }
+
+    zero          = 0;
+    new_set.buffer = buff;
+    new_set.pos    = array_make(vim_pos);
+    new_set.delta  = array_make(int);
+    array_push(new_set.delta, zero);
+    array_push(pos_sets, new_set);
+
+    return array_last(pos_sets);
+}
+
+/* Add d to the rows of slots i.. (0-based). */
+static void vim_pos_shift_from(vim_pos_set *s, int i, int d) {
+    int n;
+
+    n = array_len(s->pos);
+    for (i += 1; i <= n; i += i & -i) {
+        *(int*)array_item(s->delta, i) += d;
+    }
+}
+
+static int vim_pos_row(vim_pos_set *s, int i) {
+    int row;
+
+    row = ((vim_pos*)array_item(s->pos, i))->row;
+    for (i += 1; i > 0; i -= i & -i) {
+        row += *(int*)array_item(s->delta, i);
+    }
+
+    return row;
+}
+
+/* First slot whose current row is >= row. */
+static int vim_pos_lower_bound(vim_pos_set *s, int row) {
+    int lo, hi, mid;
+
+    lo = 0;
+    hi = array_len(s->pos);
+    while (lo < hi) {
+        mid = lo + (hi - lo) / 2;
+        if (vim_pos_row(s, mid) < row) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+
+    return lo;
+}
+
+/* Fold the deltas into the rows and drop dead positions. */
+static void vim_pos_normalize(vim_pos_set *s) {
+    vim_pos *p;
+    int      i, n, zero;
+
+    n = array_len(s->pos);
+    for (i = 0; i < n; i += 1) {
+        p      = array_item(s->pos, i);
+        p->row = vim_pos_row(s, i);
+    }
+    for (i = n - 1; i >= 0; i -= 1) {
+        if (((vim_pos*)array_item(s->pos, i))->dead) {
+            array_delete(s->pos, i);
+        }
+    }
+
+    zero = 0;
+    array_clear(s->delta);
+    for (i = 0; i <= array_len(s->pos); i += 1) {
+        array_push(s->delta, zero);
+    }
+}
+
+static int vim_pos_find(vim_pos_set *s, int owner) {
+    vim_pos *p;
+    int      i;
+
+    i = 0;
+    array_traverse(s->pos, p) {
+        if (p->owner == owner && !p->dead) { return i; }
+        i += 1;
+    }
+
+    return -1;
+}
+
+static void vim_pos_remove(vim_pos_set *s, int owner) {
+    int i;
+
+    if ((i = vim_pos_find(s, owner)) >= 0) {
+        ((vim_pos*)array_item(s->pos, i))->dead = 1;
+    }
+}
+
+static void vim_pos_set_owner(yed_buffer *buff, int owner, int row, int col) {
+    vim_pos_set *s;
+    vim_pos      p;
+    int          i, zero;
+
+    s = vim_pos_set_for(buff, 1);
+
+    vim_pos_remove(s, owner);
+    vim_pos_normalize(s);
+
+    p.row   = row;
+    p.col   = col;
+    p.owner = owner;
+    p.dead  = 0;
+
+    i = vim_pos_lower_bound(s, row + 1);
+    if (i == array_len(s->pos)) {
+        array_push(s->pos, p);
+    } else {
+        array_insert(s->pos, i, p);
+    }
+
+    zero = 0;
+    array_push(s->delta, zero);
+}
+
+/* Current position of owner in buff.  Returns 0 if it isn't set or its line was deleted. */
+static int vim_pos_get(yed_buffer *buff, int owner, int *row, int *col) {
+    vim_pos_set *s;
+    int          i;
+
+    if (!(s = vim_pos_set_for(buff, 0)) || (i = vim_pos_find(s, owner)) < 0) { return 0; }
+
+    *row = vim_pos_row(s, i);
+    *col = ((vim_pos*)array_item(s->pos, i))->col;
+
+    return 1;
+}
+
+static void vim_marks_buffer_post_mod(yed_event *event) {
+    vim_pos_set *s;
+    vim_pos     *p;
+    int          i, end;
+
+    if (event->buffer == NULL || !(s = vim_pos_set_for(event->buffer, 0))) { return; }
+
+    switch (event->buff_mod_event) {
+        case BUFF_MOD_INSERT_LINE:
+            vim_pos_shift_from(s, vim_pos_lower_bound(s, event->row), 1);
+            break;
+
+        case BUFF_MOD_DELETE_LINE:
+            i   = vim_pos_lower_bound(s, event->row);
+            end = vim_pos_lower_bound(s, event->row + 1);
+            for (; i < end; i += 1) {
+                p       = array_item(s->pos, i);
+                p->dead = 1;
+            }
+            vim_pos_shift_from(s, end, -1);
+            break;
+
+        case BUFF_MOD_CLEAR:
+            array_traverse(s->pos, p) {
+                p->dead = 1;
+            }
+            break;
+    }
+}
+
+static void vim_marks_buffer_pre_delete(yed_event *event) {
+    vim_pos_set *s;
+    vim_jump    *j;
+    int          i;
+
+    for (i = array_len(jump_list) - 1; i >= 0; i -= 1) {
+        j = array_item(jump_list, i);
+        if (j->buffer == event->buffer) {
+            array_delete(jump_list, i);
+            if (jump_idx > i) { jump_idx -= 1; }
+        }
+    }
+
+    i = 0;
+    array_traverse(pos_sets, s) {
+        if (s->buffer == event->buffer) {
+            array_free(s->pos);
+            array_free(s->delta);
+            array_delete(pos_sets, i);
+            return;
+        }
+        i += 1;
+    }
+}
+
+static void vim_jump_delete(int i) {
+    vim_jump *j;
+
+    j = array_item(jump_list, i);
+    if (vim_pos_set_for(j->buffer, 0)) {
+        vim_pos_remove(vim_pos_set_for(j->buffer, 0), VIM_MARK_JUMP + j->id);
+    }
+    array_delete(jump_list, i);
+}
+
+/*
+ * Record a jump from row/col of buff.  Like vim, an older entry for the same
+ * line is dropped and the new one goes to the end of the list.  This also
+ * sets the previous context mark used by '' and ``.
+ */
+static void vim_jump_push_pos(yed_buffer *buff, int row, int col) {
+    vim_jump  new_jump, *j;
+    int       i, j_row, j_col;
+
+    if (!buff) { return; }
+
+    vim_pos_set_owner(buff, VIM_MARK_CONTEXT, row, col);
+
+    for (i = array_len(jump_list) - 1; i >= 0; i -= 1) {
+        j = array_item(jump_list, i);
+        if (j->buffer == buff
+        &&  (!vim_pos_get(buff, VIM_MARK_JUMP + j->id, &j_row, &j_col) || j_row == row)) {
+            vim_jump_delete(i);
+        }
+    }
+
+    if (array_len(jump_list) == VIM_JUMP_LIST_MAX) {
+        vim_jump_delete(0);
+    }
+
+    new_jump.buffer = buff;
+    new_jump.id     = jump_next_id++;
+    vim_pos_set_owner(buff, VIM_MARK_JUMP + new_jump.id, row, col);
+    array_push(jump_list, new_jump);
+
+    jump_idx = array_len(jump_list);
+}
+
+/* Record a jump from the cursor. */
+static void vim_jump_push(void) {
+    yed_frame *f;
+
+    f = ys->active_frame;
+    if (!f || !f->buffer) { return; }
+
+    vim_jump_push_pos(f->buffer, f->cursor_line, f->cursor_col);
+}
+
+static void vim_goto_pos(yed_buffer *buff, int row, int col, int exact) {
+    yed_frame *f;
+    yed_line  *line;
+
+    f = ys->active_frame;
+    if (!f) { return; }
+
+    if (f->buffer != buff) {
+        YEXE("buffer", buff->name);
+        if (f->buffer != buff) { return; }
+    }
+
+    if (row > yed_buff_n_lines(buff)) { row = yed_buff_n_lines(buff); }
+    line = yed_buff_get_line(buff, row);
+
+    if (!exact) {
+        col = line ? vim_get_indent(buff, row).width + 1 : 1;
+    } else if (line && col > line->visual_width + 1) {
+        col = line->visual_width + 1;
+    }
+
+    yed_set_cursor_far_within_frame(f, row, col);
+}
+
+/* CTRL-O (direction -1) and CTRL-I (direction 1) */
+static void vim_jump_travel(int direction, int count) {
+    yed_frame *f;
+    vim_jump  *j;
+    int        target, row, col;
+
+    f = ys->active_frame;
+    if (!f || !f->buffer) { return; }
+
+    /* leaving the end of the list: remember where we were so CTRL-I can come back */
+    if (direction < 0 && jump_idx == array_len(jump_list)) {
+        vim_jump_push();
+        jump_idx -= 1;
+    }
+
+    target = jump_idx + direction * count;
+    while (target >= 0 && target < array_len(jump_list)) {
+        j = array_item(jump_list, target);
+        if (vim_pos_get(j->buffer, VIM_MARK_JUMP + j->id, &row, &col)) {
+            jump_idx = target;
+            vim_goto_pos(j->buffer, row, col, 1);
+            return;
+        }
+
+        /* the line went away */
+        vim_jump_delete(target);
+        if (direction < 0) {
+            target  -= 1;
+            jump_idx -= 1;
+        }
+    }
+
+    yed_cerr("at %s of jump list", direction < 0 ? "start" : "end");
+}
+
+/* ''' and '`': go to a mark's line (first non-blank) or exact position. */
+static void vim_mark_goto(int name, int exact) {
+    yed_frame  *f;
+    yed_buffer *buff;
+    int         row, col, from_row, from_col;
+
+    f = ys->active_frame;
+    if (!f || !(buff = f->buffer)) { return; }
+
+    if (name == '`') { name = VIM_MARK_CONTEXT; }
+
+    if (!vim_pos_get(buff, name, &row, &col)) {
+        if (name == VIM_MARK_CONTEXT) {
+            row = 1;
+            col = 1;
+        } else {
+            yed_cerr("mark not set: %c", name);
+            return;
+        }
+    }
+
+    from_row = f->cursor_line;
+    from_col = f->cursor_col;
+
+    vim_goto_pos(buff, row, col, exact);
+    vim_jump_push_pos(buff, from_row, from_col);
+}
+
+/* 'm', ''' or '`' in normal mode */
+static void vim_mark_start(int key) {
+    mark_pending = key;
+}
+
+/* The mark name after 'm', ''' or '`'.  Returns 1 if the key was consumed. */
+static int vim_mark_take_key(int key) {
+    yed_frame *f;
+    int        op;
+
+    if (!mark_pending) { return 0; }
+
+    op           = mark_pending;
+    mark_pending = 0;
+
+    if (key == ESC || key == CTRL_C) { return 1; }
+
+    f = ys->active_frame;
+    if (!f || !f->buffer) { return 1; }
+
+    if (op == 'm') {
+        if (key == '\'' || key == '`') {
+            vim_pos_set_owner(f->buffer, VIM_MARK_CONTEXT, f->cursor_line, f->cursor_col);
+        } else if (key >= 'a' && key <= 'z') {
+            vim_pos_set_owner(f->buffer, key, f->cursor_line, f->cursor_col);
+        } else {
+            yed_cerr("invalid mark name '%c'", key);
+        }
+    } else if ((key >= 'a' && key <= 'z') || key == '\'' || key == '`') {
+        vim_mark_goto(key, op == '`');
+    } else {
+        yed_cerr("invalid mark name '%c'", key);
+    }
+
+    return 1;
+}
+
+static void vim_marks_make(void) {
+    yed_event_handler h;
+
+    pos_sets  = array_make(vim_pos_set);
+    jump_list = array_make(vim_jump);
+
+    h.kind = EVENT_BUFFER_POST_MOD;
+    h.fn   = vim_marks_buffer_post_mod;
+    yed_plugin_add_event_handler(Self, h);
+
+    h.kind = EVENT_BUFFER_PRE_DELETE;
+    h.fn   = vim_marks_buffer_pre_delete;
+    yed_plugin_add_event_handler(Self, h);
+}
+
+static void vim_marks_free(void) {
+    vim_pos_set *s;
+
+    array_traverse(pos_sets, s) {
+        array_free(s->pos);
+        array_free(s->delta);
+    }
+    array_free(pos_sets);
+    array_free(jump_list);
+}
@@ -0,0 +1,146 @@
+/*
+ * The motions, shared by normal, delete and yank mode (keymap.c) and by the
+ * older vim.c plugin (parse.c).  Each X(key, cmd, fn, flags) row is one key:
+ *
+ *   cmd    the yed command that makes the motion, or NULL if there is none;
+ *          vim.c only knows motions that have one
+ *   fn     what keymap.c runs instead, given the key, the count and the row,
+ *          so it can fall back to cmd; NULL to run cmd count times
+ *   flags  VIM_KEY_* flags for keymap.c
+ *
+ * Whoever includes this defines X and expands VIM_MOTIONS(X) into a table
+ * indexed by VIM_KEY_SLOT(key), so a new motion is one row here.  Motions yed
+ * has no command for, like 'W', 'B' and 'E', are written here so that both
+ * plugins can use them.
+ */
+
+/* Plain keys index directly; ARROW_LEFT and the special keys after it follow. */
+#define VIM_KEY_SPECIALS (64)
+#define VIM_KEY_SLOTS    (REAL_KEY_MAX + VIM_KEY_SPECIALS)
+#define VIM_KEY_SLOT(k)                                                 \
+    ((k) >= 0 && (k) < REAL_KEY_MAX                                     \
+        ? (k)                                                           \
+        : (k) >= ARROW_LEFT && (k) < ARROW_LEFT + VIM_KEY_SPECIALS      \
+            ? REAL_KEY_MAX + (k) - ARROW_LEFT                           \
+            : -1)
+
+#define VIM_MOTIONS(X)                                                              \
+    X('h',         "cursor-left",           NULL,                 0)                \
+    X(ARROW_LEFT,  "cursor-left",           NULL,                 0)                \
+    X('l',         "cursor-right",          NULL,                 0)                \
+    X(ARROW_RIGHT, "cursor-right",          NULL,                 0)                \
+    X('j',         "cursor-down",           vim_act_vertical,     0)                \
+    X(ARROW_DOWN,  "cursor-down",           vim_act_vertical,     0)                \
+    X('k',         "cursor-up",             vim_act_vertical,     0)                \
+    X(ARROW_UP,    "cursor-up",             vim_act_vertical,     0)                \
+    X(CTRL_H,      NULL,                    vim_act_nothing,      0)                \
+    X(CTRL_J,      NULL,                    vim_act_nothing,      0)                \
+    X(CTRL_K,      NULL,                    vim_act_nothing,      0)                \
+    X(CTRL_L,      NULL,                    vim_act_nothing,      0)                \
+    X(PAGE_UP,     "cursor-page-up",        NULL,                 0)                \
+    X(PAGE_DOWN,   "cursor-page-down",      NULL,                 0)                \
+    X('w',         "cursor-next-word",      NULL,                 0)                \
+    X('W',         NULL,                    vim_act_WORD,         0)                \
+    X('b',         "cursor-prev-word",      NULL,                 0)                \
+    X('B',         NULL,                    vim_act_WORD,         0)                \
+    X('e',         "cursor-next-word-end",  NULL,                 0)                \
+    X('E',         NULL,                    vim_act_WORD,         0)                \
+    X('^',         "cursor-line-begin",     NULL,                 0)                \
+    X('0',         "cursor-line-begin",     NULL,                 0)                \
+    X(HOME_KEY,    "cursor-line-begin",     NULL,                 0)                \
+    X('$',         "cursor-line-end",       NULL,                 0)                \
+    X(END_KEY,     "cursor-line-end",       NULL,                 0)                \
+    X('{',         "cursor-prev-paragraph", vim_act_paragraph,    0)                \
+    X('}',         "cursor-next-paragraph", vim_act_paragraph,    0)                \
+    X('g',         "cursor-buffer-begin",   NULL,                 VIM_KEY_JUMP)     \
+    X('G',         "cursor-buffer-end",     vim_act_buffer_end,   VIM_KEY_JUMP)     \
+    X('%',         NULL,                    vim_act_match_pair,   0)                \
+    X('/',         NULL,                    vim_act_search,       0)                \
+    X('?',         NULL,                    vim_act_search,       0)                \
+    X('n',         NULL,                    vim_act_search_again, 0)                \
+    X('N',         NULL,                    vim_act_search_again, 0)                \
+    X('f',         NULL,                    vim_act_till,         0)                \
+    X('t',         NULL,                    vim_act_till,         0)                \
+    X('F',         NULL,                    vim_act_till,         0)                \
+    X('T',         NULL,                    vim_act_till,         0)                \
+    X(';',         NULL,                    vim_act_repeat_till,  0)                \
+    X('[',         NULL,                    vim_act_section,      0)                \
+    X(']',         NULL,                    vim_act_section,      0)
+
+/* A WORD is a run of anything but spaces and tabs; the end of a line counts as a blank. */
+static int vim_WORD_blank(yed_line *line, int idx) {
+    char c;
+
+    if (idx >= array_len(line->chars)) { return 1; }
+
+    c = ((char*)array_data(line->chars))[idx];
+    return c == ' ' || c == '\t';
+}
+
+/*
+ * 'W' to the start of the next WORD (an empty line is one too), 'B' to the
+ * start of this or the previous one, 'E' to the end of this or the next one.
+ */
+static void vim_WORD_motion(int key) {
+    yed_frame *f;
+    yed_line  *line;
+    char      *data;
+    int        row, idx, len, n_lines;
+
+    f = ys->active_frame;
+    if (!f || !f->buffer) { return; }
+
+    row  = f->cursor_line;
+    line = yed_buff_get_line(f->buffer, row);
+    if (!line) { return; }
+
+    n_lines = yed_buff_n_lines(f->buffer);
+    len     = array_len(line->chars);
+    idx     = f->cursor_col > line->visual_width ? len : yed_line_col_to_idx(line, f->cursor_col);
+
+    if (key == 'B') {
+        for (;;) {
+            if (idx == 0) {
+                if (row <= 1) { break; }
+                row  -= 1;
+                line  = yed_buff_get_line(f->buffer, row);
+                idx   = array_len(line->chars);
+                if (idx == 0) { break; }
+                continue;
+            }
+            idx -= 1;
+            if (!vim_WORD_blank(line, idx)) { break; }
+        }
+        while (idx > 0 && !vim_WORD_blank(line, idx - 1)) { idx -= 1; }
+    } else {
+        if (key == 'W') {
+            while (!vim_WORD_blank(line, idx)) { idx += 1; }
+        } else if (idx < len) {
+            data = array_data(line->chars);
+            for (idx += 1; idx < len && (data[idx] & 0xC0) == 0x80; idx += 1);
+        }
+
+        for (;;) {
+            while (idx < len && vim_WORD_blank(line, idx)) { idx += 1; }
+            if (idx < len || row >= n_lines) { break; }
+
+            row  += 1;
+            line  = yed_buff_get_line(f->buffer, row);
+            len   = array_len(line->chars);
+            idx   = 0;
+            if (key == 'W' && len == 0) { break; }
+        }
+
+        if (key == 'E') {
+            while (idx + 1 < len && !vim_WORD_blank(line, idx + 1)) { idx += 1; }
+        }
+    }
+
+    /* past the end of the last line, or inside a multibyte glyph: back to a glyph start */
+    len  = array_len(line->chars);
+    data = array_data(line->chars);
+    if (idx >= len) { idx = len > 0 ? len - 1 : 0; }
+    while (idx > 0 && (data[idx] & 0xC0) == 0x80) { idx -= 1; }
+
+    yed_set_cursor_within_frame(f, row, len ? yed_line_idx_to_col(line, idx) : 1);
+}
@@ -0,0 +1,134 @@
+/*
+ * :[range]normal {keys}
+ *
+ * Runs {keys} as normal mode keys with the cursor at the start of each line of
+ * the range (the cursor line if there is no range).  The keys are fed straight
+ * into _vim_take_key() rather than through yed's key bindings, and while they
+ * run, mode changes don't rebind keys or set the vim-mode variables; that is
+ * done once at the end.  Every change made is merged into a single undo record.
+ * An unfinished command or insert is ended as if ESC was typed after each line.
+ */
+
+static int batching; /* keys are being fed by :normal */
+
+/* Drop a command left half typed, as ESC would. */
+static void vim_normal_cancel_pending(void) {
+    count_pending        = 0;
+    till_pending         = 0;
+    section_pending      = 0;
+    g_pending            = 0;
+    case_pending         = 0;
+    case_object_pending  = 0;
+    fold_pending         = 0;
+    fold_create_pending  = 0;
+    shift_pending        = 0;
+    mark_pending         = 0;
+    register_pending     = 0;
+    replace_char_pending = 0;
+}
+
+static void vim_normal_feed(const char *keys) {
+    const unsigned char *k;
+
+    for (k = (const unsigned char*)keys; *k; k += 1) {
+        _vim_take_key(*k, NULL);
+    }
+
+    if (mode != MODE_NORMAL) {
+        _vim_take_key(ESC, NULL);
+        if (mode != MODE_NORMAL) {
+            vim_change_mode(MODE_NORMAL, 0, 1);
+        }
+    }
+
+    vim_normal_cancel_pending();
+}
+
+static void vim_normal_range(const char *keys, int r1, int r2) {
+    yed_frame          *f;
+    yed_buffer         *buff;
+    int                 n_undo, row, n_lines, n_done;
+    unsigned long long  start_ms, ms;
+
+    f = ys->active_frame;
+    if (!f || !(buff = f->buffer)) { return; }
+
+    if (mode != MODE_NORMAL) {
+        vim_change_mode(MODE_NORMAL, 0, 1);
+    }
+
+    start_ms = measure_time_now_ms();
+    n_undo   = yed_get_undo_num_records(buff);
+    n_done   = 0;
+
+    batching = 1;
+
+    for (row = r1; row <= r2 && row <= yed_buff_n_lines(buff); row += 1) {
+        if (ys->active_frame != f || f->buffer != buff) { break; }
+
+        n_lines = yed_buff_n_lines(buff);
+
+        yed_set_cursor_within_frame(f, row, 1);
+        vim_normal_feed(keys);
+        n_done += 1;
+
+        /* keep walking the original lines when the keys add or remove some */
+        row += yed_buff_n_lines(buff) - n_lines;
+        r2  += yed_buff_n_lines(buff) - n_lines;
+    }
+
+    batching = 0;
+
+    vim_change_mode(MODE_NORMAL, 0, 0);
+
+    while (yed_get_undo_num_records(buff) > n_undo + 1) {
+        yed_merge_undo_records(buff);
+    }
+
+    ms = measure_time_now_ms() - start_ms;
+    if (n_done > 1) {
+        yed_cprint("%d lines in %llums (%.0f lines/sec)", n_done, ms, n_done * 1000.0 / (ms ? ms : 1));
+    }
+}
+
+void vim_normal_command(int n_args, char **args) {
+    yed_frame *f;
+    array_t    keys;
+    char       space;
+    int        i, r1, r2;
+
+    f = ys->active_frame;
+    if (!f || !f->buffer) {
+        yed_cerr("no active buffer");
+        return;
+    }
+
+    if (n_args == 0) {
+        yed_cerr("expected keys");
+        return;
+    }
+
+    /* from the ex line, keep the spaces in the keys */
+    keys  = array_make(char);
+    space = ' ';
+    if (ex_args) {
+        array_push_n(keys, ex_args, strlen(ex_args));
+    } else {
+        for (i = 0; i < n_args; i += 1) {
+            if (i) { array_push(keys, space); }
+            array_push_n(keys, args[i], strlen(args[i]));
+        }
+    }
+    array_zero_term(keys);
+
+    if (ex_range.given) {
+        r1 = ex_range.r1;
+        r2 = ex_range.r2;
+    } else {
+        r1 = r2 = f->cursor_line;
+    }
+
+    vim_normal_range(array_data(keys), r1, r2);
+
+    array_free(keys);
+}
@@ -0,0 +1,384 @@
+/*
+ * :e, :vsp and :sp.
+ *
+ * Files up to VIM_OPEN_SYNC_MAX bytes, files that don't exist yet and files
+ * that already have a buffer are opened with yed's buffer command.  Anything
+ * bigger is read on a worker thread: the buffer is created empty and shown
+ * right away, and the worker reads the file in blocks cut at line breaks and
+ * queues them.  Every pump appends what has arrived within a time budget, a
+ * slice of at most VIM_OPEN_SLICE bytes (again cut at a line break) at a
+ * time, so that the budget is checked often.  The first screenful appears as
+ * soon as the first block is read, and the editor stays responsive while the
+ * rest streams in.  vim-open-progress holds "<name> <percent>%" for the
+ * status line until the file is in.
+ *
+ * The buffer is read only while it's loading.  When the last block is in,
+ * EVENT_BUFFER_POST_LOAD is sent for it like for any other loaded file.
+ */
+
+#include <fcntl.h>
+#include <limits.h>
+#include <sys/stat.h>
+
+#define VIM_OPEN_SYNC_MAX     (4 * 1024 * 1024)
+#define VIM_OPEN_FIRST_BLOCK  (64 * 1024)       /* small, so the first screenful comes fast */
+#define VIM_OPEN_BLOCK        (4 * 1024 * 1024)
+#define VIM_OPEN_PUMP_US      (8000)            /* time spent appending per pump */
+#define VIM_OPEN_SLICE        (64 * 1024)       /* appended between checks of the time */
+
+typedef struct {
+    char *data;
+    int   len;
+} vim_open_chunk;
+
+typedef struct {
+    yed_buffer      *buffer;
+    char            *path;
+    int              fd;
+    long long        size;
+    pthread_t        thread;
+    int              threaded;   /* thread is running and needs joining */
+    pthread_mutex_t  lock;
+    array_t          chunks;     /* vim_open_chunk, guarded by lock */
+    vim_open_chunk   cur;        /* block being appended, taken off chunks */
+    int              cur_off;    /* bytes of cur appended so far */
+    atomic_int       done;       /* the worker has queued everything */
+    atomic_int       cancel;
+    int              failed;     /* read error, guarded by lock */
+    long long        appended;   /* bytes appended to the buffer */
+    int              last_percent;
+} vim_open_job;
+
+static array_t open_jobs; /* vim_open_job* */
+
+static void vim_open_queue(vim_open_job *job, char *data, int len) {
+    vim_open_chunk c;
+
+    c.data = data;
+    c.len  = len;
+
+    pthread_mutex_lock(&job->lock);
+    array_push(job->chunks, c);
+    pthread_mutex_unlock(&job->lock);
+}
+
+/*
+ * Read the file and queue it as NUL terminated blocks that end at a line break
+ * (except the last).
+ */
+static void *vim_open_worker(void *arg) {
+    vim_open_job *job;
+    char         *buff, *block;
+    int           cap, len, n, cut;
+
+    job = arg;
+    cap = VIM_OPEN_FIRST_BLOCK;
+    len = 0;
+    buff = malloc(cap + 1);
+
+    while (!atomic_load(&job->cancel)) {
+        n = read(job->fd, buff + len, cap - len);
+        if (n < 0) {
+            pthread_mutex_lock(&job->lock);
+            job->failed = 1;
+            pthread_mutex_unlock(&job->lock);
+            break;
+        }
+        len += n;
+
+        if (n == 0) {
+            if (len > 0) {
+                buff[len] = 0;
+                vim_open_queue(job, buff, len);
+                buff = NULL;
+            }
+            break;
+        }
+
+        if (len < cap) { continue; }
+
+        for (cut = len; cut > 0 && buff[cut - 1] != '\n'; cut -= 1);
+        if (cut == 0) {
+            /* one very long line: keep reading into a bigger block */
+            cap  *= 2;
+            buff  = realloc(buff, cap + 1);
+            continue;
+        }
+
+        block = buff;
+        cap   = VIM_OPEN_BLOCK > cap ? VIM_OPEN_BLOCK : cap;
+        buff  = malloc(cap + 1);
+        memcpy(buff, block + cut, len - cut);
+        len  -= cut;
+        block[cut] = 0;
+        vim_open_queue(job, block, cut);
+    }
+
+    free(buff);
+    close(job->fd);
+    atomic_store(&job->done, 1);
+
+    return NULL;
+}
+
+static void vim_open_free_job(vim_open_job *job) {
+    vim_open_chunk *c;
+
+    atomic_store(&job->cancel, 1);
+    if (job->threaded) {
+        pthread_join(job->thread, NULL);
+    }
+
+    array_traverse(job->chunks, c) {
+        free(c->data);
+    }
+    array_free(job->chunks);
+    free(job->cur.data);
+    pthread_mutex_destroy(&job->lock);
+    free(job->path);
+    free(job);
+}
+
+/*
+ * Append the next slice of the current block to the end of the buffer: up to
+ * VIM_OPEN_SLICE bytes ending at a line break, or one whole line if it's
+ * longer.  The block is freed once it's all in.
+ */
+static void vim_open_append_slice(vim_open_job *job) {
+    yed_buffer *buff;
+    yed_line   *last;
+    char       *s, *end, *cut, save;
+    int         row;
+
+    s   = job->cur.data + job->cur_off;
+    end = job->cur.data + job->cur.len;
+    cut = end;
+
+    if (end - s > VIM_OPEN_SLICE) {
+        for (cut = s + VIM_OPEN_SLICE; cut > s && cut[-1] != '\n'; cut -= 1);
+        if (cut == s) {
+            cut = memchr(s + VIM_OPEN_SLICE, '\n', end - s - VIM_OPEN_SLICE);
+            cut = cut ? cut + 1 : end;
+        }
+    }
+
+    buff = job->buffer;
+    row  = yed_buff_n_lines(buff);
+    last = yed_buff_get_line(buff, row);
+
+    /* the block is NUL terminated, so there's always a byte at cut to borrow */
+    save = *cut;
+    *cut = 0;
+    buff->flags &= ~BUFF_RD_ONLY;
+    yed_buff_insert_string_no_undo(buff, s, row, last->visual_width + 1);
+    buff->flags |= BUFF_RD_ONLY;
+    *cut = save;
+
+    job->appended += cut - s;
+    job->cur_off   = cut - job->cur.data;
+
+    if (cut == end) {
+        free(job->cur.data);
+        job->cur.data = NULL;
+        job->cur_off  = 0;
+    }
+}
+
+static void vim_open_finish(vim_open_job *job) {
+    yed_buffer *buff;
+    yed_line   *last;
+    yed_event   event;
+    int         n_lines;
+
+    buff    = job->buffer;
+    n_lines = yed_buff_n_lines(buff);
+    last    = yed_buff_get_line(buff, n_lines);
+
+    buff->flags &= ~BUFF_RD_ONLY;
+
+    /* a final newline ends the last line rather than starting another */
+    if (n_lines > 1 && last && array_len(last->chars) == 0) {
+        yed_buff_delete_line_no_undo(buff, n_lines);
+    }
+
+    memset(&event, 0, sizeof(event));
+    event.kind   = EVENT_BUFFER_POST_LOAD;
+    event.buffer = buff;
+    yed_trigger_event(&event);
+
+    yed_set_var("vim-open-progress", "");
+
+    if (job->failed) {
+        yed_cerr("error reading '%s'; the buffer is incomplete", job->path);
+    }
+}
+
+static void vim_open_pump(yed_event *event) {
+    vim_open_job       *job;
+    unsigned long long  start;
+    char                progress[256];
+    int                 i, percent, have;
+
+    start = vim_stats_now_us();
+
+    for (i = 0; i < array_len(open_jobs); i += 1) {
+        job = *(vim_open_job**)array_item(open_jobs, i);
+
+        for (;;) {
+            if (!job->cur.data) {
+                pthread_mutex_lock(&job->lock);
+                if (array_len(job->chunks) > 0) {
+                    job->cur = *(vim_open_chunk*)array_item(job->chunks, 0);
+                    array_delete(job->chunks, 0);
+                }
+                pthread_mutex_unlock(&job->lock);
+
+                if (!job->cur.data) { break; }
+            }
+
+            vim_open_append_slice(job);
+
+            if (vim_stats_now_us() - start > VIM_OPEN_PUMP_US) { break; }
+        }
+
+        percent = job->size ? (int)(job->appended * 100 / job->size) : 100;
+        if (percent != job->last_percent) {
+            job->last_percent = percent;
+            snprintf(progress, sizeof(progress), "%s %d%%", job->buffer->name, percent);
+            yed_set_var("vim-open-progress", progress);
+        }
+
+        pthread_mutex_lock(&job->lock);
+        have = job->cur.data || array_len(job->chunks) > 0;
+        pthread_mutex_unlock(&job->lock);
+
+        if (!have && atomic_load(&job->done)) {
+            array_delete(open_jobs, i);
+            vim_open_finish(job);
+            vim_open_free_job(job);
+            vim_hold_pumps(0);
+            i -= 1;
+        }
+    }
+}
+
+static void vim_open_buffer_pre_delete(yed_event *event) {
+    vim_open_job *job;
+    int           i;
+
+    for (i = 0; i < array_len(open_jobs); i += 1) {
+        job = *(vim_open_job**)array_item(open_jobs, i);
+        if (job->buffer == event->buffer) {
+            array_delete(open_jobs, i);
+            vim_open_free_job(job);
+            vim_hold_pumps(0);
+            yed_set_var("vim-open-progress", "");
+            return;
+        }
+    }
+}
+
+/* Show path in the active frame, reading it in the background if it's big. */
+static void vim_open(char *path) {
+    vim_open_job *job;
+    yed_buffer   *buff;
+    struct stat   st;
+    char          full_path[PATH_MAX];
+    int           fd;
+
+    if (!realpath(path, full_path)
+    ||  yed_get_buffer_by_path(full_path)
+    ||  stat(full_path, &st) < 0
+    ||  !S_ISREG(st.st_mode)
+    ||  st.st_size <= VIM_OPEN_SYNC_MAX
+    ||  yed_get_buffer(path)
+    ||  (fd = open(full_path, O_RDONLY)) < 0) {
+        YEXE("buffer", path);
+        return;
+    }
+
+    if (!ys->active_frame) {
+        YEXE("frame-new");
+    }
+
+    buff        = yed_create_buffer(path);
+    buff->kind  = BUFF_KIND_FILE;
+    buff->path  = strdup(full_path);
+    buff->flags |= BUFF_RD_ONLY;
+    yed_frame_set_buff(ys->active_frame, buff);
+
+    job               = calloc(1, sizeof(*job));
+    job->buffer       = buff;
+    job->path         = strdup(full_path);
+    job->fd           = fd;
+    job->size         = st.st_size;
+    job->chunks       = array_make(vim_open_chunk);
+    job->last_percent = -1;
+    pthread_mutex_init(&job->lock, NULL);
+    array_push(open_jobs, job);
+
+    vim_hold_pumps(1);
+
+    if (pthread_create(&job->thread, NULL, vim_open_worker, job) == 0) {
+        job->threaded = 1;
+    } else {
+        vim_open_worker(job);
+    }
+}
+
+static int vim_open_take_path(int n_args, char **args) {
+    if (n_args == 0) {
+        yed_cerr("Expected file path, but got nothing");
+        return 0;
+    }
+    if (n_args > 1) {
+        yed_cerr("expected 1 argument, but got %d", n_args);
+        return 0;
+    }
+
+    return 1;
+}
+
+void vim_edit(int n_args, char **args) {
+    if (!vim_open_take_path(n_args, args)) { return; }
+
+    vim_open(args[0]);
+}
+
+void vim_vsp(int n_args, char **args) {
+    if (!vim_open_take_path(n_args, args)) { return; }
+
+    YEXE("frame-vsplit");
+    vim_open(args[0]);
+}
+
+void vim_sp(int n_args, char **args) {
+    if (!vim_open_take_path(n_args, args)) { return; }
+
+    YEXE("frame-hsplit");
+    vim_open(args[0]);
+}
+
+static void vim_open_make(void) {
+    yed_event_handler h;
+
+    open_jobs = array_make(vim_open_job*);
+
+    h.kind = EVENT_PRE_PUMP;
+    h.fn   = vim_open_pump;
+    yed_plugin_add_event_handler(Self, h);
+
+    h.kind = EVENT_BUFFER_PRE_DELETE;
+    h.fn   = vim_open_buffer_pre_delete;
+    yed_plugin_add_event_handler(Self, h);
+}
+
+static void vim_open_free(void) {
+    vim_open_job **job;
+
+    array_traverse(open_jobs, job) {
+        vim_open_free_job(*job);
+        vim_hold_pumps(0);
+    }
+    array_free(open_jobs);
+}
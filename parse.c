@@ -1,37 +1,36 @@
 #include <stdbool.h>
 
+/* The yed command of each motion in motions.c, by VIM_KEY_SLOT(). */
+#define X(key, cmd, fn, flags) [VIM_KEY_SLOT(key)] = (cmd),
+static char *motion_cmds[VIM_KEY_SLOTS] = {
+    VIM_MOTIONS(X)
+};
+#undef X
+
+/* The motions this grammar takes; the rest of motions.c belongs to bac.vim.c. */
+static const char grammar_motions[] = "hjklwWbBeE";
+
 bool
 is_movement (char c)
 {
-    return c == 'h' || c == 'j' || c == 'k' || c == 'l' ||
-           c == 'w' || c == 'W' ||
-           c == 'b' || c == 'B' ||
-           c == 'e' || c == 'E';
+    return c != 0 && strchr(grammar_motions, c) != NULL;
 }
 
-bool
+void
 movement (int repeat, char c)
 {
     char *cmd;
+    int key;
 
-    switch (c) {
-        case 'h': cmd = "cursor-left";  break;
-        case 'j': cmd = "cursor-down";  break;
-        case 'k': cmd = "cursor-up";    break;
-        case 'l': cmd = "cursor-right"; break;
+    key = (unsigned char) c;
+    cmd = motion_cmds[VIM_KEY_SLOT(key)];
 
-        case 'w': cmd = "cursor-next-word"; break;
-        case 'W': cmd = "cursor-next-word"; break; /* TODO */
-
-        case 'b': cmd = "cursor-prev-word"; break;
-        case 'B': cmd = "cursor-prev-word"; break; /* TODO */
-
-        case 'e': cmd = "cursor-next-word-end"; break;
-        case 'E': cmd = "cursor-next-word-end"; break; /* TODO */
+    for (int i = 0; i < repeat; i++) {
+        if (cmd)
+            YEXE(cmd);
+        else
+            vim_WORD_motion(c);
     }
-
-    for (int i = 0; i < repeat; i++)
-        YEXE(cmd);
 }
 
 void
@@ -0,0 +1,334 @@
+/*
+ * Registers: "" (unnamed), "0-"9, "a-"z (appended to with "A-"Z) and "_.
+ *
+ * The text of a yank or delete is copied out of the buffer exactly once into a
+ * reference counted vim_reg_text.  Every register that receives it -- the
+ * unnamed register, "0 or "1, a named register -- points at that same block,
+ * and shifting "1-"9 on a delete only moves pointers.  Appending to a named
+ * register that shares its text clones it first (copy-on-write).  The black
+ * hole register "_ never holds anything, so deletes into it skip the copy.
+ */
+
+#include <limits.h>
+
+typedef struct {
+    int     refs;
+    int     linewise;
+    int     n_lines;
+    array_t bytes; /* lines joined with '\n', no trailing newline */
+} vim_reg_text;
+
+#define VIM_REG_UNNAMED   (0)
+#define VIM_REG_NUMBERED  (1)
+#define VIM_REG_NAMED     (VIM_REG_NUMBERED + 10)
+#define VIM_N_REGISTERS   (VIM_REG_NAMED + 26)
+
+static vim_reg_text *registers[VIM_N_REGISTERS];
+static int           active_register;  /* register name given with '"', 0 for none */
+static int           register_pending; /* '"' was typed, waiting for the name */
+
+static int vim_reg_index(int name) {
+    if (name == 0 || name == '"')   { return VIM_REG_UNNAMED;                   }
+    if (name >= '0' && name <= '9') { return VIM_REG_NUMBERED + (name - '0');   }
+    if (name >= 'a' && name <= 'z') { return VIM_REG_NAMED + (name - 'a');      }
+    if (name >= 'A' && name <= 'Z') { return VIM_REG_NAMED + (name - 'A');      }
+    return -1;
+}
+
+static int vim_reg_is_valid_name(int name) {
+    return name == '_' || vim_reg_index(name) >= 0;
+}
+
+static vim_reg_text *vim_reg_text_new(int linewise, int cap) {
+    vim_reg_text *text;
+
+    text           = malloc(sizeof(*text));
+    text->refs     = 1;
+    text->linewise = linewise;
+    text->n_lines  = 0;
+    text->bytes    = array_make_with_cap(char, cap > 0 ? cap : 16);
+
+    return text;
+}
+
+static vim_reg_text *vim_reg_text_ref(vim_reg_text *text) {
+    if (text) { text->refs += 1; }
+    return text;
+}
+
+static void vim_reg_text_unref(vim_reg_text *text) {
+    if (text == NULL) { return; }
+
+    text->refs -= 1;
+    if (text->refs == 0) {
+        array_free(text->bytes);
+        free(text);
+    }
+}
+
+static void vim_reg_text_add_lines(vim_reg_text *text, const char *s, int len, int n_lines) {
+    char nl;
+
+    if (text->n_lines > 0) {
+        nl = '\n';
+        array_push(text->bytes, nl);
+    }
+    array_push_n(text->bytes, (char*)s, len);
+    text->n_lines += n_lines;
+}
+
+/* Point register slot idx at text, dropping whatever it held. */
+static void vim_reg_store(int idx, vim_reg_text *text) {
+    vim_reg_text_unref(registers[idx]);
+    registers[idx] = vim_reg_text_ref(text);
+}
+
+/*
+ * Copy a range of buff into a new register text.  For RANGE_LINE every row is
+ * taken whole; otherwise the end column is exclusive.  This is the only copy
+ * a yank or delete makes.
+ */
+static vim_reg_text *vim_reg_text_from_range(yed_buffer *buff, yed_range *range) {
+    vim_reg_text *text;
+    yed_line     *line;
+    int           r1, c1, r2, c2, row, start, end, cap;
+
+    if (range->anchor_row < range->cursor_row
+    ||  (range->anchor_row == range->cursor_row && range->anchor_col <= range->cursor_col)) {
+        r1 = range->anchor_row; c1 = range->anchor_col;
+        r2 = range->cursor_row; c2 = range->cursor_col;
+    } else {
+        r1 = range->cursor_row; c1 = range->cursor_col;
+        r2 = range->anchor_row; c2 = range->anchor_col;
+    }
+
+    cap = 0;
+    for (row = r1; row <= r2; row += 1) {
+        if ((line = yed_buff_get_line(buff, row))) { cap += array_len(line->chars) + 1; }
+    }
+
+    text = vim_reg_text_new(range->kind == RANGE_LINE, cap);
+
+    for (row = r1; row <= r2; row += 1) {
+        line = yed_buff_get_line(buff, row);
+        if (!line) { break; }
+
+        start = 0;
+        end   = array_len(line->chars);
+
+        if (range->kind != RANGE_LINE) {
+            if (row == r1) { start = vim_line_col_to_byte(line, c1); }
+            if (row == r2) { end   = vim_line_col_to_byte(line, c2); }
+            if (end < start) { end = start; }
+        }
+
+        vim_reg_text_add_lines(text, (char*)array_data(line->chars) + start, end - start, 1);
+    }
+
+    return text;
+}
+
+/*
+ * Put text into the register named name (0 for the unnamed register) the way
+ * vim does: yanks also go to "0, deletes shift "1-"9, and the unnamed register
+ * always ends up pointing at the last text written.
+ */
+static void vim_reg_set(int name, vim_reg_text *text, int is_delete) {
+    vim_reg_text *existing, *copy;
+    int           idx, i;
+
+    vim_state_load_registers();
+
+    idx = vim_reg_index(name);
+    if (idx < 0) { return; }
+
+    if (name >= 'A' && name <= 'Z' && (existing = registers[idx])) {
+        if (existing->refs > 1) {
+            copy = vim_reg_text_new(existing->linewise, array_len(existing->bytes) + array_len(text->bytes) + 1);
+            vim_reg_text_add_lines(copy, array_data(existing->bytes), array_len(existing->bytes), existing->n_lines);
+            vim_reg_store(idx, copy);
+            vim_reg_text_unref(copy);
+            existing = copy;
+        }
+
+        /* appending lines to a charwise register makes it linewise, like vim */
+        if (text->linewise) { existing->linewise = 1; }
+        vim_reg_text_add_lines(existing, array_data(text->bytes), array_len(text->bytes), text->n_lines);
+
+        vim_reg_store(VIM_REG_UNNAMED, existing);
+        return;
+    }
+
+    if (idx >= VIM_REG_NAMED) {
+        vim_reg_store(idx, text);
+    } else if (is_delete) {
+        vim_reg_text_unref(registers[VIM_REG_NUMBERED + 9]);
+        for (i = 9; i > 1; i -= 1) {
+            registers[VIM_REG_NUMBERED + i] = registers[VIM_REG_NUMBERED + i - 1];
+        }
+        registers[VIM_REG_NUMBERED + 1] = NULL;
+        vim_reg_store(VIM_REG_NUMBERED + 1, text);
+    } else {
+        vim_reg_store(VIM_REG_NUMBERED, text);
+    }
+
+    vim_reg_store(VIM_REG_UNNAMED, text);
+}
+
+/*
+ * Yank the active buffer's selection into the active register.  Returns 0 if
+ * nothing was copied (no selection, or the black hole register).
+ */
+static int vim_reg_yank_selection(int is_delete) {
+    yed_buffer   *buff;
+    vim_reg_text *text;
+
+    if (active_register == '_') { return 0; }
+
+    if (!ys->active_frame
+    ||  !(buff = ys->active_frame->buffer)
+    ||  !buff->has_selection) {
+        return 0;
+    }
+
+    text = vim_reg_text_from_range(buff, &buff->selection);
+    vim_reg_set(active_register, text, is_delete);
+    vim_reg_text_unref(text);
+
+    return 1;
+}
+
+/*
+ * Repeat text count times into out, the way it should land in the buffer:
+ * one allocation sized up front, copies joined with newlines.
+ */
+static int vim_reg_text_repeat(vim_reg_text *text, int count, array_t *out) {
+    long long  size;
+    char       nl;
+    int        i;
+
+    size = (long long)count * (array_len(text->bytes) + 1);
+    if (size > INT_MAX) {
+        yed_cerr("put of %d copies is too large", count);
+        return 0;
+    }
+
+    *out = array_make_with_cap(char, (int)size);
+    nl   = '\n';
+
+    for (i = 0; i < count; i += 1) {
+        if (i > 0 && text->linewise) {
+            array_push(*out, nl);
+        }
+        array_push_n(*out, array_data(text->bytes), array_len(text->bytes));
+    }
+
+    return 1;
+}
+
+/*
+ * 'p' (after = 1) and 'P' (after = 0).  Linewise text goes on new lines below
+ * or above the cursor; charwise text goes after or at the cursor.  A count
+ * builds the repeated text once and inserts it as one undo record.
+ */
+static void vim_reg_put(int name, int after, int count) {
+    yed_frame    *f;
+    yed_buffer   *buff;
+    vim_reg_text *text;
+    yed_line     *line;
+    array_t       repeated;
+    const char   *s, *nl;
+    int           idx, len, row, col, n_records, i;
+
+    if (name == '_' || count < 1) { return; }
+
+    vim_state_load_registers();
+
+    idx = vim_reg_index(name);
+    if (idx < 0) { return; }
+
+    f = ys->active_frame;
+    if (!f || !(buff = f->buffer)) { return; }
+
+    text = registers[idx];
+    if (text == NULL) {
+        if (name == 0) {
+            /* nothing yanked through the plugin yet; fall back to yed's yank buffer */
+            n_records = yed_get_undo_num_records(buff);
+            for (i = 0; i < count; i += 1) {
+                YEXE("paste-yank-buffer");
+            }
+            while (yed_get_undo_num_records(buff) > n_records + 1) {
+                yed_merge_undo_records(buff);
+            }
+        } else {
+            yed_cerr("register \"%c is empty", name);
+        }
+        return;
+    }
+
+    if (count > 1) {
+        if (!vim_reg_text_repeat(text, count, &repeated)) { return; }
+        s   = array_data(repeated);
+        len = array_len(repeated);
+    } else {
+        s   = array_data(text->bytes);
+        len = array_len(text->bytes);
+    }
+
+    yed_start_undo_record(f, buff);
+
+    if (text->linewise) {
+        row = after ? f->cursor_line + 1 : f->cursor_line;
+        col = 1;
+        while (1) {
+            nl = memchr(s, '\n', len);
+            vim_buff_insert_line_bytes(buff, row, s, nl ? nl - s : len);
+            row += 1;
+            if (nl == NULL) { break; }
+            len -= nl - s + 1;
+            s    = nl + 1;
+        }
+        row = after ? f->cursor_line + 1 : f->cursor_line;
+    } else {
+        row  = f->cursor_line;
+        line = yed_buff_get_line(buff, row);
+        col  = f->cursor_col;
+        if (after && line && line->visual_width > 0) {
+            col += yed_get_glyph_width(*yed_line_col_to_glyph(line, col));
+        }
+        vim_buff_insert_text(buff, row, col, s, len);
+    }
+
+    yed_set_cursor_within_frame(f, row, col);
+
+    yed_end_undo_record(f, buff);
+
+    if (count > 1) {
+        array_free(repeated);
+    }
+}
+
+/* Handle the key after '"'.  Returns 1 if the key was consumed. */
+static int vim_reg_take_name(int key) {
+    if (!register_pending) { return 0; }
+
+    register_pending = 0;
+
+    if (vim_reg_is_valid_name(key)) {
+        active_register = key;
+    } else {
+        yed_cerr("invalid register name '%c'", key);
+    }
+
+    return 1;
+}
+
+static void vim_registers_free(void) {
+    int i;
+
+    for (i = 0; i < VIM_N_REGISTERS; i += 1) {
+        vim_reg_text_unref(registers[i]);
+        registers[i] = NULL;
+    }
+}
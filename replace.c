@@ -0,0 +1,225 @@
+/*
+ * 'r{char}' with a count, and replace mode ('R').
+ *
+ * A counted 'r' builds the new line once and writes it in one undo record.
+ * Replace mode overwrites one glyph per key straight through the buffer's
+ * line primitives instead of dispatching a delete and an insert command, and
+ * remembers each overwritten glyph on a compact per-session stack so that
+ * backspace can put the originals back.  The whole session is merged into a
+ * single undo record when it ends, like insert mode.
+ */
+
+static int     replace_char_pending; /* 'r' waiting for its character */
+static int     replace_char_count;
+static array_t replace_saved;        /* bytes of the overwritten glyphs, back to back */
+static array_t replace_saved_lens;   /* char: byte length of each, 0 if the key appended */
+
+/* 'r{c}': replace count characters from the cursor with c. */
+static void vim_replace_chars(int c, int count) {
+    yed_frame  *f;
+    yed_buffer *buff;
+    yed_line   *line;
+    array_t     new_line;
+    char       *data, ch;
+    int         start, end, len, n;
+
+    f = ys->active_frame;
+    if (!f || !(buff = f->buffer)) { return; }
+
+    line = yed_buff_get_line(buff, f->cursor_line);
+    if (!line) { return; }
+
+    data  = array_data(line->chars);
+    len   = array_len(line->chars);
+    start = vim_line_col_to_byte(line, f->cursor_col);
+
+    /* unlike vim, a count past the end of the line extends it (80r- draws a ruler) */
+    for (end = start, n = 0; end < len && n < count; n += 1) {
+        end += vim_utf8_len((unsigned char)data[end]);
+    }
+
+    new_line = array_make_with_cap(char, start + count + (len - end) + 1);
+    array_push_n(new_line, data, start);
+    ch = c;
+    for (n = 0; n < count; n += 1) {
+        array_push(new_line, ch);
+    }
+    array_push_n(new_line, data + end, len - end);
+
+    yed_start_undo_record(f, buff);
+    vim_buff_set_line_bytes(buff, f->cursor_line, array_data(new_line), array_len(new_line));
+    yed_end_undo_record(f, buff);
+
+    array_free(new_line);
+
+    line = yed_buff_get_line(buff, f->cursor_line);
+    yed_set_cursor_within_frame(f, f->cursor_line, yed_line_idx_to_col(line, start + count - 1));
+}
+
+/* Normal mode 'r'. */
+static void vim_replace_start_char(int count) {
+    replace_char_pending = 1;
+    replace_char_count   = count;
+}
+
+/* The key after 'r'.  Returns 1 if the key was consumed. */
+static int vim_replace_take_char(int key) {
+    if (!replace_char_pending) { return 0; }
+
+    replace_char_pending = 0;
+
+    if (key == ESC || key == CTRL_C) { return 1; }
+
+    if (key < REAL_KEY_MAX && (key == TAB || !iscntrl(key))) {
+        vim_push_repeat_key(key);
+        vim_replace_chars(key, replace_char_count);
+    } else {
+        yed_cerr("[NORMAL] can't replace with key %d", key);
+    }
+
+    return 1;
+}
+
+static void vim_replace_forget(void) {
+    array_clear(replace_saved);
+    array_clear(replace_saved_lens);
+}
+
+/* Overwrite the glyph under the cursor with g, remembering what was there. */
+static void vim_replace_glyph(yed_glyph g) {
+    yed_frame  *f;
+    yed_buffer *buff;
+    yed_line   *line;
+    yed_glyph  *old;
+    char        n;
+
+    f    = ys->active_frame;
+    buff = f->buffer;
+    line = yed_buff_get_line(buff, f->cursor_line);
+
+    if (f->cursor_col > line->visual_width) {
+        n = 0;
+        yed_append_to_line(buff, f->cursor_line, g);
+    } else {
+        old = yed_line_col_to_glyph(line, f->cursor_col);
+        n   = yed_get_glyph_len(*old);
+        array_push_n(replace_saved, old->bytes, n);
+        yed_delete_from_line(buff, f->cursor_line, f->cursor_col);
+        yed_insert_into_line(buff, f->cursor_line, f->cursor_col, g);
+    }
+
+    array_push(replace_saved_lens, n);
+
+    yed_set_cursor_within_frame(f, f->cursor_line, f->cursor_col + yed_get_glyph_width(g));
+}
+
+/* Backspace in replace mode: step back and restore the original glyph. */
+static void vim_replace_backspace(void) {
+    yed_frame  *f;
+    yed_buffer *buff;
+    yed_line   *line;
+    yed_glyph   g;
+    int         n, col;
+
+    f    = ys->active_frame;
+    buff = f->buffer;
+
+    if (array_len(replace_saved_lens) == 0) {
+        YEXE("cursor-left");
+        return;
+    }
+
+    line = yed_buff_get_line(buff, f->cursor_line);
+    if (!line || f->cursor_col <= 1) {
+        vim_replace_forget();
+        return;
+    }
+
+    n = *(char*)array_last(replace_saved_lens);
+    array_pop(replace_saved_lens);
+
+    col = yed_line_idx_to_col(line, yed_line_col_to_idx(line, f->cursor_col - 1));
+
+    yed_delete_from_line(buff, f->cursor_line, col);
+
+    if (n > 0) {
+        g.data = 0;
+        memcpy(g.bytes, (char*)array_data(replace_saved) + array_len(replace_saved) - n, n);
+        while (n-- > 0) { array_pop(replace_saved); }
+        yed_insert_into_line(buff, f->cursor_line, col, g);
+    }
+
+    yed_set_cursor_within_frame(f, f->cursor_line, col);
+}
+
+void vim_replace(int key, char *key_str) {
+    vim_push_repeat_key(key);
+
+    switch (key) {
+        case ARROW_LEFT:  vim_replace_forget(); YEXE("cursor-left");       break;
+        case ARROW_DOWN:  vim_replace_forget(); YEXE("cursor-down");       break;
+        case ARROW_UP:    vim_replace_forget(); YEXE("cursor-up");         break;
+        case ARROW_RIGHT: vim_replace_forget(); YEXE("cursor-right");      break;
+        case HOME_KEY:    vim_replace_forget(); YEXE("cursor-line-begin"); break;
+        case END_KEY:     vim_replace_forget(); YEXE("cursor-line-end");   break;
+
+        case BACKSPACE:
+            vim_replace_backspace();
+            break;
+
+        case ENTER:
+            /* a line break is inserted, not replaced, and can't be backed over */
+            vim_replace_forget();
+            YEXE("insert", key_str);
+            break;
+
+        case ESC:
+        case CTRL_C:
+            vim_change_mode(MODE_NORMAL, 0, 1);
+            break;
+
+        default:
+            if (key == MBYTE) {
+                vim_replace_forget();
+                YEXE("delete-forward");
+                YEXE("insert", key_str);
+            } else if (key == TAB || !iscntrl(key)) {
+                yed_glyph g;
+
+                g.data = 0;
+                g.c    = key;
+                vim_replace_glyph(g);
+            } else {
+                vim_pop_repeat_key();
+                yed_cerr("[REPLACE] unhandled key %d", key);
+            }
+    }
+}
+
+void enter_replace(void) {
+    if (ys->active_frame && ys->active_frame->buffer) {
+        num_undo_records_before_insert = yed_get_undo_num_records(ys->active_frame->buffer);
+    }
+    vim_replace_forget();
+}
+
+void exit_replace(void) {
+    yed_buffer *buff;
+
+    if (ys->active_frame && (buff = ys->active_frame->buffer)) {
+        while (yed_get_undo_num_records(buff) > num_undo_records_before_insert + 1) {
+            yed_merge_undo_records(buff);
+        }
+    }
+    vim_replace_forget();
+}
+
+static void vim_replace_make(void) {
+    replace_saved      = array_make(char);
+    replace_saved_lens = array_make(char);
+}
+
+static void vim_replace_free(void) {
+    array_free(replace_saved);
+    array_free(replace_saved_lens);
+}
@@ -0,0 +1,922 @@
+/*
+ * Match index used by '*', '#', '/', 'n' and 'N'.
+ *
+ * '*' and '#' scan the buffer once and keep every whole-word occurrence of the
+ * word in a sorted array of (row, byte idx) positions.  Buffer modifications
+ * don't throw the index away: edited lines are queued as dirty rows and line
+ * insertions/deletions as row shifts, and both are folded into the index the
+ * next time it is queried.  'n' and 'N' are then binary searches.
+ *
+ * '/' fills the same index incrementally: the visible lines are matched while
+ * typing and the rest of the buffer is scanned on a worker thread (see the
+ * incremental search section below).
+ */
+
+#include <stdatomic.h>
+
+typedef struct {
+    int row;
+    int idx; /* byte index into the line */
+} vim_match;
+
+typedef struct {
+    int kind; /* BUFF_MOD_INSERT_LINE or BUFF_MOD_DELETE_LINE */
+    int row;
+} vim_line_shift;
+
+/* Past this many queued edits a full rescan is cheaper. */
+#define VIM_WORD_INDEX_MAX_SHIFTS (64)
+#define VIM_WORD_INDEX_MAX_DIRTY  (1024)
+
+typedef struct {
+    yed_buffer *buffer;
+    char       *word;
+    int         word_len;
+    int         whole_word;
+    int         direction; /* 1 for '*' and '/', -1 for '#' */
+    int         stale;
+    int         scanning;  /* a worker is still filling in matches */
+    array_t     matches;   /* vim_match, sorted by (row, idx) */
+    array_t     dirty;     /* int rows needing a rescan */
+    array_t     shifts;    /* vim_line_shift, in the order they happened */
+} vim_word_index;
+
+static vim_word_index word_index;
+
+static void vim_search_cancel_worker(void);
+static int vim_search_jump_scanning(int direction);
+
+static int vim_is_word_char(int c) {
+    return c == '_' || isalnum(c) || (c & 0x80);
+}
+
+static int vim_match_cmp(int row_a, int idx_a, int row_b, int idx_b) {
+    if (row_a != row_b) { return row_a < row_b ? -1 : 1; }
+    if (idx_a != idx_b) { return idx_a < idx_b ? -1 : 1; }
+    return 0;
+}
+
+/* Index of the first match at or after (row, idx). */
+static int vim_word_index_lower_bound(int row, int idx) {
+    vim_match *m;
+    int        lo, hi, mid;
+
+    lo = 0;
+    hi = array_len(word_index.matches);
+
+    while (lo < hi) {
+        mid = lo + ((hi - lo) >> 1);
+        m   = array_item(word_index.matches, mid);
+        if (vim_match_cmp(m->row, m->idx, row, idx) < 0) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+
+    return lo;
+}
+
+/*
+ * Byte index of the first occurrence of pat in data at or after start, or -1.
+ * Doesn't touch any yed or plugin state so that the search worker can use it.
+ */
+static int vim_find_in_bytes(const char *data, int len, const char *pat, int pat_len, int whole_word, int start) {
+    const char *p, *end;
+
+    if (pat_len == 0 || len - start < pat_len) { return -1; }
+
+    end = data + len - pat_len;
+
+    for (p = data + start; p <= end; p += 1) {
+        p = memchr(p, pat[0], end - p + 1);
+        if (p == NULL) { break; }
+
+        if (memcmp(p, pat, pat_len) != 0) { continue; }
+
+        if (whole_word) {
+            if (p > data && vim_is_word_char((unsigned char)p[-1]))      { continue; }
+            if (p < end  && vim_is_word_char((unsigned char)p[pat_len])) { continue; }
+        }
+
+        return p - data;
+    }
+
+    return -1;
+}
+
+/* Appends the matches in row to out, in column order. */
+static void vim_word_index_scan_line(yed_buffer *buff, int row, array_t *out) {
+    yed_line  *line;
+    vim_match  m;
+
+    line = yed_buff_get_line(buff, row);
+    if (!line) { return; }
+
+    m.row = row;
+    m.idx = 0;
+    while ((m.idx = vim_find_in_bytes(array_data(line->chars), array_len(line->chars),
+                                      word_index.word, word_index.word_len,
+                                      word_index.whole_word, m.idx)) >= 0) {
+        _array_push(out, &m);
+        m.idx += word_index.word_len;
+    }
+}
+
+static void vim_word_index_rebuild(void) {
+    int row, n_lines;
+
+    array_clear(word_index.matches);
+    array_clear(word_index.dirty);
+    array_clear(word_index.shifts);
+    word_index.stale = 0;
+
+    n_lines = yed_buff_n_lines(word_index.buffer);
+    for (row = 1; row <= n_lines; row += 1) {
+        vim_word_index_scan_line(word_index.buffer, row, &word_index.matches);
+    }
+}
+
+static void vim_word_index_apply_shift(vim_line_shift *shift) {
+    vim_match *m;
+    int        i, first;
+
+    first = vim_word_index_lower_bound(shift->row, 0);
+
+    if (shift->kind == BUFF_MOD_DELETE_LINE) {
+        i = vim_word_index_lower_bound(shift->row + 1, 0);
+        while (i > first) {
+            i -= 1;
+            array_delete(word_index.matches, i);
+        }
+        array_traverse_from(word_index.matches, m, first) { m->row -= 1; }
+    } else {
+        array_traverse_from(word_index.matches, m, first) { m->row += 1; }
+    }
+}
+
+static void vim_word_index_rescan_row(int row) {
+    array_t  found;
+    int      first, last, i;
+
+    if (row < 1 || row > yed_buff_n_lines(word_index.buffer)) { return; }
+
+    first = vim_word_index_lower_bound(row, 0);
+    last  = vim_word_index_lower_bound(row + 1, 0);
+    for (i = last - 1; i >= first; i -= 1) {
+        array_delete(word_index.matches, i);
+    }
+
+    found = array_make(vim_match);
+    vim_word_index_scan_line(word_index.buffer, row, &found);
+    for (i = array_len(found) - 1; i >= 0; i -= 1) {
+        _array_insert(&word_index.matches, first, array_item(found, i));
+    }
+    array_free(found);
+}
+
+/* Bring the index up to date with the buffer. */
+static void vim_word_index_sync(void) {
+    vim_line_shift *shift;
+    int            *d;
+
+    if (word_index.stale) {
+        vim_word_index_rebuild();
+        return;
+    }
+
+    /*
+     * Matches are in the coordinates of the last sync, so replay the shifts
+     * in order.  Dirty rows are kept in current coordinates as events come in.
+     */
+    array_traverse(word_index.shifts, shift) {
+        vim_word_index_apply_shift(shift);
+    }
+    array_traverse(word_index.dirty, d) {
+        vim_word_index_rescan_row(*d);
+    }
+
+    array_clear(word_index.dirty);
+    array_clear(word_index.shifts);
+}
+
+static void vim_word_index_clear(void) {
+    vim_search_cancel_worker();
+    if (word_index.word) {
+        free(word_index.word);
+        word_index.word = NULL;
+    }
+    word_index.buffer = NULL;
+    array_clear(word_index.matches);
+    array_clear(word_index.dirty);
+    array_clear(word_index.shifts);
+    yed_set_var("vim-search-match", "");
+}
+
+static void vim_word_index_update_status(int which) {
+    char buff[64];
+
+    if (vim_large_for(word_index.buffer)) { return; }
+
+    if (array_len(word_index.matches) == 0) {
+        snprintf(buff, sizeof(buff), "no matches");
+    } else {
+        snprintf(buff, sizeof(buff), "match %d of %d%s", which + 1, array_len(word_index.matches),
+                 word_index.scanning ? "+" : "");
+    }
+    yed_set_var("vim-search-match", buff);
+}
+
+/*
+ * Move to the next (direction > 0) or previous match relative to the cursor,
+ * wrapping around the buffer.  Returns 0 if the index doesn't apply to the
+ * active frame.
+ */
+static int vim_word_index_jump(int direction) {
+    yed_frame *f;
+    yed_line  *line;
+    vim_match *m;
+    char      *chars;
+    int        cur_idx, i, n;
+
+    f = ys->active_frame;
+    if (!f || !f->buffer || f->buffer != word_index.buffer) { return 0; }
+
+    vim_word_index_sync();
+
+    n = array_len(word_index.matches);
+    if (n == 0) {
+        vim_word_index_update_status(0);
+        yed_cerr("pattern not found: %s", word_index.word);
+        return 1;
+    }
+
+    line    = yed_buff_get_line(f->buffer, f->cursor_line);
+    cur_idx = line ? yed_line_col_to_idx(line, f->cursor_col) : 0;
+
+    if (direction > 0) {
+        i = vim_word_index_lower_bound(f->cursor_line, cur_idx + 1);
+        if (i == n) { i = 0; }
+    } else {
+        /* from the start of the word under the cursor, so '#' in a word skips it */
+        if (line) {
+            chars = array_data(line->chars);
+            while (cur_idx > 0 && cur_idx < array_len(line->chars)
+            &&     vim_is_word_char((unsigned char)chars[cur_idx])
+            &&     vim_is_word_char((unsigned char)chars[cur_idx - 1])) {
+                cur_idx -= 1;
+            }
+        }
+        i = vim_word_index_lower_bound(f->cursor_line, cur_idx) - 1;
+        if (i < 0) { i = n - 1; }
+    }
+
+    vim_jump_push();
+
+    m    = array_item(word_index.matches, i);
+    line = yed_buff_get_line(f->buffer, m->row);
+    yed_set_cursor_far_within_frame(f, m->row, yed_line_idx_to_col(line, m->idx));
+    vim_word_index_update_status(i);
+
+    return 1;
+}
+
+/* '*' (direction 1) and '#' (direction -1) */
+static void vim_search_word_under_cursor(int direction) {
+    yed_frame *f;
+    char      *word;
+
+    f = ys->active_frame;
+    if (!f || !f->buffer) { return; }
+
+    word = yed_word_under_cursor();
+    if (word == NULL || *word == 0) {
+        yed_cerr("no word under cursor");
+        return;
+    }
+
+    vim_word_index_clear();
+    word_index.buffer    = f->buffer;
+    word_index.word      = word;
+    word_index.word_len   = strlen(word);
+    word_index.whole_word = 1;
+    word_index.direction  = direction;
+    vim_word_index_rebuild();
+
+    vim_word_index_jump(direction);
+}
+
+/* 'n' (direction 1) and 'N' (direction -1) */
+static void vim_search_repeat(int direction) {
+    vim_state_load_search();
+
+    if (vim_search_jump_scanning(direction * word_index.direction)) {
+        return;
+    }
+
+    if (word_index.buffer
+    &&  vim_word_index_jump(direction * word_index.direction)) {
+        return;
+    }
+
+    if (direction > 0) {
+        YEXE("find-next-in-buffer");
+    } else {
+        YEXE("find-prev-in-buffer");
+    }
+}
+
+/*
+ * Incremental search.
+ *
+ * '/' runs the vim-search interactive command.  On every key the pattern is
+ * matched against the frame's visible lines right away, so the cursor and
+ * highlighting follow the typing no matter how big the buffer is.  The rest of
+ * the buffer is handed to a worker thread that posts its matches through a
+ * single-producer/single-consumer ring, which is drained into the index on
+ * every pump; the pumps are held up while the worker runs so that happens
+ * without keys coming in.  A worker that fills the ring sleeps until a drain
+ * makes room.  Each keystroke bumps the search generation, which makes the
+ * current worker bail out; anything it already queued is discarded by
+ * generation when drained.  The index has holes until the scan is done, so
+ * 'n' and 'N' meanwhile look for the next match themselves, reading lines
+ * from the cursor only as far as that match, and leave the worker running.
+ * The match count in vim-search-match ends in '+' until the scan is done.
+ *
+ * The worker reads the buffer's lines directly, so it must not outlive the
+ * state of the buffer it started on: any modification of that buffer or its
+ * deletion cancels and joins it first.
+ */
+
+#define VIM_SEARCH_QUEUE_SIZE (4096) /* power of two */
+
+typedef struct {
+    int generation;
+    int row;        /* 0 means the worker finished */
+    int idx;
+} vim_search_result;
+
+typedef struct {
+    yed_buffer *buffer;
+    char       *pat;
+    int         pat_len;
+    int         generation;
+    int         first_row; /* scans first_row..n_lines, then 1..last_row */
+    int         last_row;
+    int         n_lines;
+} vim_search_job;
+
+static vim_search_result search_queue[VIM_SEARCH_QUEUE_SIZE];
+static atomic_uint       search_queue_head;
+static atomic_uint       search_queue_tail;
+static atomic_int        search_generation;
+static pthread_mutex_t   search_queue_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t    search_queue_room = PTHREAD_COND_INITIALIZER;
+static pthread_t         search_thread;
+static int               search_thread_running;
+static vim_search_job    search_job;
+
+static array_t                    search_head_matches; /* worker matches above the visible lines */
+static int                        search_visible_top;
+static int                        search_origin_row;
+static int                        search_origin_col;
+static int                        search_origin_idx;
+static int                        search_jump_pending;
+static char                      *search_hl_pattern;
+static array_t                    search_history;
+static yed_cmd_line_readline_ptr_t search_readline;
+
+/* Worker side of the queue.  Returns 0 if the job was cancelled while waiting for room. */
+static int vim_search_post(int generation, int row, int idx) {
+    unsigned           tail;
+    vim_search_result *r;
+
+    tail = atomic_load_explicit(&search_queue_tail, memory_order_relaxed);
+
+    if (tail - atomic_load_explicit(&search_queue_head, memory_order_acquire) == VIM_SEARCH_QUEUE_SIZE) {
+        pthread_mutex_lock(&search_queue_lock);
+        while (tail - atomic_load_explicit(&search_queue_head, memory_order_acquire) == VIM_SEARCH_QUEUE_SIZE
+        &&     atomic_load_explicit(&search_generation, memory_order_relaxed) == generation) {
+            pthread_cond_wait(&search_queue_room, &search_queue_lock);
+        }
+        pthread_mutex_unlock(&search_queue_lock);
+
+        if (atomic_load_explicit(&search_generation, memory_order_relaxed) != generation) {
+            return 0;
+        }
+    }
+
+    r             = &search_queue[tail & (VIM_SEARCH_QUEUE_SIZE - 1)];
+    r->generation = generation;
+    r->row        = row;
+    r->idx        = idx;
+
+    atomic_store_explicit(&search_queue_tail, tail + 1, memory_order_release);
+
+    return 1;
+}
+
+static int vim_search_worker_scan_rows(vim_search_job *job, int from, int to) {
+    yed_line *line;
+    int       row, idx;
+
+    for (row = from; row <= to; row += 1) {
+        if (atomic_load_explicit(&search_generation, memory_order_relaxed) != job->generation) {
+            return 0;
+        }
+
+        line = yed_buff_get_line(job->buffer, row);
+        if (!line) { continue; }
+
+        idx = 0;
+        while ((idx = vim_find_in_bytes(array_data(line->chars), array_len(line->chars),
+                                        job->pat, job->pat_len, 0, idx)) >= 0) {
+            if (!vim_search_post(job->generation, row, idx)) { return 0; }
+            idx += job->pat_len;
+        }
+    }
+
+    return 1;
+}
+
+static void *vim_search_worker(void *arg) {
+    vim_search_job *job;
+
+    job = arg;
+
+    /* below the visible lines first: those matches are appended in order */
+    if (vim_search_worker_scan_rows(job, job->first_row, job->n_lines)
+    &&  vim_search_worker_scan_rows(job, 1, job->last_row)) {
+        vim_search_post(job->generation, 0, 0);
+    }
+
+    return NULL;
+}
+
+/* Wake a worker waiting for room, after a drain or a cancel. */
+static void vim_search_wake_worker(void) {
+    pthread_mutex_lock(&search_queue_lock);
+    pthread_cond_signal(&search_queue_room);
+    pthread_mutex_unlock(&search_queue_lock);
+}
+
+static void vim_search_join_worker(void) {
+    if (search_thread_running) {
+        pthread_join(search_thread, NULL);
+        search_thread_running = 0;
+        vim_hold_pumps(0);
+    }
+}
+
+static void vim_search_cancel_worker(void) {
+    atomic_fetch_add(&search_generation, 1);
+    vim_search_wake_worker();
+    vim_search_join_worker();
+
+    if (search_job.pat) {
+        free(search_job.pat);
+        search_job.pat = NULL;
+    }
+
+    atomic_store(&search_queue_head, atomic_load(&search_queue_tail));
+    array_clear(search_head_matches);
+    word_index.scanning = 0;
+}
+
+static void vim_search_finish_scan(void) {
+    array_t merged;
+
+    if (array_len(search_head_matches)) {
+        merged = array_make_with_cap(vim_match, array_len(search_head_matches) + array_len(word_index.matches));
+        array_push_n(merged, array_data(search_head_matches), array_len(search_head_matches));
+        array_push_n(merged, array_data(word_index.matches), array_len(word_index.matches));
+        array_free(word_index.matches);
+        word_index.matches = merged;
+        array_clear(search_head_matches);
+    }
+
+    word_index.scanning = 0;
+
+    vim_search_join_worker();
+    free(search_job.pat);
+    search_job.pat = NULL;
+}
+
+static void vim_search_jump_from_origin(void) {
+    yed_frame *f;
+
+    f = ys->active_frame;
+    if (!f || f->buffer != word_index.buffer) { return; }
+
+    yed_set_cursor_within_frame(f, search_origin_row, search_origin_col);
+    if (array_len(word_index.matches)) {
+        vim_word_index_jump(1);
+        search_jump_pending = 0;
+    }
+}
+
+/* Drop the '+' from the match count once the scan is complete. */
+static void vim_search_refresh_status(void) {
+    yed_frame *f;
+    yed_line  *line;
+    vim_match *m;
+    int        idx, i;
+
+    f = ys->active_frame;
+    if (!f || f->buffer != word_index.buffer) { return; }
+
+    line = yed_buff_get_line(f->buffer, f->cursor_line);
+    idx  = line ? yed_line_col_to_idx(line, f->cursor_col) : 0;
+    i    = vim_word_index_lower_bound(f->cursor_line, idx);
+
+    if (i < array_len(word_index.matches)) {
+        m = array_item(word_index.matches, i);
+        if (m->row == f->cursor_line && m->idx == idx) {
+            vim_word_index_update_status(i);
+        }
+    }
+}
+
+/* Consumer side of the queue, run on every pump. */
+static void vim_search_drain(yed_event *event) {
+    unsigned           head, tail;
+    vim_search_result *r;
+    vim_match          m;
+    int                generation, done;
+
+    head = atomic_load_explicit(&search_queue_head, memory_order_relaxed);
+    tail = atomic_load_explicit(&search_queue_tail, memory_order_acquire);
+
+    if (head == tail) { return; }
+
+    generation = atomic_load_explicit(&search_generation, memory_order_relaxed);
+    done       = 0;
+
+    for (; head != tail; head += 1) {
+        r = &search_queue[head & (VIM_SEARCH_QUEUE_SIZE - 1)];
+
+        if (r->generation != generation || !word_index.scanning) { continue; }
+
+        if (r->row == 0) {
+            done = 1;
+            continue;
+        }
+
+        m.row = r->row;
+        m.idx = r->idx;
+        if (m.row < search_visible_top) {
+            array_push(search_head_matches, m);
+        } else {
+            array_push(word_index.matches, m);
+        }
+    }
+
+    atomic_store_explicit(&search_queue_head, head, memory_order_release);
+    vim_search_wake_worker();
+
+    if (done) {
+        vim_search_finish_scan();
+        if (!search_jump_pending) {
+            vim_search_refresh_status();
+        }
+    }
+
+    if (search_jump_pending) {
+        if (array_len(word_index.matches)) {
+            vim_search_jump_from_origin();
+        } else if (done) {
+            search_jump_pending = 0;
+            yed_cerr("pattern not found: %s", word_index.word);
+        }
+    }
+}
+
+/*
+ * 'n' and 'N' while the worker is scanning: find the next match from the
+ * cursor line by line, stopping at the first one, rather than trusting an
+ * index with holes or waiting for the whole scan.  Returns 0 if no scan is
+ * running for the active buffer.
+ */
+static int vim_search_jump_scanning(int direction) {
+    yed_frame *f;
+    yed_line  *line;
+    vim_match *m, hit;
+    array_t    found;
+    int        n_lines, row, cur_idx, steps, k, i;
+
+    f = ys->active_frame;
+    if (!word_index.scanning || !f || f->buffer != word_index.buffer) { return 0; }
+
+    /* a jump still waiting for the first match is overtaken by this one */
+    search_jump_pending = 0;
+
+    line    = yed_buff_get_line(f->buffer, f->cursor_line);
+    cur_idx = line ? yed_line_col_to_idx(line, f->cursor_col) : 0;
+    n_lines = yed_buff_n_lines(f->buffer);
+    found   = array_make(vim_match);
+    hit.row = 0;
+
+    /* the cursor's line comes around again last, where any match counts */
+    row = f->cursor_line;
+    for (steps = 0; steps <= n_lines && hit.row == 0; steps += 1) {
+        array_clear(found);
+        vim_word_index_scan_line(f->buffer, row, &found);
+
+        for (k = 0; k < array_len(found); k += 1) {
+            m = array_item(found, direction > 0 ? k : array_len(found) - 1 - k);
+            if (steps > 0 || (direction > 0 ? m->idx > cur_idx : m->idx < cur_idx)) {
+                hit = *m;
+                break;
+            }
+        }
+
+        row += direction > 0 ? 1 : -1;
+        if (row > n_lines) { row = 1;       }
+        if (row < 1)       { row = n_lines; }
+    }
+
+    array_free(found);
+
+    if (hit.row == 0) {
+        yed_cerr("pattern not found: %s", word_index.word);
+        return 1;
+    }
+
+    vim_jump_push();
+
+    line = yed_buff_get_line(f->buffer, hit.row);
+    yed_set_cursor_far_within_frame(f, hit.row, yed_line_idx_to_col(line, hit.idx));
+
+    /* the count is filled in by vim_search_refresh_status() once the scan is done */
+    i = vim_word_index_lower_bound(hit.row, hit.idx);
+    m = i < array_len(word_index.matches) ? array_item(word_index.matches, i) : NULL;
+    if (m && m->row == hit.row && m->idx == hit.idx) {
+        vim_word_index_update_status(i);
+    } else {
+        yed_set_var("vim-search-match", "");
+    }
+
+    return 1;
+}
+
+static void vim_search_origin_from_cursor(void) {
+    yed_frame *f;
+    yed_line  *line;
+
+    f = ys->active_frame;
+    if (!f || !f->buffer) { return; }
+
+    search_origin_row = f->cursor_line;
+    search_origin_col = f->cursor_col;
+    line              = yed_buff_get_line(f->buffer, f->cursor_line);
+    search_origin_idx = line ? yed_line_col_to_idx(line, f->cursor_col) : 0;
+}
+
+static void vim_search_set_highlight(const char *pat) {
+    if (ys->current_search == search_hl_pattern) {
+        ys->current_search = NULL;
+    }
+    if (search_hl_pattern) {
+        free(search_hl_pattern);
+        search_hl_pattern = NULL;
+    }
+    if (pat && *pat) {
+        search_hl_pattern  = strdup(pat);
+        ys->current_search = search_hl_pattern;
+    }
+}
+
+/* Match the visible lines now and queue everything else for the worker. */
+static void vim_search_update(const char *pat) {
+    yed_frame *f;
+    vim_match *m;
+    int        top, bottom, n_lines, row;
+
+    f = ys->active_frame;
+    if (!f || !f->buffer) { return; }
+
+    vim_word_index_clear();
+    vim_search_set_highlight(pat);
+    search_jump_pending = 0;
+
+    if (*pat == 0) {
+        yed_set_cursor_within_frame(f, search_origin_row, search_origin_col);
+        return;
+    }
+
+    word_index.buffer     = f->buffer;
+    word_index.word       = strdup(pat);
+    word_index.word_len   = strlen(pat);
+    word_index.whole_word = 0;
+    word_index.direction  = 1;
+
+    n_lines = yed_buff_n_lines(f->buffer);
+    top     = f->buffer_y_offset + 1;
+    bottom  = f->buffer_y_offset + f->height;
+    if (bottom > n_lines) { bottom = n_lines; }
+
+    for (row = top; row <= bottom; row += 1) {
+        vim_word_index_scan_line(f->buffer, row, &word_index.matches);
+    }
+
+    /* incsearch: follow the first visible match after where the search started */
+    yed_set_cursor_within_frame(f, search_origin_row, search_origin_col);
+    array_traverse(word_index.matches, m) {
+        if (vim_match_cmp(m->row, m->idx, search_origin_row, search_origin_idx) > 0) {
+            yed_set_cursor_within_frame(f, m->row,
+                                        yed_line_idx_to_col(yed_buff_get_line(f->buffer, m->row), m->idx));
+            break;
+        }
+    }
+
+    if (top == 1 && bottom == n_lines) { return; }
+
+    search_visible_top    = top;
+    search_job.buffer     = f->buffer;
+    search_job.pat        = strdup(pat);
+    search_job.pat_len    = word_index.word_len;
+    search_job.generation = atomic_load(&search_generation);
+    search_job.first_row  = bottom + 1;
+    search_job.last_row   = top - 1;
+    search_job.n_lines    = n_lines;
+
+    word_index.scanning = 1;
+    if (pthread_create(&search_thread, NULL, vim_search_worker, &search_job) == 0) {
+        search_thread_running = 1;
+        vim_hold_pumps(1);
+    } else {
+        /* no thread available; fall back to scanning here */
+        word_index.scanning = 0;
+        vim_word_index_rebuild();
+    }
+}
+
+void vim_search(int n_args, char **args) {
+    static int  is_running = 0;
+    yed_frame  *f;
+    int         key;
+
+    if (!is_running) {
+        vim_state_load_search();
+
+        if (n_args > 0) {
+            vim_search_origin_from_cursor();
+            vim_search_update(args[0]);
+            vim_jump_push_pos(word_index.buffer, search_origin_row, search_origin_col);
+            search_jump_pending = 1;
+            vim_search_jump_from_origin();
+            return;
+        }
+
+        vim_search_origin_from_cursor();
+        ys->interactive_command = "vim-search";
+        ys->cmd_prompt          = "/";
+        yed_clear_cmd_buff();
+        yed_cmd_line_readline_reset(search_readline, &search_history);
+        is_running = 1;
+        return;
+    }
+
+    sscanf(args[0], "%d", &key);
+
+    switch (key) {
+        case ESC:
+        case CTRL_C:
+            ys->interactive_command = NULL;
+            yed_clear_cmd_buff();
+            is_running = 0;
+            vim_word_index_clear();
+            vim_search_set_highlight(NULL);
+            f = ys->active_frame;
+            if (f && f->buffer) {
+                yed_set_cursor_within_frame(f, search_origin_row, search_origin_col);
+            }
+            break;
+
+        case ENTER:
+            ys->interactive_command = NULL;
+            yed_clear_cmd_buff();
+            is_running = 0;
+            if (word_index.buffer) {
+                vim_jump_push_pos(word_index.buffer, search_origin_row, search_origin_col);
+                search_jump_pending = 1;
+                vim_search_jump_from_origin();
+            }
+            break;
+
+        default:
+            yed_cmd_line_readline_take_key(search_readline, key);
+            array_zero_term(ys->cmd_buff);
+            vim_search_update(array_data(ys->cmd_buff));
+    }
+}
+
+static void vim_word_index_shift_dirty(vim_line_shift *shift) {
+    int *d;
+
+    array_traverse(word_index.dirty, d) {
+        if (*d > shift->row || (*d == shift->row && shift->kind == BUFF_MOD_INSERT_LINE)) {
+            *d += shift->kind == BUFF_MOD_DELETE_LINE ? -1 : 1;
+        } else if (*d == shift->row) {
+            *d = 0; /* the dirty line itself is gone */
+        }
+    }
+}
+
+static void vim_word_index_buffer_post_mod(yed_event *event) {
+    vim_line_shift shift;
+    int           *d;
+
+    if (event->buffer == NULL || event->buffer != word_index.buffer || word_index.stale) {
+        return;
+    }
+
+    switch (event->buff_mod_event) {
+        case BUFF_MOD_ADD_LINE:
+        case BUFF_MOD_INSERT_LINE:
+        case BUFF_MOD_DELETE_LINE:
+            shift.kind = event->buff_mod_event == BUFF_MOD_DELETE_LINE
+                            ? BUFF_MOD_DELETE_LINE
+                            : BUFF_MOD_INSERT_LINE;
+            shift.row  = event->buff_mod_event == BUFF_MOD_ADD_LINE
+                            ? yed_buff_n_lines(event->buffer)
+                            : event->row;
+            vim_word_index_shift_dirty(&shift);
+            array_push(word_index.shifts, shift);
+            if (shift.kind == BUFF_MOD_INSERT_LINE) {
+                array_push(word_index.dirty, shift.row);
+            }
+            break;
+
+        case BUFF_MOD_CLEAR:
+            word_index.stale = 1;
+            return;
+
+        default:
+            array_traverse(word_index.dirty, d) {
+                if (*d == event->row) { return; }
+            }
+            array_push(word_index.dirty, event->row);
+    }
+
+    if (array_len(word_index.shifts) > VIM_WORD_INDEX_MAX_SHIFTS
+    ||  array_len(word_index.dirty)  > VIM_WORD_INDEX_MAX_DIRTY) {
+        word_index.stale = 1;
+    }
+}
+
+static void vim_word_index_buffer_pre_mod(yed_event *event) {
+    if (word_index.scanning && event->buffer == word_index.buffer) {
+        vim_search_cancel_worker();
+        word_index.stale = 1;
+    }
+}
+
+static void vim_word_index_buffer_pre_delete(yed_event *event) {
+    if (event->buffer == word_index.buffer) {
+        vim_word_index_clear();
+    }
+}
+
+static void vim_word_index_make(void) {
+    yed_event_handler h;
+
+    memset(&word_index, 0, sizeof(word_index));
+    word_index.matches = array_make(vim_match);
+    word_index.dirty   = array_make(int);
+    word_index.shifts  = array_make(vim_line_shift);
+
+    h.kind = EVENT_BUFFER_POST_MOD;
+    h.fn   = vim_word_index_buffer_post_mod;
+    yed_plugin_add_event_handler(Self, h);
+
+    h.kind = EVENT_BUFFER_PRE_MOD;
+    h.fn   = vim_word_index_buffer_pre_mod;
+    yed_plugin_add_event_handler(Self, h);
+
+    h.kind = EVENT_BUFFER_PRE_DELETE;
+    h.fn   = vim_word_index_buffer_pre_delete;
+    yed_plugin_add_event_handler(Self, h);
+
+    h.kind = EVENT_PRE_PUMP;
+    h.fn   = vim_search_drain;
+    yed_plugin_add_event_handler(Self, h);
+
+    search_head_matches = array_make(vim_match);
+    search_history      = array_make(char*);
+    search_readline     = malloc(sizeof(*search_readline));
+    yed_cmd_line_readline_make(search_readline, &search_history);
+
+    yed_plugin_set_command(Self, "vim-search", vim_search);
+}
+
+static void vim_word_index_free(void) {
+    vim_search_cancel_worker();
+    vim_search_set_highlight(NULL);
+    array_free(search_head_matches);
+    free(search_readline);
+    if (word_index.word) { free(word_index.word); }
+    array_free(word_index.matches);
+    array_free(word_index.dirty);
+    array_free(word_index.shifts);
+}
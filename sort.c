@@ -0,0 +1,409 @@
+/*
+ * :[range]sort[!] [n][u][r][i] [/pattern/]
+ *
+ * The lines are never copied to be sorted: each gets a small handle with its
+ * row and the bounds of its sort key inside the line's own bytes, and the
+ * handles are merge sorted -- for big ranges in chunks on as many threads as
+ * there are cores, then merged pairwise.  The buffer is then reordered by
+ * following the cycles of the resulting permutation, so every moved line is
+ * written once and only one line per cycle is held aside, and the whole thing
+ * is one undo record.
+ *
+ * Like vim, 'n' sorts on the first decimal number in the key (lines without
+ * one come first), 'i' ignores case, 'u' keeps the first of equal lines and
+ * '!' reverses the order.  With a pattern the key is what follows its first
+ * match, or the match itself with 'r'; lines without a match come first.
+ * Patterns are matched literally since nothing else in the plugin does
+ * regular expressions.
+ */
+
+/* Below this many lines per thread, sorting on more threads isn't worth it. */
+#define VIM_SORT_MIN_PER_THREAD (16384)
+#define VIM_SORT_MAX_THREADS    (16)
+
+typedef struct {
+    int         row;
+    const char *key;
+    int         key_len;
+    int         has_key; /* the pattern matched, or with 'n', a number was found */
+    long long   num;
+} vim_sort_line;
+
+typedef struct {
+    int numeric;
+    int unique;
+    int icase;
+    int reverse;
+} vim_sort_opts;
+
+/* A chunk to sort in place (m < 0), or two sorted runs src[0, m) and src[m, n) to merge into dst. */
+typedef struct {
+    vim_sort_line *src;
+    vim_sort_line *dst;
+    int            m, n;
+    vim_sort_opts *opts;
+} vim_sort_job;
+
+static int vim_sort_cmp(const vim_sort_line *a, const vim_sort_line *b, const vim_sort_opts *opts) {
+    int n, i, r, ca, cb;
+
+    if (a->has_key != b->has_key) { return a->has_key - b->has_key; }
+    if (!a->has_key)              { return 0; }
+
+    if (opts->numeric) {
+        r = a->num < b->num ? -1 : a->num > b->num;
+    } else {
+        n = a->key_len < b->key_len ? a->key_len : b->key_len;
+        r = 0;
+        if (opts->icase) {
+            for (i = 0; i < n && !r; i += 1) {
+                ca = tolower((unsigned char)a->key[i]);
+                cb = tolower((unsigned char)b->key[i]);
+                r  = ca - cb;
+            }
+        } else {
+            r = memcmp(a->key, b->key, n);
+        }
+        if (!r) { r = a->key_len - b->key_len; }
+    }
+
+    return opts->reverse ? -r : r;
+}
+
+/* For 'u': lines with equal keys are the same; lines without a key only if they are identical. */
+static int vim_sort_same(yed_buffer *buff, const vim_sort_line *a, const vim_sort_line *b, const vim_sort_opts *opts) {
+    yed_line *la, *lb;
+
+    if (vim_sort_cmp(a, b, opts) != 0) { return 0; }
+    if (a->has_key)                    { return 1; }
+
+    la = yed_buff_get_line(buff, a->row);
+    lb = yed_buff_get_line(buff, b->row);
+
+    return array_len(la->chars) == array_len(lb->chars)
+        && memcmp(array_data(la->chars), array_data(lb->chars), array_len(la->chars)) == 0;
+}
+
+/* Stable merge of the sorted runs src[0, m) and src[m, n) into dst. */
+static void vim_sort_merge(vim_sort_line *src, vim_sort_line *dst, int m, int n, vim_sort_opts *opts) {
+    int a, b, k;
+
+    a = 0;
+    b = m;
+    k = 0;
+    while (a < m && b < n) {
+        dst[k++] = vim_sort_cmp(&src[b], &src[a], opts) < 0 ? src[b++] : src[a++];
+    }
+    while (a < m) { dst[k++] = src[a++]; }
+    while (b < n) { dst[k++] = src[b++]; }
+}
+
+/* Bottom-up merge sort of lines[0, n) using tmp as scratch; the result ends up in lines. */
+static void vim_sort_run(vim_sort_line *lines, vim_sort_line *tmp, int n, vim_sort_opts *opts) {
+    vim_sort_line *src, *dst, *swap;
+    int            width, i, m, r;
+
+    src = lines;
+    dst = tmp;
+
+    for (width = 1; width < n; width *= 2) {
+        for (i = 0; i < n; i += 2 * width) {
+            m = i + width     < n ? width         : n - i;
+            r = i + 2 * width < n ? 2 * width     : n - i;
+            vim_sort_merge(src + i, dst + i, m, r, opts);
+        }
+        swap = src; src = dst; dst = swap;
+    }
+
+    if (src != lines) { memcpy(lines, src, n * sizeof(*lines)); }
+}
+
+static void *vim_sort_worker(void *arg) {
+    vim_sort_job *job;
+
+    job = arg;
+    if (job->m < 0) {
+        vim_sort_run(job->dst, job->src, job->n, job->opts);
+    } else {
+        vim_sort_merge(job->src, job->dst, job->m, job->n, job->opts);
+    }
+
+    return NULL;
+}
+
+/* Run the jobs, all but the first on threads of their own. */
+static void vim_sort_run_jobs(vim_sort_job *jobs, int n_jobs) {
+    pthread_t threads[VIM_SORT_MAX_THREADS];
+    int       started[VIM_SORT_MAX_THREADS];
+    int       i;
+
+    for (i = 1; i < n_jobs; i += 1) {
+        started[i] = pthread_create(&threads[i], NULL, vim_sort_worker, &jobs[i]) == 0;
+        if (!started[i]) {
+            vim_sort_worker(&jobs[i]);
+        }
+    }
+
+    vim_sort_worker(&jobs[0]);
+
+    for (i = 1; i < n_jobs; i += 1) {
+        if (started[i]) { pthread_join(threads[i], NULL); }
+    }
+}
+
+/*
+ * Sort lines[0, n): one chunk per core is sorted on its own thread, then
+ * neighbouring chunks are merged pairwise, each round's merges in parallel.
+ */
+static void vim_sort_parallel(vim_sort_line *lines, int n, vim_sort_opts *opts) {
+    vim_sort_line *tmp;
+    vim_sort_job   jobs[VIM_SORT_MAX_THREADS];
+    int            bounds[VIM_SORT_MAX_THREADS + 1];
+    int            n_chunks, n_jobs, i, step, lo, mid, hi;
+    long           n_cpus;
+
+    tmp = malloc((n ? n : 1) * sizeof(*tmp));
+
+    n_cpus   = sysconf(_SC_NPROCESSORS_ONLN);
+    n_chunks = n / VIM_SORT_MIN_PER_THREAD;
+    if (n_chunks > n_cpus)               { n_chunks = n_cpus;               }
+    if (n_chunks > VIM_SORT_MAX_THREADS) { n_chunks = VIM_SORT_MAX_THREADS; }
+    if (n_chunks < 1)                    { n_chunks = 1;                    }
+
+    for (i = 0; i <= n_chunks; i += 1) {
+        bounds[i] = (int)((long long)n * i / n_chunks);
+    }
+
+    for (i = 0; i < n_chunks; i += 1) {
+        jobs[i].src  = tmp + bounds[i];
+        jobs[i].dst  = lines + bounds[i];
+        jobs[i].m    = -1;
+        jobs[i].n    = bounds[i + 1] - bounds[i];
+        jobs[i].opts = opts;
+    }
+    vim_sort_run_jobs(jobs, n_chunks);
+
+    for (step = 1; step < n_chunks; step *= 2) {
+        n_jobs = 0;
+        for (i = 0; i + step < n_chunks; i += 2 * step) {
+            lo  = bounds[i];
+            mid = bounds[i + step];
+            hi  = bounds[i + 2 * step < n_chunks ? i + 2 * step : n_chunks];
+
+            memcpy(tmp + lo, lines + lo, (hi - lo) * sizeof(*tmp));
+
+            jobs[n_jobs].src  = tmp + lo;
+            jobs[n_jobs].dst  = lines + lo;
+            jobs[n_jobs].m    = mid - lo;
+            jobs[n_jobs].n    = hi - lo;
+            jobs[n_jobs].opts = opts;
+            n_jobs += 1;
+        }
+        vim_sort_run_jobs(jobs, n_jobs);
+    }
+
+    free(tmp);
+}
+
+/* Fill in the sort key of l from its line. */
+static void vim_sort_key(vim_sort_line *l, yed_line *line, const char *pat, int pat_len, int on_match, int numeric) {
+    const char *data, *p, *end;
+    int         len, idx, neg;
+
+    data = array_data(line->chars);
+    len  = array_len(line->chars);
+
+    l->key     = data;
+    l->key_len = len;
+    l->has_key = 1;
+    l->num     = 0;
+
+    if (pat_len > 0) {
+        idx = vim_find_in_bytes(data, len, pat, pat_len, 0, 0);
+        if (idx < 0) {
+            l->has_key = 0;
+            return;
+        }
+        l->key     = on_match ? data + idx : data + idx + pat_len;
+        l->key_len = on_match ? pat_len    : len - idx - pat_len;
+    }
+
+    if (numeric) {
+        end = l->key + l->key_len;
+        for (p = l->key; p < end && !isdigit((unsigned char)*p); p += 1);
+        if (p == end) {
+            l->has_key = 0;
+            return;
+        }
+        neg = p > l->key && p[-1] == '-';
+        for (; p < end && isdigit((unsigned char)*p); p += 1) {
+            l->num = l->num * 10 + (*p - '0');
+        }
+        if (neg) { l->num = -l->num; }
+    }
+}
+
+/*
+ * Put the lines of rows r1..r2 in the order given by the sorted handles,
+ * keeping only the first n_keep of them.
+ */
+static void vim_sort_reorder(yed_buffer *buff, int r1, int r2, vim_sort_line *sorted, int n_keep) {
+    yed_line *line;
+    array_t   held;
+    char     *done;
+    int      *src, n, i, j, row;
+
+    n    = r2 - r1 + 1;
+    src  = malloc(n * sizeof(int));
+    done = calloc(n, 1);
+    held = array_make(char);
+
+    /* rows that are dropped by 'u' go last, in any order: src is then a permutation of 0..n-1 */
+    for (i = 0; i < n; i += 1) {
+        src[i] = sorted[i].row - r1;
+    }
+
+    for (i = 0; i < n; i += 1) {
+        if (done[i] || src[i] == i) { continue; }
+
+        /* hold on to the first line of the cycle; every other line moves up from the next */
+        line = yed_buff_get_line(buff, r1 + i);
+        array_clear(held);
+        array_push_n(held, array_data(line->chars), array_len(line->chars));
+
+        for (j = i; !done[j]; j = src[j]) {
+            done[j] = 1;
+            row     = r1 + j;
+            if (src[j] == i) {
+                if (j < n_keep) {
+                    vim_buff_set_line_bytes(buff, row, array_data(held), array_len(held));
+                }
+                break;
+            }
+            if (j < n_keep) {
+                line = yed_buff_get_line(buff, r1 + src[j]);
+                vim_buff_set_line_bytes(buff, row, array_data(line->chars), array_len(line->chars));
+            }
+        }
+    }
+
+    for (row = r2; row >= r1 + n_keep; row -= 1) {
+        yed_buff_delete_line(buff, row);
+    }
+
+    array_free(held);
+    free(done);
+    free(src);
+}
+
+static void vim_sort(int n_args, char **args, int reverse) {
+    yed_frame     *f;
+    yed_buffer    *buff;
+    vim_sort_opts  opts;
+    vim_sort_line *lines;
+    array_t        flags;
+    char          *s, *pat, *w;
+    int            pat_len, on_match, r1, r2, n, i, n_keep;
+
+    f = ys->active_frame;
+    if (!f || !(buff = f->buffer)) {
+        yed_cerr("no active buffer");
+        return;
+    }
+
+    memset(&opts, 0, sizeof(opts));
+    opts.reverse = reverse;
+    on_match     = 0;
+    pat          = NULL;
+    pat_len      = 0;
+
+    /* the pattern may have been split at spaces; put the arguments back together */
+    flags = array_make(char);
+    for (i = 0; i < n_args; i += 1) {
+        if (i) { array_push(flags, *" "); }
+        array_push_n(flags, args[i], strlen(args[i]));
+    }
+    array_zero_term(flags);
+
+    for (s = array_data(flags); *s; s += 1) {
+        switch (*s) {
+            case ' ':                    break;
+            case 'n': opts.numeric = 1; break;
+            case 'u': opts.unique  = 1; break;
+            case 'i': opts.icase   = 1; break;
+            case 'r': on_match     = 1; break;
+            case '/':
+                pat = w = s + 1;
+                for (s += 1; *s && *s != '/'; s += 1) {
+                    if (*s == '\\' && s[1] == '/') { s += 1; }
+                    *w++ = *s;
+                }
+                pat_len = w - pat;
+                if (!*s) { s -= 1; }
+                break;
+            default:
+                yed_cerr("invalid sort option '%c'", *s);
+                array_free(flags);
+                return;
+        }
+    }
+
+    if (ex_range.given) {
+        r1 = ex_range.r1;
+        r2 = ex_range.r2;
+    } else {
+        r1 = 1;
+        r2 = yed_buff_n_lines(buff);
+    }
+
+    n = r2 - r1 + 1;
+    if (n < 2) {
+        array_free(flags);
+        return;
+    }
+
+    lines = malloc(n * sizeof(*lines));
+    for (i = 0; i < n; i += 1) {
+        lines[i].row = r1 + i;
+        vim_sort_key(&lines[i], yed_buff_get_line(buff, r1 + i), pat, pat_len, on_match, opts.numeric);
+    }
+
+    vim_sort_parallel(lines, n, &opts);
+
+    n_keep = n;
+    if (opts.unique) {
+        /* move the later duplicates to the end, keeping the rest in order */
+        vim_sort_line *dropped;
+        int            n_dropped;
+
+        dropped   = malloc(n * sizeof(*dropped));
+        n_keep    = 0;
+        n_dropped = 0;
+        for (i = 0; i < n; i += 1) {
+            if (n_keep > 0 && vim_sort_same(buff, &lines[n_keep - 1], &lines[i], &opts)) {
+                dropped[n_dropped++] = lines[i];
+            } else {
+                lines[n_keep++] = lines[i];
+            }
+        }
+        memcpy(lines + n_keep, dropped, n_dropped * sizeof(*lines));
+        free(dropped);
+    }
+
+    yed_start_undo_record(f, buff);
+    vim_sort_reorder(buff, r1, r2, lines, n_keep);
+    yed_end_undo_record(f, buff);
+
+    free(lines);
+    array_free(flags);
+
+    yed_set_cursor_within_frame(f, r1, 1);
+}
+
+void vim_sort_command(int n_args, char **args) {
+    vim_sort(n_args, args, 0);
+}
+
+void vim_sort_reverse_command(int n_args, char **args) {
+    vim_sort(n_args, args, 1);
+}
@@ -0,0 +1,710 @@
+/*
+ * State kept across restarts, like vim's viminfo: the registers, the ':' and
+ * '/' histories, the last search pattern, and the marks and last cursor
+ * position of every file.
+ *
+ * It lives in one binary file (vim-state-file, ~/.yed/vim_state by default)
+ * that is mmap()ed on boot without decoding anything.  Each section is decoded
+ * the first time it's needed: the registers on the first yank or put, the
+ * ':' history on the first ':', the search state on the first '/', 'n' or 'N'.
+ * Files are found with a binary search of a table sorted by path hash when
+ * they are loaded, so remembering thousands of them costs nothing at startup.
+ *
+ * The file is rewritten, through a temporary file and a rename, when yed quits
+ * or the plugin is unloaded.  Entries of files not opened in this session are
+ * copied over from the old mapping; the least recently used are dropped past
+ * VIM_STATE_MAX_FILES.
+ */
+
+#include <fcntl.h>
+#include <limits.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+
+#define VIM_STATE_MAGIC       (0x4d495659) /* "YVIM" */
+#define VIM_STATE_VERSION     (1)
+#define VIM_STATE_MAX_FILES   (5000)
+#define VIM_STATE_MAX_HISTORY (100)
+#define VIM_STATE_N_MARKS     (27) /* 'a'..'z' and ''' */
+
+enum {
+    VIM_STATE_REGISTERS,      /* vim_state_reg, each followed by its bytes */
+    VIM_STATE_CMD_HISTORY,    /* uint32_t length, then the bytes, oldest first */
+    VIM_STATE_SEARCH_HISTORY,
+    VIM_STATE_SEARCH,         /* one string: the last pattern */
+    VIM_STATE_FILES,          /* vim_state_file_rec, sorted by hash then path */
+    VIM_STATE_MARKS,          /* vim_state_mark_rec, referenced by the files */
+    VIM_STATE_STRINGS,        /* the file paths */
+
+    VIM_STATE_N_SECTIONS
+};
+
+/* Everything is stored in native byte order; the magic catches a mismatch. */
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t n_sections;
+    uint32_t pad;
+    struct {
+        uint64_t off;
+        uint64_t size;
+    } sections[VIM_STATE_N_SECTIONS];
+} vim_state_header;
+
+typedef struct {
+    uint32_t idx; /* slot in registers[] */
+    uint32_t linewise;
+    uint32_t n_lines;
+    uint32_t len;
+} vim_state_reg;
+
+typedef struct {
+    uint64_t hash;
+    uint64_t stamp; /* time the file was last seen */
+    uint32_t path_off;
+    uint32_t path_len;
+    int32_t  row;
+    int32_t  col;
+    uint32_t marks_off; /* first vim_state_mark_rec */
+    uint32_t n_marks;
+} vim_state_file_rec;
+
+typedef struct {
+    int32_t owner;
+    int32_t row;
+    int32_t col;
+} vim_state_mark_rec;
+
+/* A file seen in this session. */
+typedef struct {
+    char               *path;
+    uint64_t            hash;
+    uint64_t            stamp;
+    int                 row;
+    int                 col;
+    int                 n_marks;
+    vim_state_mark_rec  marks[VIM_STATE_N_MARKS];
+} vim_state_file;
+
+static const char *state_map;      /* the mapped file, NULL if there is none */
+static size_t      state_map_size;
+static int         state_loaded[VIM_STATE_N_SECTIONS];
+static array_t     state_files;    /* vim_state_file */
+static array_t     state_buffers;  /* yed_buffer*: loaded file buffers that are still open */
+static yed_buffer *state_restore_buffer; /* put the cursor back when it's shown in a frame */
+static int         state_restore_row;
+static int         state_restore_col;
+static int         state_saved;
+
+static uint64_t vim_state_hash(const char *s, int len) {
+    uint64_t h;
+    int      i;
+
+    h = 14695981039346656037ULL;
+    for (i = 0; i < len; i += 1) {
+        h ^= (unsigned char)s[i];
+        h *= 1099511628211ULL;
+    }
+
+    return h;
+}
+
+static char *vim_state_file_path(void) {
+    static char  buff[PATH_MAX];
+    char        *path, *home;
+
+    if ((path = yed_get_var("vim-state-file"))) { return path; }
+
+    if (!(home = getenv("HOME"))) { return NULL; }
+
+    snprintf(buff, sizeof(buff), "%s/.yed/vim_state", home);
+
+    return buff;
+}
+
+/* The canonical path of a file buffer, or NULL for buffers that aren't files. */
+static char *vim_state_buffer_path(yed_buffer *buff, char *out) {
+    if (!buff || buff->kind != BUFF_KIND_FILE || (buff->flags & BUFF_SPECIAL) || !buff->path) {
+        return NULL;
+    }
+
+    if (!realpath(buff->path, out)) {
+        snprintf(out, PATH_MAX, "%s", buff->path);
+    }
+
+    return out;
+}
+
+/* The bounds of a section in the map, or NULL if it's missing or there is no map. */
+static const char *vim_state_section(int which, size_t *size) {
+    const vim_state_header *h;
+
+    *size = 0;
+
+    if (!state_map) { return NULL; }
+
+    h     = (const vim_state_header*)state_map;
+    *size = h->sections[which].size;
+
+    return state_map + h->sections[which].off;
+}
+
+static void vim_state_map(void) {
+    const vim_state_header *h;
+    struct stat             st;
+    char                   *path;
+    void                   *map;
+    int                     fd, i;
+
+    if (!(path = vim_state_file_path()) || (fd = open(path, O_RDONLY)) < 0) { return; }
+
+    if (fstat(fd, &st) < 0 || (size_t)st.st_size < sizeof(vim_state_header)) {
+        close(fd);
+        return;
+    }
+
+    map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) { return; }
+
+    h = map;
+    if (h->magic != VIM_STATE_MAGIC || h->version != VIM_STATE_VERSION || h->n_sections != VIM_STATE_N_SECTIONS) {
+        goto bad;
+    }
+    for (i = 0; i < VIM_STATE_N_SECTIONS; i += 1) {
+        if (h->sections[i].off > (uint64_t)st.st_size
+        ||  h->sections[i].size > (uint64_t)st.st_size - h->sections[i].off) {
+            goto bad;
+        }
+    }
+
+    state_map      = map;
+    state_map_size = st.st_size;
+    return;
+
+bad:
+    munmap(map, st.st_size);
+}
+
+/*
+ * Walk the length prefixed strings of a section.  Returns a pointer past the
+ * string at *pos and advances *pos, or NULL at the end.
+ */
+static const char *vim_state_next_string(const char *sec, size_t size, size_t *pos, uint32_t *len) {
+    const char *s;
+
+    if (*pos + sizeof(uint32_t) > size) { return NULL; }
+
+    memcpy(len, sec + *pos, sizeof(uint32_t));
+    if (*len > size - *pos - sizeof(uint32_t)) { return NULL; }
+
+    s     = sec + *pos + sizeof(uint32_t);
+    *pos += sizeof(uint32_t) + ((*len + 3) & ~3);
+
+    return s;
+}
+
+/* Put the remembered entries in front of the ones typed in this session. */
+static void vim_state_load_history(array_t *history, int which) {
+    const char *sec, *s;
+    size_t      size, pos;
+    uint32_t    len;
+    char       *entry;
+    int         i;
+
+    sec = vim_state_section(which, &size);
+    pos = 0;
+    i   = 0;
+
+    while (sec && (s = vim_state_next_string(sec, size, &pos, &len))) {
+        entry = malloc(len + 1);
+        memcpy(entry, s, len);
+        entry[len] = 0;
+
+        if (i == array_len(*history)) {
+            array_push(*history, entry);
+        } else {
+            array_insert(*history, i, entry);
+        }
+        i += 1;
+    }
+}
+
+static void vim_state_load_registers(void) {
+    const char    *sec;
+    vim_state_reg  r;
+    vim_reg_text  *text;
+    size_t         size, pos;
+
+    if (state_loaded[VIM_STATE_REGISTERS]) { return; }
+    state_loaded[VIM_STATE_REGISTERS] = 1;
+
+    sec = vim_state_section(VIM_STATE_REGISTERS, &size);
+    pos = 0;
+
+    while (sec && pos + sizeof(r) <= size) {
+        memcpy(&r, sec + pos, sizeof(r));
+        pos += sizeof(r);
+
+        if (r.len > size - pos) { break; }
+
+        /* don't clobber anything set before the first use */
+        if (r.idx < VIM_N_REGISTERS && registers[r.idx] == NULL) {
+            text = vim_reg_text_new(r.linewise, r.len);
+            array_push_n(text->bytes, (char*)sec + pos, r.len);
+            text->n_lines      = r.n_lines;
+            registers[r.idx]   = text;
+        }
+
+        pos += (r.len + 3) & ~3;
+    }
+}
+
+static void vim_state_load_cmd_history(void) {
+    if (state_loaded[VIM_STATE_CMD_HISTORY]) { return; }
+    state_loaded[VIM_STATE_CMD_HISTORY] = 1;
+
+    vim_state_load_history(&_cmd_history, VIM_STATE_CMD_HISTORY);
+}
+
+static void vim_state_load_search(void) {
+    const char *sec, *s;
+    size_t      size, pos;
+    uint32_t    len;
+    char       *pat;
+
+    if (state_loaded[VIM_STATE_SEARCH]) { return; }
+    state_loaded[VIM_STATE_SEARCH]         = 1;
+    state_loaded[VIM_STATE_SEARCH_HISTORY] = 1;
+
+    vim_state_load_history(&search_history, VIM_STATE_SEARCH_HISTORY);
+
+    sec = vim_state_section(VIM_STATE_SEARCH, &size);
+    pos = 0;
+
+    if (search_hl_pattern == NULL && sec && (s = vim_state_next_string(sec, size, &pos, &len)) && len > 0) {
+        pat = malloc(len + 1);
+        memcpy(pat, s, len);
+        pat[len] = 0;
+        vim_search_set_highlight(pat);
+        free(pat);
+    }
+}
+
+/* The mapped entry for path, or NULL. */
+static const vim_state_file_rec *vim_state_find_mapped(const char *path) {
+    const vim_state_file_rec *recs, *r;
+    const char               *strings;
+    size_t                    size, strings_size;
+    uint64_t                  hash;
+    int                       lo, hi, mid, n, len;
+
+    recs = (const vim_state_file_rec*)vim_state_section(VIM_STATE_FILES, &size);
+    if (!recs) { return NULL; }
+
+    strings = vim_state_section(VIM_STATE_STRINGS, &strings_size);
+    n       = size / sizeof(*recs);
+    len     = strlen(path);
+    hash    = vim_state_hash(path, len);
+
+    lo = 0;
+    hi = n;
+    while (lo < hi) {
+        mid = lo + (hi - lo) / 2;
+        if (recs[mid].hash < hash) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+
+    for (r = recs + lo; r < recs + n && r->hash == hash; r += 1) {
+        if (r->path_len == (uint32_t)len
+        &&  (size_t)r->path_off + len <= strings_size
+        &&  memcmp(strings + r->path_off, path, len) == 0) {
+            return r;
+        }
+    }
+
+    return NULL;
+}
+
+static vim_state_file *vim_state_find_session(const char *path) {
+    vim_state_file *f;
+
+    array_traverse(state_files, f) {
+        if (strcmp(f->path, path) == 0) { return f; }
+    }
+
+    return NULL;
+}
+
+/* Remember where the cursor and marks of buff are now. */
+static void vim_state_capture(yed_buffer *buff) {
+    char            path_buff[PATH_MAX], *path;
+    vim_state_file *f, new_file;
+    yed_frame     **fit, *frame;
+    int             owner, row, col;
+
+    if (!(path = vim_state_buffer_path(buff, path_buff))) { return; }
+
+    if (!(f = vim_state_find_session(path))) {
+        memset(&new_file, 0, sizeof(new_file));
+        new_file.path = strdup(path);
+        new_file.hash = vim_state_hash(path, strlen(path));
+        array_push(state_files, new_file);
+        f = array_last(state_files);
+    }
+
+    f->stamp = time(NULL);
+    f->row   = buff->last_cursor_row;
+    f->col   = buff->last_cursor_col;
+
+    frame = NULL;
+    if (ys->active_frame && ys->active_frame->buffer == buff) {
+        frame = ys->active_frame;
+    } else {
+        array_traverse(ys->frames, fit) {
+            if ((*fit)->buffer == buff) { frame = *fit; break; }
+        }
+    }
+    if (frame) {
+        f->row = frame->cursor_line;
+        f->col = frame->cursor_col;
+    }
+
+    f->n_marks = 0;
+    for (owner = 'a'; owner <= 'z' + 1; owner += 1) {
+        if (!vim_pos_get(buff, owner > 'z' ? VIM_MARK_CONTEXT : owner, &row, &col)) { continue; }
+
+        f->marks[f->n_marks].owner = owner > 'z' ? VIM_MARK_CONTEXT : owner;
+        f->marks[f->n_marks].row   = row;
+        f->marks[f->n_marks].col   = col;
+        f->n_marks += 1;
+    }
+}
+
+static void vim_state_buffer_post_load(yed_event *event) {
+    char                      path_buff[PATH_MAX], *path;
+    const vim_state_file_rec *r;
+    const vim_state_mark_rec *marks;
+    vim_state_file           *f;
+    yed_buffer              **bit, *buff;
+    size_t                    size;
+    int                       n_lines, row, col, i;
+
+    buff = event->buffer;
+    if (!(path = vim_state_buffer_path(buff, path_buff))) { return; }
+
+    array_traverse(state_buffers, bit) {
+        if (*bit == buff) { break; }
+    }
+    if (bit == (yed_buffer**)array_data(state_buffers) + array_len(state_buffers)) {
+        array_push(state_buffers, buff);
+    }
+
+    n_lines = yed_buff_n_lines(buff);
+
+    if ((f = vim_state_find_session(path))) {
+        row = f->row;
+        col = f->col;
+        for (i = 0; i < f->n_marks; i += 1) {
+            if (f->marks[i].row <= n_lines) {
+                vim_pos_set_owner(buff, f->marks[i].owner, f->marks[i].row, f->marks[i].col);
+            }
+        }
+    } else if ((r = vim_state_find_mapped(path))) {
+        row   = r->row;
+        col   = r->col;
+        marks = (const vim_state_mark_rec*)vim_state_section(VIM_STATE_MARKS, &size);
+        if ((r->marks_off + (size_t)r->n_marks) * sizeof(*marks) <= size) {
+            for (i = 0; i < (int)r->n_marks; i += 1) {
+                if (marks[r->marks_off + i].row <= n_lines) {
+                    vim_pos_set_owner(buff, marks[r->marks_off + i].owner, marks[r->marks_off + i].row, marks[r->marks_off + i].col);
+                }
+            }
+        }
+    } else {
+        return;
+    }
+
+    if (row < 1 || row > n_lines) { return; }
+    if (col < 1)                  { col = 1; }
+
+    buff->last_cursor_row = row;
+    buff->last_cursor_col = col;
+    state_restore_buffer  = buff;
+    state_restore_row     = row;
+    state_restore_col     = col;
+}
+
+static void vim_state_frame_post_set_buffer(yed_event *event) {
+    if (event->frame == NULL || event->frame->buffer != state_restore_buffer || state_restore_buffer == NULL) { return; }
+
+    yed_set_cursor_far_within_frame(event->frame, state_restore_row, state_restore_col);
+    state_restore_buffer = NULL;
+}
+
+static void vim_state_buffer_pre_delete(yed_event *event) {
+    int i;
+
+    vim_state_capture(event->buffer);
+
+    for (i = 0; i < array_len(state_buffers); i += 1) {
+        if (*(yed_buffer**)array_item(state_buffers, i) == event->buffer) {
+            array_delete(state_buffers, i);
+            break;
+        }
+    }
+
+    if (state_restore_buffer == event->buffer) {
+        state_restore_buffer = NULL;
+    }
+}
+
+/* len bytes, padded to a multiple of four */
+static void vim_state_put_bytes(array_t *out, const char *s, uint32_t len) {
+    uint32_t zero;
+
+    zero = 0;
+    array_push_n(*out, (char*)s, len);
+    array_push_n(*out, (char*)&zero, ((len + 3) & ~3) - len);
+}
+
+static void vim_state_put_string(array_t *out, const char *s, uint32_t len) {
+    array_push_n(*out, (char*)&len, sizeof(len));
+    vim_state_put_bytes(out, s, len);
+}
+
+static void vim_state_put_history(array_t *out, array_t *history) {
+    char **it;
+    int    i;
+
+    i = 0;
+    array_traverse(*history, it) {
+        if (i++ >= array_len(*history) - VIM_STATE_MAX_HISTORY) {
+            vim_state_put_string(out, *it, strlen(*it));
+        }
+    }
+}
+
+static int vim_state_cmp_stamp(const void *a, const void *b) {
+    const vim_state_file *fa = a, *fb = b;
+
+    if (fa->stamp != fb->stamp) { return fa->stamp < fb->stamp ? 1 : -1; }
+    return 0;
+}
+
+static int vim_state_cmp_hash(const void *a, const void *b) {
+    const vim_state_file *fa = a, *fb = b;
+
+    if (fa->hash != fb->hash) { return fa->hash < fb->hash ? -1 : 1; }
+    return strcmp(fa->path, fb->path);
+}
+
+static void vim_state_save(void) {
+    char                      tmp_path[PATH_MAX + 8], *path;
+    vim_state_header          h;
+    vim_state_reg             r;
+    vim_state_file_rec        rec;
+    vim_state_file           *files, *f;
+    const vim_state_file_rec *mrecs, *mr;
+    const vim_state_mark_rec *mmarks;
+    const char               *mstrings;
+    yed_buffer              **bit;
+    array_t                   secs[VIM_STATE_N_SECTIONS], all;
+    size_t                    size, marks_size, strings_size, off;
+    uint32_t                  n_marks;
+    int                       n_files, n, i, fd, ok;
+    char                      zero;
+    FILE                     *fp;
+
+    if (state_saved || !(path = vim_state_file_path())) { return; }
+
+    /* decode whatever wasn't used this session so that it isn't dropped */
+    vim_state_load_registers();
+    vim_state_load_cmd_history();
+    vim_state_load_search();
+
+    array_traverse(state_buffers, bit) {
+        vim_state_capture(*bit);
+    }
+
+    for (i = 0; i < VIM_STATE_N_SECTIONS; i += 1) {
+        secs[i] = array_make(char);
+    }
+
+    for (i = 0; i < VIM_N_REGISTERS; i += 1) {
+        if (!registers[i]) { continue; }
+
+        r.idx      = i;
+        r.linewise = registers[i]->linewise;
+        r.n_lines  = registers[i]->n_lines;
+        r.len      = array_len(registers[i]->bytes);
+        array_push_n(secs[VIM_STATE_REGISTERS], (char*)&r, sizeof(r));
+        vim_state_put_bytes(&secs[VIM_STATE_REGISTERS], array_data(registers[i]->bytes), r.len);
+    }
+
+    vim_state_put_history(&secs[VIM_STATE_CMD_HISTORY],    &_cmd_history);
+    vim_state_put_history(&secs[VIM_STATE_SEARCH_HISTORY], &search_history);
+
+    if (search_hl_pattern) {
+        vim_state_put_string(&secs[VIM_STATE_SEARCH], search_hl_pattern, strlen(search_hl_pattern));
+    }
+
+    /* this session's files, then the remembered ones that weren't opened */
+    mrecs    = (const vim_state_file_rec*)vim_state_section(VIM_STATE_FILES, &size);
+    mmarks   = (const vim_state_mark_rec*)vim_state_section(VIM_STATE_MARKS, &marks_size);
+    mstrings = vim_state_section(VIM_STATE_STRINGS, &strings_size);
+    n        = mrecs ? size / sizeof(*mrecs) : 0;
+
+    files   = malloc((array_len(state_files) + n) * sizeof(*files));
+    n_files = 0;
+    array_traverse(state_files, f) {
+        files[n_files++] = *f;
+    }
+    for (mr = mrecs; mr && mr < mrecs + n; mr += 1) {
+        if ((size_t)mr->path_off + mr->path_len > strings_size
+        ||  (mr->marks_off + (size_t)mr->n_marks) * sizeof(*mmarks) > marks_size
+        ||  mr->n_marks > VIM_STATE_N_MARKS) {
+            continue;
+        }
+
+        f = files + n_files;
+        memset(f, 0, sizeof(*f));
+        f->path = strndup(mstrings + mr->path_off, mr->path_len);
+        if (vim_state_find_session(f->path)) {
+            free(f->path);
+            continue;
+        }
+        f->hash    = mr->hash;
+        f->stamp   = mr->stamp;
+        f->row     = mr->row;
+        f->col     = mr->col;
+        f->n_marks = mr->n_marks;
+        memcpy(f->marks, mmarks + mr->marks_off, mr->n_marks * sizeof(*mmarks));
+        n_files += 1;
+    }
+
+    qsort(files, n_files, sizeof(*files), vim_state_cmp_stamp);
+    for (i = VIM_STATE_MAX_FILES; i < n_files; i += 1) {
+        if (!vim_state_find_session(files[i].path)) { free(files[i].path); }
+    }
+    if (n_files > VIM_STATE_MAX_FILES) { n_files = VIM_STATE_MAX_FILES; }
+    qsort(files, n_files, sizeof(*files), vim_state_cmp_hash);
+
+    n_marks = 0;
+    for (i = 0; i < n_files; i += 1) {
+        f = files + i;
+
+        rec.hash      = f->hash;
+        rec.stamp     = f->stamp;
+        rec.path_off  = array_len(secs[VIM_STATE_STRINGS]);
+        rec.path_len  = strlen(f->path);
+        rec.row       = f->row;
+        rec.col       = f->col;
+        rec.marks_off = n_marks;
+        rec.n_marks   = f->n_marks;
+        array_push_n(secs[VIM_STATE_FILES],   (char*)&rec, sizeof(rec));
+        array_push_n(secs[VIM_STATE_STRINGS], f->path, rec.path_len);
+        array_push_n(secs[VIM_STATE_MARKS],   (char*)f->marks, f->n_marks * sizeof(*f->marks));
+        n_marks += f->n_marks;
+
+        if (!vim_state_find_session(f->path)) { free(f->path); }
+    }
+    free(files);
+
+    /* header, then the sections, each starting on an 8 byte boundary */
+    memset(&h, 0, sizeof(h));
+    zero         = 0;
+    h.magic      = VIM_STATE_MAGIC;
+    h.version    = VIM_STATE_VERSION;
+    h.n_sections = VIM_STATE_N_SECTIONS;
+
+    all = array_make_with_cap(char, 4096);
+    off = sizeof(h);
+    for (i = 0; i < VIM_STATE_N_SECTIONS; i += 1) {
+        h.sections[i].off  = off;
+        h.sections[i].size = array_len(secs[i]);
+        off               += (array_len(secs[i]) + 7) & ~7;
+    }
+    array_push_n(all, (char*)&h, sizeof(h));
+    for (i = 0; i < VIM_STATE_N_SECTIONS; i += 1) {
+        array_push_n(all, array_data(secs[i]), array_len(secs[i]));
+        while (array_len(all) & 7) {
+            array_push(all, zero);
+        }
+        array_free(secs[i]);
+    }
+
+    snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", path);
+    if ((fd = open(tmp_path, O_WRONLY | O_CREAT | O_TRUNC, 0600)) >= 0) {
+        ok = 0;
+        if ((fp = fdopen(fd, "w"))) {
+            /* on disk before the rename, so a crash can't leave a truncated state file */
+            ok = fwrite(array_data(all), 1, array_len(all), fp) == (size_t)array_len(all)
+              && fflush(fp) == 0
+              && fsync(fd)  == 0;
+            if (fclose(fp) != 0) { ok = 0; }
+        } else {
+            close(fd);
+        }
+
+        if (ok) {
+            rename(tmp_path, path);
+        } else {
+            unlink(tmp_path);
+        }
+    }
+
+    array_free(all);
+
+    /* yed may free the buffers without events after quitting, so don't look at them again */
+    state_saved = 1;
+}
+
+static void vim_state_pre_quit(yed_event *event) {
+    vim_state_save();
+}
+
+static void vim_state_make(void) {
+    yed_event_handler h;
+
+    state_files   = array_make(vim_state_file);
+    state_buffers = array_make(yed_buffer*);
+
+    vim_state_map();
+
+    h.kind = EVENT_BUFFER_POST_LOAD;
+    h.fn   = vim_state_buffer_post_load;
+    yed_plugin_add_event_handler(Self, h);
+
+    h.kind = EVENT_FRAME_POST_SET_BUFFER;
+    h.fn   = vim_state_frame_post_set_buffer;
+    yed_plugin_add_event_handler(Self, h);
+
+    /* registered before the marks' handler, so the marks are still there */
+    h.kind = EVENT_BUFFER_PRE_DELETE;
+    h.fn   = vim_state_buffer_pre_delete;
+    yed_plugin_add_event_handler(Self, h);
+
+    h.kind = EVENT_PRE_QUIT;
+    h.fn   = vim_state_pre_quit;
+    yed_plugin_add_event_handler(Self, h);
+}
+
+static void vim_state_free(void) {
+    vim_state_file *f;
+
+    array_traverse(state_files, f) {
+        free(f->path);
+    }
+    array_free(state_files);
+    array_free(state_buffers);
+
+    if (state_map) {
+        munmap((void*)state_map, state_map_size);
+        state_map = NULL;
+    }
+}
@@ -0,0 +1,63 @@
+/*
+ * vim-stats: a few numbers about the plugin itself, shown in the *vim-stats
+ * buffer.
+ */
+
+#include <stdarg.h>
+#include <time.h>
+
+static unsigned long long stats_boot_us;  /* time yed_plugin_boot() took */
+static unsigned long long stats_keys;     /* keys taken by the key hook */
+
+static unsigned long long vim_stats_now_us(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (ts.tv_sec * 1000000ULL) + (ts.tv_nsec / 1000);
+}
+
+static void vim_stats_line(array_t *out, const char *fmt, ...) {
+    va_list  va;
+    char     line[256];
+    int      len;
+
+    va_start(va, fmt);
+    len = vsnprintf(line, sizeof(line), fmt, va);
+    va_end(va);
+
+    if (len >= (int)sizeof(line)) { len = sizeof(line) - 1; }
+
+    array_push_n(*out, line, len);
+    line[0] = '\n';
+    array_push(*out, line[0]);
+}
+
+void vim_stats(int n_args, char **args) {
+    yed_buffer *buff;
+    array_t     text;
+
+    if (n_args != 0) {
+        yed_cerr("expected 0 arguments, but got %d", n_args);
+        return;
+    }
+
+    text = array_make(char);
+
+    vim_stats_line(&text, "boot time        %llu.%03llu ms", stats_boot_us / 1000, stats_boot_us % 1000);
+    vim_stats_line(&text, "keys taken       %llu", stats_keys);
+    vim_stats_line(&text, "mode             %s", mode_strs[mode]);
+    vim_stats_line(&text, "profile          %s", vim_large_active() ? "large file" : "normal");
+    vim_stats_line(&text, "large files      %d (over %d bytes)", array_len(large_buffers), vim_large_threshold());
+    array_zero_term(text);
+
+    buff = yed_get_or_create_special_rdonly_buffer("*vim-stats");
+    buff->flags &= ~BUFF_RD_ONLY;
+    yed_buff_clear_no_undo(buff);
+    yed_buff_insert_string_no_undo(buff, array_data(text), 1, 1);
+    buff->flags |= BUFF_RD_ONLY;
+
+    array_free(text);
+
+    YEXE("buffer", "*vim-stats");
+}
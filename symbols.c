@@ -0,0 +1,852 @@
+/*
+ * Section motions ('[[', ']]', '[]', '][') and 'gd'/'gD', from a per-buffer
+ * index of top level blocks.
+ *
+ * Every line of an indexed buffer has a record of the brace depth and block
+ * comment state it starts in, and of where on it a top level block opens or
+ * closes, if one does.  Strings, character literals and comments are skipped
+ * when counting braces.  A top level block opening is a section start; the
+ * definition it belongs to is named from the text before its '{' (the name
+ * before the parameter list of a function, the name of a struct, or the
+ * variable of an initializer).  Section starts and ends are kept in arrays
+ * sorted by row, so the motions are binary searches, and the names in an
+ * array sorted by name, rebuilt when a section has changed, so 'gd' is one.
+ *
+ * Records are built for buffers as they're loaded on a worker thread, from a
+ * copy of the text.  Buffers with the large file profile are scanned on
+ * demand instead, only as far as a motion needs.  An edit rescans just the
+ * edited line: if the depth and comment state it leaves didn't change, the
+ * rest of the index holds; otherwise the index is dropped from the line down
+ * and rebuilt from there when needed.
+ */
+
+#define VIM_SYM_HEADER_LINES (8) /* lines looked back over for a definition's name */
+
+typedef struct {
+    int     depth;     /* brace depth at the start of the line */
+    int     open_idx;  /* byte index of a '{' opening a top level block, or -1 */
+    int     close_idx; /* byte index of a '}' closing one, or -1 */
+    uint8_t comment;   /* the line starts inside a block comment */
+} vim_sym_line;
+
+typedef struct {
+    int   row;
+    char *name;     /* NULL if the definition has none */
+    int   name_row;
+    int   name_idx;
+} vim_sym_section;
+
+typedef struct {
+    yed_buffer *buffer;
+    char       *text;    /* copy of the buffer, lines separated by '\n' */
+    int         len;
+    array_t     lines;   /* vim_sym_line */
+    int         depth;   /* state after the last line */
+    int         comment;
+} vim_sym_job;
+
+typedef struct {
+    yed_buffer  *buffer;
+    array_t      lines;       /* vim_sym_line for rows 1..array_len(lines) */
+    int          depth;       /* state at the end of the last scanned row */
+    int          comment;
+    array_t      sections;    /* vim_sym_section, by row */
+    array_t      ends;        /* int rows of top level '}', ascending */
+    array_t      by_name;     /* int indices into sections, by name */
+    int          names_dirty; /* by_name needs rebuilding */
+    vim_sym_job *job;
+    pthread_t    thread;
+    int          threaded;    /* the job is running on thread */
+    atomic_int   job_done;
+} vim_sym_buffer;
+
+static array_t sym_buffers;     /* vim_sym_buffer* */
+static int     section_pending; /* '[' or ']' typed, waiting for the second key */
+static int     section_count;
+
+/* Follow brace depth and comment state across one line of text. */
+static void vim_sym_scan_line(const char *data, int len, vim_sym_line *rec, int *depth, int *comment) {
+    char c, quote;
+    int  i;
+
+    rec->depth     = *depth;
+    rec->comment   = *comment;
+    rec->open_idx  = -1;
+    rec->close_idx = -1;
+
+    quote = 0;
+
+    for (i = 0; i < len; i += 1) {
+        c = data[i];
+
+        if (*comment) {
+            if (c == '*' && i + 1 < len && data[i + 1] == '/') {
+                *comment  = 0;
+                i        += 1;
+            }
+            continue;
+        }
+
+        if (quote) {
+            if (c == '\\') {
+                i += 1;
+            } else if (c == quote) {
+                quote = 0;
+            }
+            continue;
+        }
+
+        switch (c) {
+            case '/':
+                if (i + 1 < len && data[i + 1] == '/') { return; }
+                if (i + 1 < len && data[i + 1] == '*') {
+                    *comment  = 1;
+                    i        += 1;
+                }
+                break;
+
+            case '"':
+            case '\'':
+                quote = c;
+                break;
+
+            case '{':
+                if (*depth == 0 && rec->open_idx < 0) { rec->open_idx = i; }
+                *depth += 1;
+                break;
+
+            case '}':
+                if (*depth > 0 && --*depth == 0) { rec->close_idx = i; }
+                break;
+        }
+    }
+}
+
+static vim_sym_buffer *vim_sym_for(yed_buffer *buff) {
+    vim_sym_buffer **sb;
+
+    if (!buff) { return NULL; }
+
+    array_traverse(sym_buffers, sb) {
+        if ((*sb)->buffer == buff) { return *sb; }
+    }
+
+    return NULL;
+}
+
+/*
+ * Reading backwards over up to VIM_SYM_HEADER_LINES lines before a '{', with
+ * line breaks read as spaces and '//' comments left out.
+ */
+typedef struct {
+    yed_buffer *buffer;
+    int         row;
+    int         idx;
+    int         stop_row;
+} vim_sym_reader;
+
+static int vim_sym_prev_char(vim_sym_reader *r) {
+    yed_line *line;
+    char     *data, *p;
+
+    if (r->idx <= 0) {
+        if (r->row <= r->stop_row) { return 0; }
+
+        r->row -= 1;
+        line    = yed_buff_get_line(r->buffer, r->row);
+        r->idx  = line ? array_len(line->chars) : 0;
+
+        if (r->idx > 1) {
+            data = array_data(line->chars);
+            for (p = data; (p = memchr(p, '/', r->idx - (p - data) - 1)); p += 1) {
+                if (p[1] == '/') {
+                    r->idx = p - data;
+                    break;
+                }
+            }
+        }
+
+        return ' ';
+    }
+
+    r->idx -= 1;
+    line    = yed_buff_get_line(r->buffer, r->row);
+
+    return ((char*)array_data(line->chars))[r->idx];
+}
+
+static int vim_sym_prev_nonspace(vim_sym_reader *r) {
+    int c;
+
+    while ((c = vim_sym_prev_char(r)) == ' ' || c == '\t' || c == '\r');
+
+    return c;
+}
+
+/* Step back over a bracketed group whose closing bracket was just read. */
+static int vim_sym_skip_group(vim_sym_reader *r, char open, char close) {
+    int c, nest;
+
+    for (nest = 1; nest > 0;) {
+        if (!(c = vim_sym_prev_char(r))) { return 0; }
+        if (c == close)     { nest += 1; }
+        else if (c == open) { nest -= 1; }
+    }
+
+    return vim_sym_prev_nonspace(r);
+}
+
+static int vim_sym_is_keyword(const char *s, int len) {
+    static const char *keywords[] = {
+        "if", "else", "for", "while", "do", "switch", "return", "sizeof",
+        "struct", "union", "enum", "const", "extern", "namespace",
+    };
+    int i;
+
+    for (i = 0; i < (int)(sizeof(keywords) / sizeof(keywords[0])); i += 1) {
+        if ((int)strlen(keywords[i]) == len && strncmp(keywords[i], s, len) == 0) { return 1; }
+    }
+
+    return 0;
+}
+
+/* Name the definition whose block opens at (row, open_idx). */
+static void vim_sym_name_section(yed_buffer *buff, vim_sym_section *s, int open_idx) {
+    vim_sym_reader  r;
+    yed_line       *line;
+    char           *data;
+    int             c, end;
+
+    free(s->name);
+    s->name = NULL;
+
+    r.buffer   = buff;
+    r.row      = s->row;
+    r.idx      = open_idx;
+    r.stop_row = s->row > VIM_SYM_HEADER_LINES ? s->row - VIM_SYM_HEADER_LINES : 1;
+
+    c = vim_sym_prev_nonspace(&r);
+
+    /* int table[] = {  */
+    if (c == '=') {
+        c = vim_sym_prev_nonspace(&r);
+        while (c == ']') { c = vim_sym_skip_group(&r, '[', ']'); }
+    }
+
+    /* int main(int argc, char **argv) {  */
+    if (c == ')') {
+        c = vim_sym_skip_group(&r, '(', ')');
+    }
+
+    if (!c || !vim_is_word_char((unsigned char)c)) { return; }
+
+    line = yed_buff_get_line(buff, r.row);
+    data = array_data(line->chars);
+    end  = r.idx + 1;
+    while (r.idx > 0 && vim_is_word_char((unsigned char)data[r.idx - 1])) { r.idx -= 1; }
+
+    if (is_digit(data[r.idx]) || vim_sym_is_keyword(data + r.idx, end - r.idx)) { return; }
+
+    s->name     = strndup(data + r.idx, end - r.idx);
+    s->name_row = r.row;
+    s->name_idx = r.idx;
+}
+
+/* Index of the first section at or after row. */
+static int vim_sym_section_lower_bound(vim_sym_buffer *sb, int row) {
+    int lo, hi, mid;
+
+    lo = 0;
+    hi = array_len(sb->sections);
+    while (lo < hi) {
+        mid = lo + (hi - lo) / 2;
+        if (((vim_sym_section*)array_item(sb->sections, mid))->row < row) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+
+    return lo;
+}
+
+/* Index of the first end at or after row. */
+static int vim_sym_end_lower_bound(vim_sym_buffer *sb, int row) {
+    int lo, hi, mid;
+
+    lo = 0;
+    hi = array_len(sb->ends);
+    while (lo < hi) {
+        mid = lo + (hi - lo) / 2;
+        if (*(int*)array_item(sb->ends, mid) < row) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+
+    return lo;
+}
+
+/* Put row's section start and end, as its record has them, into the index. */
+static void vim_sym_index_row(vim_sym_buffer *sb, int row) {
+    vim_sym_line    *rec;
+    vim_sym_section  s, *sp;
+    int              i;
+
+    rec = array_item(sb->lines, row - 1);
+
+    i = vim_sym_section_lower_bound(sb, row);
+    if (i < array_len(sb->sections) && (sp = array_item(sb->sections, i))->row == row) {
+        if (rec->open_idx >= 0) {
+            vim_sym_name_section(sb->buffer, sp, rec->open_idx);
+        } else {
+            free(sp->name);
+            array_delete(sb->sections, i);
+        }
+        sb->names_dirty = 1;
+    } else if (rec->open_idx >= 0) {
+        s.row  = row;
+        s.name = NULL;
+        vim_sym_name_section(sb->buffer, &s, rec->open_idx);
+        if (i == array_len(sb->sections)) {
+            array_push(sb->sections, s);
+        } else {
+            array_insert(sb->sections, i, s);
+        }
+        sb->names_dirty = 1;
+    }
+
+    i = vim_sym_end_lower_bound(sb, row);
+    if (i < array_len(sb->ends) && *(int*)array_item(sb->ends, i) == row) {
+        if (rec->close_idx < 0) { array_delete(sb->ends, i); }
+    } else if (rec->close_idx >= 0) {
+        if (i == array_len(sb->ends)) {
+            array_push(sb->ends, row);
+        } else {
+            array_insert(sb->ends, i, row);
+        }
+    }
+}
+
+/* Name again the sections whose header may include row. */
+static void vim_sym_rename_near(vim_sym_buffer *sb, int row) {
+    vim_sym_section *s;
+    int              i;
+
+    for (i = vim_sym_section_lower_bound(sb, row); i < array_len(sb->sections); i += 1) {
+        s = array_item(sb->sections, i);
+        if (s->row > row + VIM_SYM_HEADER_LINES) { break; }
+
+        vim_sym_name_section(sb->buffer, s, ((vim_sym_line*)array_item(sb->lines, s->row - 1))->open_idx);
+        sb->names_dirty = 1;
+    }
+}
+
+static void vim_sym_scan_to(vim_sym_buffer *sb, int row) {
+    vim_sym_line  rec;
+    yed_line     *line;
+    int           n_lines;
+
+    n_lines = yed_buff_n_lines(sb->buffer);
+    if (row > n_lines) { row = n_lines; }
+
+    while (array_len(sb->lines) < row) {
+        line = yed_buff_get_line(sb->buffer, array_len(sb->lines) + 1);
+        vim_sym_scan_line(array_data(line->chars), array_len(line->chars), &rec, &sb->depth, &sb->comment);
+        array_push(sb->lines, rec);
+        if (rec.open_idx >= 0 || rec.close_idx >= 0) { vim_sym_index_row(sb, array_len(sb->lines)); }
+    }
+}
+
+/* Forget the index from row down. */
+static void vim_sym_invalidate(vim_sym_buffer *sb, int row) {
+    vim_sym_line    *rec;
+    vim_sym_section *s;
+    int              i;
+
+    if (row > array_len(sb->lines)) { return; }
+
+    rec         = array_item(sb->lines, row - 1);
+    sb->depth   = rec->depth;
+    sb->comment = rec->comment;
+
+    while (array_len(sb->lines) >= row) {
+        array_pop(sb->lines);
+    }
+
+    i = vim_sym_section_lower_bound(sb, row);
+    while (array_len(sb->sections) > i) {
+        s = array_last(sb->sections);
+        free(s->name);
+        array_pop(sb->sections);
+        sb->names_dirty = 1;
+    }
+
+    i = vim_sym_end_lower_bound(sb, row);
+    while (array_len(sb->ends) > i) {
+        array_pop(sb->ends);
+    }
+}
+
+/* Move the index entries at or after row by delta rows. */
+static void vim_sym_shift(vim_sym_buffer *sb, int row, int delta) {
+    vim_sym_section *s;
+    int             *e;
+
+    array_traverse(sb->sections, s) {
+        if (s->row >= row)      { s->row      += delta; }
+        if (s->name_row >= row) { s->name_row += delta; }
+    }
+    array_traverse(sb->ends, e) {
+        if (*e >= row) { *e += delta; }
+    }
+}
+
+static void *vim_sym_worker(void *arg) {
+    vim_sym_buffer *sb;
+    vim_sym_job    *job;
+    vim_sym_line    rec;
+    char           *p, *end, *nl;
+
+    sb  = arg;
+    job = sb->job;
+    p   = job->text;
+    end = job->text + job->len;
+
+    for (;;) {
+        nl = memchr(p, '\n', end - p);
+        vim_sym_scan_line(p, (nl ? nl : end) - p, &rec, &job->depth, &job->comment);
+        array_push(job->lines, rec);
+        if (!nl) { break; }
+        p = nl + 1;
+    }
+
+    atomic_store_explicit(&sb->job_done, 1, memory_order_release);
+
+    return NULL;
+}
+
+/* Wait for the load scan of sb, if one is running, and take its records. */
+static void vim_sym_finish_job(vim_sym_buffer *sb) {
+    vim_sym_job  *job;
+    vim_sym_line *rec;
+    int           row;
+
+    if (!(job = sb->job)) { return; }
+
+    if (sb->threaded) {
+        pthread_join(sb->thread, NULL);
+        sb->threaded = 0;
+    }
+
+    array_free(sb->lines);
+    sb->lines   = job->lines;
+    sb->depth   = job->depth;
+    sb->comment = job->comment;
+    free(job->text);
+    free(job);
+    sb->job = NULL;
+
+    for (row = 1; row <= array_len(sb->lines); row += 1) {
+        rec = array_item(sb->lines, row - 1);
+        if (rec->open_idx >= 0 || rec->close_idx >= 0) { vim_sym_index_row(sb, row); }
+    }
+}
+
+static void vim_sym_start_job(vim_sym_buffer *sb) {
+    vim_sym_job *job;
+    array_t      text;
+    yed_line    *line;
+    int          row, n_lines;
+    char         nl;
+
+    n_lines = yed_buff_n_lines(sb->buffer);
+    text    = array_make(char);
+    nl      = '\n';
+
+    for (row = 1; row <= n_lines; row += 1) {
+        line = yed_buff_get_line(sb->buffer, row);
+        if (row > 1) { array_push(text, nl); }
+        array_push_n(text, array_data(line->chars), array_len(line->chars));
+    }
+    array_zero_term(text);
+
+    job        = calloc(1, sizeof(*job));
+    job->text  = array_data(text);
+    job->len   = array_len(text);
+    job->lines = array_make_with_cap(vim_sym_line, n_lines);
+
+    sb->job = job;
+    atomic_store(&sb->job_done, 0);
+
+    if (pthread_create(&sb->thread, NULL, vim_sym_worker, sb) == 0) {
+        sb->threaded = 1;
+    } else {
+        /* no thread available; do it here */
+        vim_sym_worker(sb);
+        vim_sym_finish_job(sb);
+    }
+}
+
+/* The index for the active buffer, made if needed, scanned to at least row. */
+static vim_sym_buffer *vim_sym_active(int row) {
+    vim_sym_buffer *sb;
+    yed_frame      *f;
+
+    f = ys->active_frame;
+    if (!f || !f->buffer) { return NULL; }
+
+    if (!(sb = vim_sym_for(f->buffer))) {
+        sb           = calloc(1, sizeof(*sb));
+        sb->buffer   = f->buffer;
+        sb->lines    = array_make(vim_sym_line);
+        sb->sections = array_make(vim_sym_section);
+        sb->ends     = array_make(int);
+        sb->by_name  = array_make(int);
+        array_push(sym_buffers, sb);
+    }
+
+    vim_sym_finish_job(sb);
+    vim_sym_scan_to(sb, row);
+
+    return sb;
+}
+
+/* '[[' (direction -1) and ']]', or with ends set, '[]' and ']['. */
+static void vim_sym_section_motion(int direction, int ends, int count) {
+    vim_sym_buffer *sb;
+    yed_frame      *f;
+    int             row, n_lines, i, n;
+
+    f       = ys->active_frame;
+    n_lines = f && f->buffer ? yed_buff_n_lines(f->buffer) : 0;
+
+    if (!(sb = vim_sym_active(f && f->buffer ? f->cursor_line : 0))) { return; }
+
+    row = f->cursor_line;
+
+    while (count-- > 0) {
+        if (direction > 0) {
+            /* scan only as far as the next boundary, a chunk at a time */
+            for (;;) {
+                i = ends ? vim_sym_end_lower_bound(sb, row + 1) : vim_sym_section_lower_bound(sb, row + 1);
+                n = ends ? array_len(sb->ends) : array_len(sb->sections);
+                if (i < n || array_len(sb->lines) >= n_lines) { break; }
+                vim_sym_scan_to(sb, array_len(sb->lines) + VIM_LARGE_SCAN_CHUNK);
+            }
+            row = i < n
+                ? (ends ? *(int*)array_item(sb->ends, i) : ((vim_sym_section*)array_item(sb->sections, i))->row)
+                : n_lines;
+        } else {
+            i   = (ends ? vim_sym_end_lower_bound(sb, row) : vim_sym_section_lower_bound(sb, row)) - 1;
+            row = i >= 0
+                ? (ends ? *(int*)array_item(sb->ends, i) : ((vim_sym_section*)array_item(sb->sections, i))->row)
+                : 1;
+        }
+    }
+
+    vim_jump_push();
+    yed_set_cursor_far_within_frame(f, row, 1);
+}
+
+static vim_sym_buffer *sym_sort_buffer;
+
+static int vim_sym_name_cmp(const void *a, const void *b) {
+    vim_sym_section *sa, *sb;
+
+    sa = array_item(sym_sort_buffer->sections, *(const int*)a);
+    sb = array_item(sym_sort_buffer->sections, *(const int*)b);
+
+    return strcmp(sa->name, sb->name);
+}
+
+static void vim_sym_sort_names(vim_sym_buffer *sb) {
+    vim_sym_section *s;
+    int              i;
+
+    if (!sb->names_dirty) { return; }
+
+    array_clear(sb->by_name);
+    i = 0;
+    array_traverse(sb->sections, s) {
+        if (s->name) { array_push(sb->by_name, i); }
+        i += 1;
+    }
+
+    sym_sort_buffer = sb;
+    qsort(array_data(sb->by_name), array_len(sb->by_name), sizeof(int), vim_sym_name_cmp);
+    sb->names_dirty = 0;
+}
+
+static vim_sym_section *vim_sym_lookup(vim_sym_buffer *sb, const char *name) {
+    vim_sym_section *s;
+    int              lo, hi, mid, cmp;
+
+    vim_sym_sort_names(sb);
+
+    lo = 0;
+    hi = array_len(sb->by_name);
+    while (lo < hi) {
+        mid = lo + (hi - lo) / 2;
+        s   = array_item(sb->sections, *(int*)array_item(sb->by_name, mid));
+        cmp = strcmp(s->name, name);
+        if (cmp == 0) { return s; }
+        if (cmp < 0) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+
+    return NULL;
+}
+
+/*
+ * 'gd': the top level definition of the word under the cursor if there is
+ * one, else its first whole-word occurrence in the current section, as vim
+ * does for a local declaration.  'gD' (global set) looks from the first line
+ * of the buffer instead of the section.
+ */
+static void vim_sym_goto_definition(int global) {
+    vim_sym_buffer  *sb;
+    vim_sym_section *s;
+    yed_frame       *f;
+    yed_line        *line;
+    char            *word;
+    int              row, idx, i, len;
+
+    f = ys->active_frame;
+    if (!f || !f->buffer) { return; }
+
+    word = yed_word_under_cursor();
+    if (word == NULL || *word == 0) {
+        yed_cerr("no word under cursor");
+        free(word);
+        return;
+    }
+    len = strlen(word);
+
+    sb = vim_sym_active(yed_buff_n_lines(f->buffer));
+
+    if ((s = vim_sym_lookup(sb, word))) {
+        vim_jump_push();
+        line = yed_buff_get_line(f->buffer, s->name_row);
+        yed_set_cursor_far_within_frame(f, s->name_row, yed_line_idx_to_col(line, s->name_idx));
+        free(word);
+        return;
+    }
+
+    row = 1;
+    if (!global) {
+        i = vim_sym_section_lower_bound(sb, f->cursor_line + 1) - 1;
+        if (i >= 0) {
+            s   = array_item(sb->sections, i);
+            row = s->name ? s->name_row : s->row;
+        }
+    }
+
+    for (; row <= f->cursor_line; row += 1) {
+        line = yed_buff_get_line(f->buffer, row);
+        idx  = vim_find_in_bytes(array_data(line->chars), array_len(line->chars), word, len, 1, 0);
+        if (idx >= 0) {
+            vim_jump_push();
+            yed_set_cursor_far_within_frame(f, row, yed_line_idx_to_col(line, idx));
+            free(word);
+            return;
+        }
+    }
+
+    yed_cerr("definition not found: %s", word);
+    free(word);
+}
+
+/* The key after '[' or ']'. */
+static void vim_sym_take_key(int key) {
+    int first, count;
+
+    first           = section_pending;
+    count           = section_count;
+    section_pending = 0;
+
+    if (key == '[' || key == ']') {
+        vim_sym_section_motion(first == ']' ? 1 : -1, key != first, count);
+    } else if (key != ESC && key != CTRL_C) {
+        yed_cerr("[NORMAL] unhandled key %c%c", first, key);
+    }
+}
+
+static void vim_sym_buffer_post_load(yed_event *event) {
+    vim_sym_buffer *sb;
+
+    /* large files are scanned as far as a motion needs instead */
+    if (!event->buffer || vim_sym_for(event->buffer) || vim_large_for(event->buffer)) { return; }
+
+    sb           = calloc(1, sizeof(*sb));
+    sb->buffer   = event->buffer;
+    sb->lines    = array_make(vim_sym_line);
+    sb->sections = array_make(vim_sym_section);
+    sb->ends     = array_make(int);
+    sb->by_name  = array_make(int);
+    array_push(sym_buffers, sb);
+
+    vim_sym_start_job(sb);
+}
+
+static void vim_sym_buffer_pre_mod(yed_event *event) {
+    vim_sym_buffer *sb;
+
+    /* the load scan's copy is of the text before this edit */
+    if ((sb = vim_sym_for(event->buffer))) { vim_sym_finish_job(sb); }
+}
+
+static void vim_sym_buffer_post_mod(yed_event *event) {
+    vim_sym_buffer *sb;
+    vim_sym_line    rec, *old;
+    yed_line       *line;
+    int             row, depth, comment, n_scanned;
+
+    if (!(sb = vim_sym_for(event->buffer))) { return; }
+
+    row       = event->row;
+    n_scanned = array_len(sb->lines);
+
+    switch (event->buff_mod_event) {
+        case BUFF_MOD_CLEAR:
+            vim_sym_invalidate(sb, 1);
+            return;
+
+        case BUFF_MOD_ADD_LINE:
+        case BUFF_MOD_INSERT_LINE:
+            if (row > n_scanned) { return; }
+
+            /* an empty line in the state the line it pushed down started in */
+            old           = array_item(sb->lines, row - 1);
+            rec.depth     = old->depth;
+            rec.comment   = old->comment;
+            rec.open_idx  = -1;
+            rec.close_idx = -1;
+            array_insert(sb->lines, row - 1, rec);
+            vim_sym_shift(sb, row, 1);
+            n_scanned += 1;
+            break;
+
+        case BUFF_MOD_DELETE_LINE:
+            if (row > n_scanned) { return; }
+
+            old     = array_item(sb->lines, row - 1);
+            depth   = row < n_scanned ? ((vim_sym_line*)array_item(sb->lines, row))->depth   : sb->depth;
+            comment = row < n_scanned ? ((vim_sym_line*)array_item(sb->lines, row))->comment : sb->comment;
+
+            if (depth != old->depth || comment != old->comment) {
+                vim_sym_invalidate(sb, row);
+                return;
+            }
+
+            old->open_idx  = -1;
+            old->close_idx = -1;
+            vim_sym_index_row(sb, row);
+            array_delete(sb->lines, row - 1);
+            vim_sym_shift(sb, row + 1, -1);
+            vim_sym_rename_near(sb, row);
+            return;
+    }
+
+    if (row > n_scanned) { return; }
+
+    /* rescan the line from the state it starts in */
+    old     = array_item(sb->lines, row - 1);
+    depth   = old->depth;
+    comment = old->comment;
+    line    = yed_buff_get_line(sb->buffer, row);
+    vim_sym_scan_line(array_data(line->chars), array_len(line->chars), &rec, &depth, &comment);
+
+    if (row < n_scanned) {
+        old = array_item(sb->lines, row);
+        if (depth != old->depth || comment != old->comment) {
+            vim_sym_invalidate(sb, row);
+            return;
+        }
+    } else {
+        sb->depth   = depth;
+        sb->comment = comment;
+    }
+
+    *(vim_sym_line*)array_item(sb->lines, row - 1) = rec;
+    vim_sym_index_row(sb, row);
+    vim_sym_rename_near(sb, row);
+}
+
+static void vim_sym_pump(yed_event *event) {
+    vim_sym_buffer **sb;
+
+    array_traverse(sym_buffers, sb) {
+        if ((*sb)->job && atomic_load_explicit(&(*sb)->job_done, memory_order_acquire)) {
+            vim_sym_finish_job(*sb);
+        }
+    }
+}
+
+static void vim_sym_free_buffer(vim_sym_buffer *sb) {
+    vim_sym_section *s;
+
+    vim_sym_finish_job(sb);
+
+    array_traverse(sb->sections, s) {
+        free(s->name);
+    }
+    array_free(sb->sections);
+    array_free(sb->ends);
+    array_free(sb->by_name);
+    array_free(sb->lines);
+    free(sb);
+}
+
+static void vim_sym_buffer_pre_delete(yed_event *event) {
+    vim_sym_buffer *sb;
+    int             i;
+
+    for (i = 0; i < array_len(sym_buffers); i += 1) {
+        sb = *(vim_sym_buffer**)array_item(sym_buffers, i);
+        if (sb->buffer == event->buffer) {
+            vim_sym_free_buffer(sb);
+            array_delete(sym_buffers, i);
+            return;
+        }
+    }
+}
+
+static void vim_symbols_make(void) {
+    yed_event_handler h;
+
+    sym_buffers = array_make(vim_sym_buffer*);
+
+    h.kind = EVENT_BUFFER_POST_LOAD;
+    h.fn   = vim_sym_buffer_post_load;
+    yed_plugin_add_event_handler(Self, h);
+
+    h.kind = EVENT_BUFFER_PRE_MOD;
+    h.fn   = vim_sym_buffer_pre_mod;
+    yed_plugin_add_event_handler(Self, h);
+
+    h.kind = EVENT_BUFFER_POST_MOD;
+    h.fn   = vim_sym_buffer_post_mod;
+    yed_plugin_add_event_handler(Self, h);
+
+    h.kind = EVENT_PRE_PUMP;
+    h.fn   = vim_sym_pump;
+    yed_plugin_add_event_handler(Self, h);
+
+    h.kind = EVENT_BUFFER_PRE_DELETE;
+    h.fn   = vim_sym_buffer_pre_delete;
+    yed_plugin_add_event_handler(Self, h);
+}
+
+static void vim_symbols_free(void) {
+    vim_sym_buffer **sb;
+
+    array_traverse(sym_buffers, sb) {
+        vim_sym_free_buffer(*sb);
+    }
+    array_free(sym_buffers);
+}
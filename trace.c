@@ -0,0 +1,146 @@
+/*
+ * Opt-in tracing (set vim-trace to yes) of where a keystroke's time goes: the
+ * key handlers, mode changes, every YEXE the plugin issues, the undo merges
+ * that end an insert, and yed's redraws.  Each span is written to a fixed
+ * ring with one atomic increment and no locks; when the ring wraps, the oldest
+ * spans are overwritten.  vim-trace-dump writes the ring out as Chrome trace
+ * event JSON, which chrome://tracing and Perfetto can open.
+ */
+
+#include <stdatomic.h>
+
+#define VIM_TRACE_RING_SIZE (16384) /* power of two */
+
+typedef struct {
+    unsigned long long  ts;  /* microseconds, CLOCK_MONOTONIC */
+    unsigned long long  dur;
+    const char         *arg_name;
+    int                 arg;
+    char                name[40];
+} vim_trace_event;
+
+static vim_trace_event    trace_ring[VIM_TRACE_RING_SIZE];
+static atomic_uint        trace_head;
+static int                trace_on;
+static unsigned long long trace_draw_start;
+
+/* Every YEXE in the plugin is a span when tracing. */
+#undef YEXE
+#define YEXE(cmd_name, ...)                                                                \
+do {                                                                                       \
+    char               *__YEXE_args[] = { __VA_ARGS__ };                                   \
+    unsigned long long  __YEXE_start  = VIM_TRACE_BEGIN();                                 \
+    yed_execute_command((cmd_name), sizeof(__YEXE_args) / sizeof(char*), __YEXE_args);     \
+    vim_trace_end((cmd_name), __YEXE_start, NULL, 0);                                      \
+} while (0)
+
+#define VIM_TRACE_BEGIN() (trace_on ? vim_stats_now_us() : 0)
+
+/* Record the span that VIM_TRACE_BEGIN() returned start for; arg_name may be NULL. */
+static void vim_trace_end(const char *name, unsigned long long start, const char *arg_name, int arg) {
+    vim_trace_event *e;
+
+    if (start == 0) { return; }
+
+    e           = trace_ring + (atomic_fetch_add(&trace_head, 1) & (VIM_TRACE_RING_SIZE - 1));
+    e->ts       = start;
+    e->dur      = vim_stats_now_us() - start;
+    e->arg_name = arg_name;
+    e->arg      = arg;
+    snprintf(e->name, sizeof(e->name), "%s", name);
+}
+
+static void vim_trace_pre_draw(yed_event *event) {
+    trace_draw_start = VIM_TRACE_BEGIN();
+}
+
+static void vim_trace_post_draw(yed_event *event) {
+    vim_trace_end("redraw", trace_draw_start, NULL, 0);
+    trace_draw_start = 0;
+}
+
+static void vim_trace_var_changed(yed_event *event) {
+    if (event->var_name && strcmp(event->var_name, "vim-trace") == 0) {
+        trace_on = yed_var_is_truthy("vim-trace");
+    }
+}
+
+static void vim_trace_put_json_string(FILE *f, const char *s) {
+    fputc('"', f);
+    for (; *s; s += 1) {
+        if (*s == '"' || *s == '\\') {
+            fprintf(f, "\\%c", *s);
+        } else if ((unsigned char)*s < 0x20) {
+            fprintf(f, "\\u%04x", *s);
+        } else {
+            fputc(*s, f);
+        }
+    }
+    fputc('"', f);
+}
+
+void vim_trace_dump(int n_args, char **args) {
+    vim_trace_event *e;
+    const char      *path;
+    FILE            *f;
+    unsigned         head, first, i, n;
+    int              pid;
+
+    if (n_args > 1) {
+        yed_cerr("expected 0 or 1 arguments, but got %d", n_args);
+        return;
+    }
+
+    path = n_args ? args[0] : "yed-vim-trace.json";
+
+    if (!(f = fopen(path, "w"))) {
+        yed_cerr("could not open '%s' for writing", path);
+        return;
+    }
+
+    head  = atomic_load(&trace_head);
+    first = head > VIM_TRACE_RING_SIZE ? head - VIM_TRACE_RING_SIZE : 0;
+    pid   = getpid();
+    n     = 0;
+
+    fprintf(f, "{\"traceEvents\":[\n");
+    for (i = first; i != head; i += 1) {
+        e = trace_ring + (i & (VIM_TRACE_RING_SIZE - 1));
+
+        fprintf(f, "%s{\"name\":", n ? ",\n" : "");
+        vim_trace_put_json_string(f, e->name);
+        fprintf(f, ",\"cat\":\"vim\",\"ph\":\"X\",\"ts\":%llu,\"dur\":%llu,\"pid\":%d,\"tid\":1",
+                e->ts, e->dur, pid);
+        if (e->arg_name) {
+            fprintf(f, ",\"args\":{\"%s\":%d}", e->arg_name, e->arg);
+        }
+        fprintf(f, "}");
+        n += 1;
+    }
+    fprintf(f, "\n],\"displayTimeUnit\":\"ms\"}\n");
+    fclose(f);
+
+    yed_cprint("wrote %u trace events to '%s'", n, path);
+}
+
+static void vim_trace_make(void) {
+    yed_event_handler h;
+
+    trace_on = yed_var_is_truthy("vim-trace");
+
+    h.kind = EVENT_VAR_POST_SET;
+    h.fn   = vim_trace_var_changed;
+    yed_plugin_add_event_handler(Self, h);
+
+    h.kind = EVENT_VAR_POST_UNSET;
+    h.fn   = vim_trace_var_changed;
+    yed_plugin_add_event_handler(Self, h);
+
+    h.kind = EVENT_PRE_DRAW_EVERYTHING;
+    h.fn   = vim_trace_pre_draw;
+    yed_plugin_add_event_handler(Self, h);
+
+    h.kind = EVENT_POST_DRAW_EVERYTHING;
+    h.fn   = vim_trace_post_draw;
+    yed_plugin_add_event_handler(Self, h);
+}
@@ -0,0 +1,734 @@
+/*
+ * Persistent undo (set vim-undo-dir to a directory to turn it on).
+ *
+ * Every file buffer keeps a journal of the line edits made to it since it
+ * was last written: a line's old and new text, a line inserted, or a line
+ * deleted with its text, with successive edits of the same line folded into
+ * one.  A line's new text is only copied once something else is edited or
+ * the file is written, not on every keystroke.  Each write appends the
+ * journal as one record to the file's undo file in vim-undo-dir, named after
+ * the file's path with '/' replaced by '%'.  Records are delta encoded: rows
+ * are stored as the difference from the previous edit's row, and a changed
+ * line as the length of the prefix and suffix it shares with its old text
+ * plus the two middles that differ.
+ *
+ * Each record ends with the size and modification time the file had when it
+ * was written.  When a file is loaded only that trailer is read, to check the
+ * undo file belongs to the file as it is now; the records themselves are read
+ * the first time 'u' runs out of yed's own undo history, so opening a big file
+ * costs nothing unless its old history is actually used.  From there 'u' and
+ * CTRL-R step through the writes, one record each.  Writing after undoing into
+ * the old history drops the records that were undone, as a new change drops
+ * redo in vim.  An undo file that doesn't match the file is started over on
+ * the next write.
+ */
+
+#define VIM_UNDO_MAGIC     (0x4e555659) /* "YVUN" */
+#define VIM_UNDO_REC_MAGIC (0x52555659) /* "YVUR", ends every record */
+#define VIM_UNDO_VERSION   (1)
+
+enum {
+    VIM_UNDO_SET, /* row's text went from old to new */
+    VIM_UNDO_INS, /* an empty line was inserted at row */
+    VIM_UNDO_DEL, /* the line at row, old, was deleted */
+};
+
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+} vim_undo_header;
+
+/* Ends each record, whose payload is preceded by its length as well. */
+typedef struct {
+    uint64_t file_size;
+    uint64_t file_mtime_ns;
+    uint32_t payload_len;
+    uint32_t magic;
+} vim_undo_trailer;
+
+/*
+ * In the journal old and new are whole lines; new is NULL while the SET is the
+ * last op and its line may still change.  Read back from a record, a SET
+ * has only the middles that differ; the prefix and suffix around them are
+ * taken from the line when the op is applied.
+ */
+typedef struct {
+    int   kind;
+    int   row;
+    int   prefix;
+    int   suffix;
+    char *old;
+    char *new;
+} vim_undo_op;
+
+typedef struct {
+    off_t   end; /* where the record ends in the undo file */
+    array_t ops; /* vim_undo_op */
+} vim_undo_rec;
+
+/*
+ * Positions in the history are offsets in the undo file: the end of the last
+ * record in effect, or the end of the header before the first.
+ */
+typedef struct {
+    yed_buffer *buffer;
+    char       *path;     /* of the undo file */
+    array_t     journal;  /* vim_undo_op: edits since pos */
+    int         valid;    /* the undo file's history ends with the file as loaded */
+    off_t       pos;      /* the state the journal starts from */
+    off_t       base;     /* the state the buffer is in when yed has nothing to undo */
+    int         stepped;  /* nothing has changed since 'u' or CTRL-R moved to base */
+    int         loaded;   /* records has been read */
+    array_t     records;  /* vim_undo_rec */
+    int         applying; /* edits are ours; don't journal them */
+} vim_undo_buffer;
+
+static array_t undo_buffers; /* vim_undo_buffer* */
+
+static vim_undo_buffer *vim_undo_for(yed_buffer *buff) {
+    vim_undo_buffer **ub;
+
+    if (!buff) { return NULL; }
+
+    array_traverse(undo_buffers, ub) {
+        if ((*ub)->buffer == buff) { return *ub; }
+    }
+
+    return NULL;
+}
+
+static void vim_undo_free_ops(array_t *ops) {
+    vim_undo_op *op;
+
+    array_traverse(*ops, op) {
+        free(op->old);
+        free(op->new);
+    }
+    array_free(*ops);
+}
+
+static void vim_undo_clear_ops(array_t *ops) {
+    vim_undo_op *op;
+
+    array_traverse(*ops, op) {
+        free(op->old);
+        free(op->new);
+    }
+    array_clear(*ops);
+}
+
+static void vim_undo_unload(vim_undo_buffer *ub) {
+    vim_undo_rec *rec;
+
+    array_traverse(ub->records, rec) {
+        vim_undo_free_ops(&rec->ops);
+    }
+    array_clear(ub->records);
+    ub->loaded = 0;
+}
+
+static char *vim_undo_line_text(yed_buffer *buff, int row) {
+    yed_line *line;
+
+    line = yed_buff_get_line(buff, row);
+
+    if (!line || array_len(line->chars) == 0) { return strdup(""); }
+
+    return strndup(array_data(line->chars), array_len(line->chars));
+}
+
+static uint64_t vim_undo_mtime_ns(struct stat *st) {
+    return (uint64_t)st->st_mtim.tv_sec * 1000000000ULL + st->st_mtim.tv_nsec;
+}
+
+/*
+ * Start tracking a file buffer that was just loaded or written, if persistent
+ * undo is on.  Only the undo file's last trailer is read.
+ */
+static vim_undo_buffer *vim_undo_track(yed_buffer *buff) {
+    vim_undo_buffer  *ub;
+    vim_undo_trailer  t;
+    struct stat       st;
+    char             *dir, *p, full_path[PATH_MAX], undo_path[PATH_MAX];
+    off_t             end;
+    int               fd;
+
+    if ((ub = vim_undo_for(buff)))                     { return ub;   }
+    if (!(dir = yed_get_var("vim-undo-dir")) || !*dir) { return NULL; }
+    if (!vim_state_buffer_path(buff, full_path))       { return NULL; }
+
+    for (p = full_path; *p; p += 1) {
+        if (*p == '/') { *p = '%'; }
+    }
+    snprintf(undo_path, sizeof(undo_path), "%s/%s", dir, full_path);
+
+    ub          = calloc(1, sizeof(*ub));
+    ub->buffer  = buff;
+    ub->path    = strdup(undo_path);
+    ub->journal = array_make(vim_undo_op);
+    ub->records = array_make(vim_undo_rec);
+    array_push(undo_buffers, ub);
+
+    if (stat(buff->path, &st) == 0 && (fd = open(ub->path, O_RDONLY)) >= 0) {
+        end = lseek(fd, -(off_t)sizeof(t), SEEK_END);
+        if (end >= (off_t)sizeof(vim_undo_header) && read(fd, &t, sizeof(t)) == sizeof(t)) {
+            ub->valid = t.magic == VIM_UNDO_REC_MAGIC
+                     && t.file_size == (uint64_t)st.st_size
+                     && t.file_mtime_ns == vim_undo_mtime_ns(&st);
+            ub->pos   = ub->base = end + sizeof(t);
+        }
+        close(fd);
+    }
+
+    return ub;
+}
+
+static void vim_undo_put_varint(array_t *out, uint64_t v) {
+    unsigned char b;
+
+    do {
+        b   = v & 0x7f;
+        v >>= 7;
+        if (v) { b |= 0x80; }
+        array_push(*out, b);
+    } while (v);
+}
+
+static void vim_undo_put_bytes(array_t *out, const char *s, int len) {
+    vim_undo_put_varint(out, len);
+    array_push_n(*out, (char*)s, len);
+}
+
+static int vim_undo_get_varint(const unsigned char **p, const unsigned char *end, uint64_t *v) {
+    int shift;
+
+    *v = 0;
+    for (shift = 0; *p < end && shift < 64; shift += 7) {
+        *v |= (uint64_t)(**p & 0x7f) << shift;
+        if (!(*(*p)++ & 0x80)) { return 1; }
+    }
+
+    return 0;
+}
+
+static char *vim_undo_get_bytes(const unsigned char **p, const unsigned char *end) {
+    uint64_t  len;
+    char     *s;
+
+    if (!vim_undo_get_varint(p, end, &len) || len > (uint64_t)(end - *p)) { return NULL; }
+
+    s   = strndup((const char*)*p, len);
+    *p += len;
+
+    return s;
+}
+
+#define VIM_UNDO_ZIGZAG(d)   (((uint64_t)(d) << 1) ^ (uint64_t)((int64_t)(d) >> 63))
+#define VIM_UNDO_UNZIGZAG(v) ((int64_t)((v) >> 1) ^ -(int64_t)((v) & 1))
+
+static void vim_undo_encode(array_t *ops, array_t *out) {
+    vim_undo_op   *op;
+    unsigned char  kind;
+    int            prev_row, old_len, new_len, prefix, suffix;
+
+    vim_undo_put_varint(out, array_len(*ops));
+
+    prev_row = 0;
+    array_traverse(*ops, op) {
+        kind = op->kind;
+        array_push(*out, kind);
+        vim_undo_put_varint(out, VIM_UNDO_ZIGZAG((int64_t)op->row - prev_row));
+        prev_row = op->row;
+
+        switch (op->kind) {
+            case VIM_UNDO_SET:
+                old_len = strlen(op->old);
+                new_len = strlen(op->new);
+
+                for (prefix = 0;
+                     prefix < old_len && prefix < new_len && op->old[prefix] == op->new[prefix];
+                     prefix += 1);
+                for (suffix = 0;
+                        suffix < old_len - prefix
+                     && suffix < new_len - prefix
+                     && op->old[old_len - 1 - suffix] == op->new[new_len - 1 - suffix];
+                     suffix += 1);
+
+                vim_undo_put_varint(out, prefix);
+                vim_undo_put_varint(out, suffix);
+                vim_undo_put_bytes(out, op->old + prefix, old_len - prefix - suffix);
+                vim_undo_put_bytes(out, op->new + prefix, new_len - prefix - suffix);
+                break;
+
+            case VIM_UNDO_DEL:
+                vim_undo_put_bytes(out, op->old, strlen(op->old));
+                break;
+        }
+    }
+}
+
+static int vim_undo_decode(const unsigned char *p, const unsigned char *end, array_t *ops) {
+    vim_undo_op  op;
+    uint64_t     n, i, v, prefix, suffix;
+    int          row;
+
+    if (!vim_undo_get_varint(&p, end, &n)) { return 0; }
+
+    row = 0;
+    for (i = 0; i < n; i += 1) {
+        if (p >= end) { return 0; }
+
+        memset(&op, 0, sizeof(op));
+        op.kind = *p++;
+
+        if (!vim_undo_get_varint(&p, end, &v)) { return 0; }
+        row    += VIM_UNDO_UNZIGZAG(v);
+        op.row  = row;
+
+        switch (op.kind) {
+            case VIM_UNDO_SET:
+                if (!vim_undo_get_varint(&p, end, &prefix)
+                ||  !vim_undo_get_varint(&p, end, &suffix)
+                ||  !(op.old = vim_undo_get_bytes(&p, end))) {
+                    return 0;
+                }
+                if (!(op.new = vim_undo_get_bytes(&p, end))) {
+                    free(op.old);
+                    return 0;
+                }
+                op.prefix = prefix;
+                op.suffix = suffix;
+                break;
+
+            case VIM_UNDO_INS:
+                break;
+
+            case VIM_UNDO_DEL:
+                if (!(op.old = vim_undo_get_bytes(&p, end))) { return 0; }
+                break;
+
+            default:
+                return 0;
+        }
+
+        array_push(*ops, op);
+    }
+
+    return p == end;
+}
+
+/* Read the whole undo file.  A damaged tail is dropped. */
+static int vim_undo_load(vim_undo_buffer *ub) {
+    vim_undo_header   h;
+    vim_undo_trailer  t;
+    vim_undo_rec      rec;
+    struct stat       st;
+    unsigned char    *data;
+    uint32_t          len;
+    off_t             off, end;
+    ssize_t           n;
+    int               fd;
+
+    if ((fd = open(ub->path, O_RDONLY)) < 0) { return 0; }
+
+    if (fstat(fd, &st) < 0 || st.st_size < (off_t)sizeof(h)) {
+        close(fd);
+        return 0;
+    }
+
+    data = malloc(st.st_size);
+    for (off = 0; off < st.st_size; off += n) {
+        if ((n = read(fd, data + off, st.st_size - off)) <= 0) { break; }
+    }
+    close(fd);
+
+    memcpy(&h, data, sizeof(h));
+    if (off < st.st_size || h.magic != VIM_UNDO_MAGIC || h.version != VIM_UNDO_VERSION) {
+        free(data);
+        return 0;
+    }
+
+    for (off = sizeof(h); off + (off_t)sizeof(len) <= st.st_size; off = end) {
+        memcpy(&len, data + off, sizeof(len));
+        end = off + sizeof(len) + len + sizeof(t);
+        if (end > st.st_size) { break; }
+
+        memcpy(&t, data + end - sizeof(t), sizeof(t));
+        if (t.magic != VIM_UNDO_REC_MAGIC || t.payload_len != len) { break; }
+
+        rec.end = end;
+        rec.ops = array_make(vim_undo_op);
+        if (!vim_undo_decode(data + off + sizeof(len), data + off + sizeof(len) + len, &rec.ops)) {
+            vim_undo_free_ops(&rec.ops);
+            break;
+        }
+        array_push(ub->records, rec);
+    }
+
+    free(data);
+    ub->loaded = 1;
+
+    return 1;
+}
+
+static void vim_undo_set_line(yed_buffer *buff, int row, const char *s) {
+    yed_buff_insert_line_no_undo(buff, row);
+    yed_buff_insert_string_no_undo(buff, s, row, 1);
+    yed_buff_delete_line_no_undo(buff, row + 1);
+}
+
+/* Apply a record's ops, or their inverses backwards.  Returns the first row touched. */
+static int vim_undo_apply(vim_undo_buffer *ub, vim_undo_rec *rec, int direction) {
+    yed_buffer  *buff;
+    vim_undo_op *op;
+    char        *text, *mid, *s;
+    int          n, i, len, prefix, suffix, mid_len, first;
+
+    buff  = ub->buffer;
+    n     = array_len(rec->ops);
+    first = yed_buff_n_lines(buff);
+
+    ub->applying = 1;
+
+    for (i = 0; i < n; i += 1) {
+        op = array_item(rec->ops, direction < 0 ? n - 1 - i : i);
+
+        switch (op->kind) {
+            case VIM_UNDO_SET:
+                text    = vim_undo_line_text(buff, op->row);
+                len     = strlen(text);
+                prefix  = op->prefix < len ? op->prefix : len;
+                suffix  = op->suffix < len - prefix ? op->suffix : len - prefix;
+                mid     = direction < 0 ? op->old : op->new;
+                mid_len = strlen(mid);
+
+                s = malloc(prefix + mid_len + suffix + 1);
+                memcpy(s, text, prefix);
+                memcpy(s + prefix, mid, mid_len);
+                memcpy(s + prefix + mid_len, text + len - suffix, suffix);
+                s[prefix + mid_len + suffix] = 0;
+
+                vim_undo_set_line(buff, op->row, s);
+                free(s);
+                free(text);
+                break;
+
+            case VIM_UNDO_INS:
+                if (direction < 0) {
+                    yed_buff_delete_line_no_undo(buff, op->row);
+                } else {
+                    yed_buff_insert_line_no_undo(buff, op->row);
+                }
+                break;
+
+            case VIM_UNDO_DEL:
+                if (direction < 0) {
+                    yed_buff_insert_line_no_undo(buff, op->row);
+                    yed_buff_insert_string_no_undo(buff, op->old, op->row, 1);
+                } else {
+                    yed_buff_delete_line_no_undo(buff, op->row);
+                }
+                break;
+        }
+
+        if (op->row < first) { first = op->row; }
+    }
+
+    ub->applying = 0;
+
+    buff->flags |= BUFF_MODIFIED;
+
+    return first;
+}
+
+/*
+ * 'u' (direction -1) and CTRL-R (1) in the written history of the current
+ * buffer.  'u' only gets here once yed has nothing left to undo, and CTRL-R
+ * only right after a step, with nothing changed since.  Returns 0 to leave the
+ * key to yed.
+ */
+static int vim_undo_step(int direction) {
+    yed_buffer      *buff;
+    vim_undo_buffer *ub;
+    vim_undo_rec    *rec;
+    int              n, idx, i, row;
+
+    buff = ys->active_frame ? ys->active_frame->buffer : NULL;
+
+    if (!(ub = vim_undo_for(buff)) || !ub->valid) { return 0; }
+
+    if (direction < 0 ? yed_get_undo_num_records(buff) > 0 : !ub->stepped) { return 0; }
+
+    if (!ub->loaded && !vim_undo_load(ub)) {
+        yed_cerr("couldn't read undo file '%s'", ub->path);
+        return 1;
+    }
+
+    n = array_len(ub->records);
+
+    for (idx = 0; idx < n; idx += 1) {
+        if (((vim_undo_rec*)array_item(ub->records, idx))->end > ub->base) { break; }
+    }
+
+    /* writes without changes make empty records; step over them */
+    if (direction < 0) {
+        for (i = idx - 1; i >= 0 && array_len(((vim_undo_rec*)array_item(ub->records, i))->ops) == 0; i -= 1);
+        if (i < 0) {
+            yed_cprint("already at oldest change");
+            return 1;
+        }
+        rec      = array_item(ub->records, i);
+        row      = vim_undo_apply(ub, rec, -1);
+        ub->base = i > 0 ? ((vim_undo_rec*)array_item(ub->records, i - 1))->end : (off_t)sizeof(vim_undo_header);
+    } else {
+        for (i = idx; i < n && array_len(((vim_undo_rec*)array_item(ub->records, i))->ops) == 0; i += 1);
+        if (i >= n) {
+            yed_cprint("already at newest change");
+            return 1;
+        }
+        rec      = array_item(ub->records, i);
+        row      = vim_undo_apply(ub, rec, 1);
+        ub->base = rec->end;
+        i       += 1;
+    }
+
+    ub->pos     = ub->base;
+    ub->stepped = 1;
+    vim_undo_clear_ops(&ub->journal);
+
+    if (row > yed_buff_n_lines(buff)) { row = yed_buff_n_lines(buff); }
+    if (row < 1)                      { row = 1;                      }
+    yed_set_cursor_far_within_frame(ys->active_frame, row, 1);
+    yed_cprint("at write %d of %d in the undo file", i, n);
+
+    return 1;
+}
+
+/* Take the new text of the last op if it's a SET still open, unless row is its row. */
+static void vim_undo_close_set(vim_undo_buffer *ub, int row) {
+    vim_undo_op *last;
+
+    last = array_len(ub->journal) ? array_last(ub->journal) : NULL;
+    if (!last || last->kind != VIM_UNDO_SET || last->new || last->row == row) { return; }
+
+    last->new = vim_undo_line_text(ub->buffer, last->row);
+}
+
+static void vim_undo_push(vim_undo_buffer *ub, int kind, int row) {
+    vim_undo_op op;
+
+    memset(&op, 0, sizeof(op));
+    op.kind = kind;
+    op.row  = row;
+    if (kind != VIM_UNDO_INS) {
+        op.old = vim_undo_line_text(ub->buffer, row);
+    }
+    array_push(ub->journal, op);
+}
+
+static void vim_undo_push_set(vim_undo_buffer *ub, int row) {
+    vim_undo_op *last;
+
+    last = array_len(ub->journal) ? array_last(ub->journal) : NULL;
+    if (last && last->kind == VIM_UNDO_SET && last->row == row && !last->new) { return; }
+
+    vim_undo_push(ub, VIM_UNDO_SET, row);
+}
+
+static void vim_undo_buffer_pre_mod(yed_event *event) {
+    vim_undo_buffer *ub;
+    int              row;
+
+    if (!(ub = vim_undo_for(event->buffer)) || ub->applying) { return; }
+
+    ub->stepped = 0;
+
+    /* before the rows move: an edit of the same line keeps the SET open */
+    switch (event->buff_mod_event) {
+        case BUFF_MOD_ADD_LINE:
+        case BUFF_MOD_INSERT_LINE:
+        case BUFF_MOD_DELETE_LINE:
+        case BUFF_MOD_CLEAR:
+            vim_undo_close_set(ub, 0);
+            break;
+
+        default:
+            vim_undo_close_set(ub, event->row);
+    }
+
+    switch (event->buff_mod_event) {
+        case BUFF_MOD_ADD_LINE:
+        case BUFF_MOD_INSERT_LINE:
+            break;
+
+        case BUFF_MOD_DELETE_LINE:
+            vim_undo_push(ub, VIM_UNDO_DEL, event->row);
+            break;
+
+        case BUFF_MOD_CLEAR:
+            /* a cleared buffer keeps one empty line */
+            for (row = yed_buff_n_lines(ub->buffer); row > 1; row -= 1) {
+                vim_undo_push(ub, VIM_UNDO_DEL, row);
+            }
+            vim_undo_push_set(ub, 1);
+            break;
+
+        default:
+            vim_undo_push_set(ub, event->row);
+    }
+}
+
+/* Line edits are taken care of in pre_mod; only inserted lines are journaled here. */
+static void vim_undo_buffer_post_mod(yed_event *event) {
+    vim_undo_buffer *ub;
+
+    if (!(ub = vim_undo_for(event->buffer)) || ub->applying) { return; }
+
+    switch (event->buff_mod_event) {
+        case BUFF_MOD_ADD_LINE:
+            vim_undo_push(ub, VIM_UNDO_INS, yed_buff_n_lines(ub->buffer));
+            break;
+
+        case BUFF_MOD_INSERT_LINE:
+            vim_undo_push(ub, VIM_UNDO_INS, event->row);
+            break;
+    }
+}
+
+/* Append the journal to the undo file as a record of the file just written. */
+static void vim_undo_buffer_post_write(yed_event *event) {
+    vim_undo_buffer  *ub;
+    vim_undo_header   h;
+    vim_undo_trailer  t;
+    struct stat       st;
+    array_t           out;
+    uint32_t          len;
+    off_t             size;
+    char             *dir;
+    int               fd, ok;
+
+    if (!(ub = vim_undo_for(event->buffer))) {
+        /* edits made before it was tracked are unknown: start the history here */
+        if (!(ub = vim_undo_track(event->buffer))) { return; }
+        ub->valid = 0;
+    }
+
+    if (stat(ub->buffer->path, &st) < 0) { return; }
+
+    if ((dir = yed_get_var("vim-undo-dir"))) {
+        mkdir(dir, 0700);
+    }
+
+    if ((fd = open(ub->path, O_RDWR | O_CREAT, 0644)) < 0) {
+        yed_cerr("couldn't write undo file '%s'", ub->path);
+        return;
+    }
+
+    size = lseek(fd, 0, SEEK_END);
+    ok   = 1;
+
+    if (!ub->valid || ub->pos < (off_t)sizeof(h) || ub->pos > size) {
+        h.magic   = VIM_UNDO_MAGIC;
+        h.version = VIM_UNDO_VERSION;
+        ok        = ftruncate(fd, 0) == 0 && pwrite(fd, &h, sizeof(h), 0) == sizeof(h);
+        ub->pos   = ub->base = sizeof(h);
+    } else if (ub->pos < size) {
+        /* undone writes are gone once something else is written */
+        ok = ftruncate(fd, ub->pos) == 0;
+    }
+
+    vim_undo_close_set(ub, 0);
+
+    out = array_make(char);
+    array_push_n(out, &len, sizeof(len));
+    vim_undo_encode(&ub->journal, &out);
+    len = array_len(out) - sizeof(len);
+    memcpy(array_data(out), &len, sizeof(len));
+
+    t.file_size     = st.st_size;
+    t.file_mtime_ns = vim_undo_mtime_ns(&st);
+    t.payload_len   = len;
+    t.magic         = VIM_UNDO_REC_MAGIC;
+    array_push_n(out, &t, sizeof(t));
+
+    ok = ok && pwrite(fd, array_data(out), array_len(out), ub->pos) == array_len(out);
+    close(fd);
+
+    if (ok) {
+        ub->pos   += array_len(out);
+        ub->valid  = 1;
+    } else {
+        ub->valid = 0;
+        yed_cerr("couldn't write undo file '%s'", ub->path);
+    }
+
+    array_free(out);
+    vim_undo_clear_ops(&ub->journal);
+    vim_undo_unload(ub);
+    ub->stepped = 0;
+}
+
+static void vim_undo_free_buffer(vim_undo_buffer *ub) {
+    vim_undo_unload(ub);
+    array_free(ub->records);
+    vim_undo_free_ops(&ub->journal);
+    free(ub->path);
+    free(ub);
+}
+
+static void vim_undo_untrack(yed_buffer *buff) {
+    int i;
+
+    for (i = 0; i < array_len(undo_buffers); i += 1) {
+        if ((*(vim_undo_buffer**)array_item(undo_buffers, i))->buffer == buff) {
+            vim_undo_free_buffer(*(vim_undo_buffer**)array_item(undo_buffers, i));
+            array_delete(undo_buffers, i);
+            return;
+        }
+    }
+}
+
+static void vim_undo_buffer_post_load(yed_event *event) {
+    /* a reload starts over from the file */
+    vim_undo_untrack(event->buffer);
+    vim_undo_track(event->buffer);
+}
+
+static void vim_undo_buffer_pre_delete(yed_event *event) {
+    vim_undo_untrack(event->buffer);
+}
+
+static void vim_undo_make(void) {
+    yed_event_handler h;
+
+    undo_buffers = array_make(vim_undo_buffer*);
+
+    h.kind = EVENT_BUFFER_POST_LOAD;
+    h.fn   = vim_undo_buffer_post_load;
+    yed_plugin_add_event_handler(Self, h);
+
+    h.kind = EVENT_BUFFER_PRE_MOD;
+    h.fn   = vim_undo_buffer_pre_mod;
+    yed_plugin_add_event_handler(Self, h);
+
+    h.kind = EVENT_BUFFER_POST_MOD;
+    h.fn   = vim_undo_buffer_post_mod;
+    yed_plugin_add_event_handler(Self, h);
+
+    h.kind = EVENT_BUFFER_POST_WRITE;
+    h.fn   = vim_undo_buffer_post_write;
+    yed_plugin_add_event_handler(Self, h);
+
+    h.kind = EVENT_BUFFER_PRE_DELETE;
+    h.fn   = vim_undo_buffer_pre_delete;
+    yed_plugin_add_event_handler(Self, h);
+}
+
+static void vim_undo_free(void) {
+    vim_undo_buffer **ub;
+
+    array_traverse(undo_buffers, ub) {
+        vim_undo_free_buffer(*ub);
+    }
+    array_free(undo_buffers);
+}
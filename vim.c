@@ -1,4 +1,5 @@
 #include <yed/plugin.h>
+#include <time.h>
 
 void vim_quit(int n_args, char **args);
 
@@ -9,7 +10,11 @@ static array_t _cmd;
 static array_t _cmd_history;
 static yed_cmd_line_readline_ptr_t _cmd_readline;
 
+static unsigned long long _boot_us;  /* time yed_plugin_boot() took */
+static unsigned long long _keys;     /* keys taken by the key hook */
+
 #include "tokens.c"
+#include "motions.c"
 #include "parse.c"
 #include "command.c"
 
@@ -27,13 +32,49 @@ vim_take_key (int n_args, char **args)
     expression(&_tokens);
 }
 
+static unsigned long long
+now_us (void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (ts.tv_sec * 1000000ULL) + (ts.tv_nsec / 1000);
+}
+
+void
+vim_stats (int n_args, char **args)
+{
+    if (n_args != 0) {
+        yed_cerr("expected 0 arguments, but got %d", n_args);
+        return;
+    }
+
+    yed_cprint("boot time %llu.%03llu ms, %llu keys taken", _boot_us / 1000, _boot_us % 1000, _keys);
+}
+
+/* Take every plain key through one hook instead of a binding per key code. */
+static void
+vim_key_pressed (yed_event *event)
+{
+    if (event->key <= 0 || event->key >= REAL_KEY_MAX || ys->interactive_command)
+        return;
+
+    event->cancel = 1;
+    _keys += 1;
+    tokens_push(&_tokens, event->key);
+    expression(&_tokens);
+}
+
 int
 yed_plugin_boot (yed_plugin *self)
 {
-    char  key_str[32];
-    int key;
+    yed_event_handler h;
+    unsigned long long start_us;
     YED_PLUG_VERSION_CHECK();
 
+    start_us = now_us();
+
     tokens_make(&_tokens);
 
     _number = array_make(char);
@@ -45,10 +86,13 @@ yed_plugin_boot (yed_plugin *self)
 
     yed_plugin_set_command(self, "vim-take-key", vim_take_key);
     yed_plugin_set_command(self, "vim-command", vim_command);
-    for (key = 1; key < REAL_KEY_MAX; key += 1) {
-        sprintf(key_str, "%d", key);
-        YPBIND(self, key, "vim-take-key", key_str);
-    }
+    yed_plugin_set_command(self, "vim-stats", vim_stats);
+
+    h.kind = EVENT_KEY_PRESSED;
+    h.fn   = vim_key_pressed;
+    yed_plugin_add_event_handler(self, h);
+
+    _boot_us = now_us() - start_us;
 
     return 0;
 }